@@ -13,7 +13,7 @@ driver::driver()
 void
 driver::register_device(pci_device *device)
 {
-	log::info(logs::driver, "AHCI registering device %d:%d:%d:",
+	log_info(logs::driver, "AHCI registering device %d:%d:%d:",
 			device->bus(), device->device(), device->function());
 
 	ahci::hba &hba = m_devices.emplace(device);
@@ -62,7 +62,7 @@ hba::hba(pci_device *device)
 	device_manager &dm = device_manager::get();
 
 	uint32_t bar5 = device->get_bar(5);
-	log::debug(logs::driver, "HBA raw BAR5 is %08lx", bar5);
+	log_debug(logs::driver, "HBA raw BAR5 is %08lx", bar5);
 
 	void *data = reinterpret_cast<void *>(bar5 & ~0xfffull);
 	pm->map_offset_pointer(&data, 0x2000);
@@ -76,8 +76,8 @@ hba::hba(pci_device *device)
 	unsigned ports = (icap & 0xf) + 1;
 	unsigned slots = ((icap >> 8) & 0x1f) + 1;
 
-	log::debug(logs::driver, "  %d ports: %08x", ports, m_data->port_impl);
-	log::debug(logs::driver, "  %d command slots", slots);
+	log_debug(logs::driver, "  %d ports: %08x", ports, m_data->port_impl);
+	log_debug(logs::driver, "  %d command slots", slots);
 
 	auto *pd = reinterpret_cast<port_data volatile *>(
 			kutil::offset_pointer(m_data, 0x100));
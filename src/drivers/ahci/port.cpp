@@ -159,7 +159,7 @@ port::update()
 			m_type == sata_signature::satapi_drive ? "SATAPI" :
 			"Other";
 
-		log::info(logs::driver, "Found device type %s at port %d", name, m_index);
+		log_info(logs::driver, "Found device type %s at port %d", name, m_index);
 
 		rebase();
 		m_pending.set_size(32);
@@ -220,12 +220,12 @@ port::make_command(size_t length, fis_register_h2d **fis)
 			slot = i;
 			break;
 		} else {
-			log::debug(logs::driver, "Type is %d", m_pending[i].type);
+			log_debug(logs::driver, "Type is %d", m_pending[i].type);
 		}
 	}
 
 	if (slot < 0) {
-		log::error(logs::driver, "AHCI could not get a free command slot.");
+		log_error(logs::driver, "AHCI could not get a free command slot.");
 		return -1;
 	}
 
@@ -266,7 +266,7 @@ port::make_command(size_t length, fis_register_h2d **fis)
 	}
 
 
-	log::debug(logs::driver, "Created command, slot %d, %d PRD entries.",
+	log_debug(logs::driver, "Created command, slot %d, %d PRD entries.",
 			slot, ent.prd_table_length);
 	return slot;
 }
@@ -296,7 +296,7 @@ port::read_async(uint64_t offset, size_t length, void *dest)
 	fis->count0 = (count     ) & 0xff;
 	fis->count1 = (count >> 8) & 0xff;
 
-	log::debug(logs::driver, "Reading %d sectors, starting from %d (0x%lx)",
+	log_debug(logs::driver, "Reading %d sectors, starting from %d (0x%lx)",
 			count, sector, sector*512);
 
 	m_pending[slot].type = command_type::read;
@@ -367,7 +367,7 @@ port::issue_command(int slot)
 	int tries = 0;
 	while (busy()) {
 		if (++tries == max_tries) {
-			log::warn(logs::driver, "AHCI port was busy too long");
+			log_warn(logs::driver, "AHCI port was busy too long");
 			free_command(slot);
 			return false;
 		}
@@ -383,7 +383,7 @@ port::issue_command(int slot)
 void
 port::handle_interrupt()
 {
-	log::debug(logs::driver, "AHCI port %d got an interrupt", m_index);
+	log_debug(logs::driver, "AHCI port %d got an interrupt", m_index);
 
 	// TODO: handle other states in interrupt_status
 
@@ -397,12 +397,12 @@ port::handle_interrupt()
 	}
 
 	if (is & 0x40000000) {
-		log::error(logs::driver, "AHCI task file error");
+		log_error(logs::driver, "AHCI task file error");
 		dump();
 		kassert(0, "Task file error");
 	}
 
-	log::debug(logs::driver, "AHCI interrupt status: %08lx  %08lx",
+	log_debug(logs::driver, "AHCI interrupt status: %08lx  %08lx",
 			m_data->interrupt_status, m_data->serial_error);
 
 	uint32_t ci = m_data->cmd_issue;
@@ -448,7 +448,7 @@ port::finish_read(int slot)
 
 		void *mem = kutil::offset_pointer(pm->offset_virt(phys), offset);
 
-		log::debug(logs::driver, "Reading PRD %2d: %016lx->%016lx [%lxb]", i, mem, p, prd_len);
+		log_debug(logs::driver, "Reading PRD %2d: %016lx->%016lx [%lxb]", i, mem, p, prd_len);
 
 		kutil::memcpy(p, mem, prd_len);
 		p = kutil::offset_pointer(p, prd_len - offset);
@@ -489,34 +489,34 @@ port::finish_identify(int slot)
 		static_cast<uintptr_t>(cmdt.entries[0].data_base_low) |
 		static_cast<uintptr_t>(cmdt.entries[0].data_base_high) << 32;
 
-	log::debug(logs::driver, "Reading ident PRD:");
+	log_debug(logs::driver, "Reading ident PRD:");
 
 	uint16_t *mem = reinterpret_cast<uint16_t *>(pm->offset_virt(phys));
 	char string[41];
 
 	ident_strcpy(&mem[10], 10, &string[0]);
-	log::debug(logs::driver, "    Device serial: %s", string);
+	log_debug(logs::driver, "    Device serial: %s", string);
 
 	ident_strcpy(&mem[23], 4, &string[0]);
-	log::debug(logs::driver, "   Device version: %s", string);
+	log_debug(logs::driver, "   Device version: %s", string);
 
 	ident_strcpy(&mem[27], 20, &string[0]);
-	log::debug(logs::driver, "     Device model: %s", string);
+	log_debug(logs::driver, "     Device model: %s", string);
 
 	uint32_t sectors = mem[60] | (mem[61] << 16);
-	log::debug(logs::driver, "      Max sectors: %xh", sectors);
+	log_debug(logs::driver, "      Max sectors: %xh", sectors);
 
 	uint16_t lb_size = mem[106];
-	log::debug(logs::driver, " lsects per psect: %d %s %s", 1 << (lb_size & 0xf),
+	log_debug(logs::driver, " lsects per psect: %d %s %s", 1 << (lb_size & 0xf),
 			lb_size & 0x20 ? "multiple logical per physical" : "",
 			lb_size & 0x10 ? "physical > 512b" : "");
 
 	uint32_t b_per_ls = 2 * (mem[117] | (mem[118] << 16));
-	log::debug(logs::driver, "      b per lsect: %d", b_per_ls);
+	log_debug(logs::driver, "      b per lsect: %d", b_per_ls);
 
 	/*
 	for (int i=0; i<256; i += 4)
-		log::debug(logs::driver, "  %3d: %04x  %3d: %04x  %3d: %04x  %3d: %04x",
+		log_debug(logs::driver, "  %3d: %04x  %3d: %04x  %3d: %04x  %3d: %04x",
 				i, mem[i], i+1, mem[i+1], i+2, mem[i+2], i+3, mem[i+3]);
 	*/
 
@@ -559,7 +559,7 @@ port::rebase()
 	void *mem = pm->map_offset_pages(pages);
 	uintptr_t phys = pm->offset_phys(mem);
 
-	log::debug(logs::driver, "Rebasing address for AHCI port %d to %lx [%d]", m_index, mem, pages);
+	log_debug(logs::driver, "Rebasing address for AHCI port %d to %lx [%d]", m_index, mem, pages);
 
 	stop_commands();
 
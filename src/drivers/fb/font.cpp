@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "font.h"
 
 
@@ -37,7 +39,9 @@ font::font(void const *data) :
 	m_sizex {0},
 	m_sizey {0},
 	m_count {0},
-	m_data {nullptr}
+	m_data {nullptr},
+	m_cache {},
+	m_cache_next {0}
 {
 	if (!data)
 		data = default_font;
@@ -53,8 +57,39 @@ font::font(void const *data) :
 	m_count = psf2->length;
 }
 
+const screen::pixel_t *
+font::rasterized(screen::pixel_t fg, screen::pixel_t bg)
+{
+	for (auto &c : m_cache) {
+		if (c.pixels && c.fg == fg && c.bg == bg)
+			return c.pixels;
+	}
+
+	glyph_cache &c = m_cache[m_cache_next % cache_size];
+	if (!c.pixels) {
+		c.pixels = reinterpret_cast<screen::pixel_t*>(
+			malloc(m_count * m_sizex * m_sizey * sizeof(screen::pixel_t)));
+		if (!c.pixels)
+			return nullptr;
+	}
+
+	++m_cache_next;
+	c.fg = fg;
+	c.bg = bg;
+
+	screen::pixel_t *out = c.pixels;
+	for (unsigned g = 0; g < m_count; ++g) {
+		for (unsigned dy = 0; dy < m_sizey; ++dy) {
+			for (unsigned dx = 0; dx < m_sizex; ++dx)
+				*out++ = pixel(g, dx, dy) ? fg : bg;
+		}
+	}
+
+	return c.pixels;
+}
+
 void
-font::draw_glyph(
+font::draw_bitmap(
 		screen &s,
 		uint32_t glyph,
 		screen::pixel_t fg,
@@ -62,19 +97,64 @@ font::draw_glyph(
 		unsigned x,
 		unsigned y) const
 {
-	unsigned bwidth = (m_sizex+7)/8;
-	uint8_t const *data = m_data + (glyph * glyph_bytes());
-
-	for (int dy = 0; dy < m_sizey; ++dy) {
-		for (int dx = 0; dx < bwidth; ++dx) {
-			uint8_t byte = data[dy * bwidth + dx];
-			for (int i = 0; i < 8; ++i) {
-				if (dx*8 + i >= m_sizex) break;
-				const uint8_t mask = 1 << (7-i);
-				uint32_t c = (byte & mask) ? fg : bg;
-				s.draw_pixel(x + dx*8 + i, y + dy, c);
+	for (unsigned dy = 0; dy < m_sizey; ++dy) {
+		screen::pixel_t *row = s.row(y + dy) + x;
+		for (unsigned dx = 0; dx < m_sizex; ++dx)
+			row[dx] = pixel(glyph, dx, dy) ? fg : bg;
+	}
+}
+
+void
+font::draw_glyph(
+		screen &s,
+		uint32_t glyph,
+		screen::pixel_t fg,
+		screen::pixel_t bg,
+		unsigned x,
+		unsigned y)
+{
+	const screen::pixel_t *glyphs = rasterized(fg, bg);
+	if (glyphs) {
+		const screen::pixel_t *pixels = glyphs + index(glyph) * m_sizex * m_sizey;
+		for (unsigned dy = 0; dy < m_sizey; ++dy)
+			memcpy(s.row(y + dy) + x, pixels + dy * m_sizex, m_sizex * sizeof(screen::pixel_t));
+	} else {
+		draw_bitmap(s, glyph, fg, bg, x, y);
+	}
+
+	s.mark_dirty(x, y, m_sizex, m_sizey);
+}
+
+void
+font::draw_text(
+		screen &s,
+		const char *text,
+		size_t len,
+		screen::pixel_t fg,
+		screen::pixel_t bg,
+		unsigned x,
+		unsigned y,
+		unsigned spacing)
+{
+	if (!len)
+		return;
+
+	const screen::pixel_t *glyphs = rasterized(fg, bg);
+	const size_t glyph_pixels = m_sizex * m_sizey;
+	const size_t row_bytes = m_sizex * sizeof(screen::pixel_t);
+
+	if (!glyphs) {
+		for (size_t i = 0; i < len; ++i)
+			draw_bitmap(s, static_cast<uint8_t>(text[i]), fg, bg, x + i * spacing, y);
+	} else {
+		for (unsigned dy = 0; dy < m_sizey; ++dy) {
+			screen::pixel_t *row = s.row(y + dy) + x;
+			for (size_t i = 0; i < len; ++i) {
+				uint32_t g = index(static_cast<uint8_t>(text[i]));
+				memcpy(row + i * spacing, glyphs + g * glyph_pixels + dy * m_sizex, row_bytes);
 			}
 		}
 	}
-}
 
+	s.mark_dirty(x, y, (len - 1) * spacing + m_sizex, m_sizey);
+}
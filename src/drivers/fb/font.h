@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
 #include "screen.h"
@@ -17,17 +18,74 @@ public:
 	unsigned height() const { return m_sizey; }
 	bool valid() const { return m_count > 0; }
 
+	/// Check if a pixel of a glyph is set in the font's bitmap
+	inline bool pixel(uint32_t glyph, unsigned x, unsigned y) const {
+		uint8_t const *data = m_data + (index(glyph) * glyph_bytes());
+		return data[y * ((m_sizex + 7) / 8) + x / 8] & (0x80 >> (x % 8));
+	}
+
+	/// Draw one glyph to the screen's back buffer
 	void draw_glyph(
 			screen &s,
 			uint32_t glyph,
 			screen::pixel_t fg,
 			screen::pixel_t bg,
 			unsigned x,
-			unsigned y) const;
+			unsigned y);
+
+	/// Draw a run of characters to the screen's back buffer. Each pixel
+	/// row of the run is copied from pre-rasterized glyphs, one glyph
+	/// row at a time.
+	/// \arg text     The characters to draw
+	/// \arg len      The number of characters
+	/// \arg x        The left edge of the first character
+	/// \arg y        The top edge of the characters
+	/// \arg spacing  Distance between the left edges of characters. The
+	///               gaps between glyphs are left untouched.
+	void draw_text(
+			screen &s,
+			const char *text,
+			size_t len,
+			screen::pixel_t fg,
+			screen::pixel_t bg,
+			unsigned x,
+			unsigned y,
+			unsigned spacing);
 
 private:
+	/// Every glyph rasterized in one fg/bg color pair
+	struct glyph_cache
+	{
+		screen::pixel_t fg, bg;
+		screen::pixel_t *pixels;
+	};
+
+	/// Number of color pairs to keep rasterized glyphs for
+	static constexpr unsigned cache_size = 4;
+
+	/// Get the rasterized glyphs for a color pair, rasterizing them if
+	/// they aren't cached
+	/// \returns  The glyphs, or nullptr if there was no memory for them
+	const screen::pixel_t * rasterized(screen::pixel_t fg, screen::pixel_t bg);
+
+	/// Draw one glyph straight from the font bitmap, for when there's no
+	/// memory to rasterize glyphs into
+	void draw_bitmap(
+			screen &s,
+			uint32_t glyph,
+			screen::pixel_t fg,
+			screen::pixel_t bg,
+			unsigned x,
+			unsigned y) const;
+
+	/// Get the glyph index to draw for a character
+	inline uint32_t index(uint32_t glyph) const { return glyph < m_count ? glyph : 0; }
+
 	unsigned m_sizex, m_sizey;
 	unsigned m_count;
 	uint8_t const *m_data;
+
+	glyph_cache m_cache[cache_size];
+	unsigned m_cache_next;
 };
 
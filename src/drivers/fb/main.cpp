@@ -7,6 +7,7 @@
 #include "j6/flags.h"
 #include "j6/signals.h"
 #include "j6/syscalls.h"
+#include "j6/time.h"
 #include "j6/types.h"
 
 #include "font.h"
@@ -91,45 +92,62 @@ main(int argc, const char **argv)
 
 	scrollback scroll(rows, cols);
 
-	int pending = 0;
-	constexpr int pending_threshold = 5;
-
 	j6_handle_t sys = __handle_sys;
-	size_t buffer_size = 0;
-	void *message_buffer = nullptr;
 
-	while (true) {
-		size_t size = buffer_size;
-		j6_status_t s = j6_system_get_log(sys, message_buffer, &size);
+	// Entries are at most 255 bytes, so this always fits at least one
+	static uint8_t message_buffer[4096];
 
-		if (s == j6_err_insufficient) {
-			free(message_buffer);
-			message_buffer = malloc(size * 2);
-			buffer_size = size;
-			continue;
-		} else if (s != j6_status_ok) {
-			j6_system_log("fb driver got error from get_log, quitting");
+	// Draw at most 60 frames a second, so a burst of log entries is
+	// drawn once
+	scr.set_frame_interval(1000000 / 60);
+
+	while (true) {
+		j6_signal_t sigs = 0;
+		j6_status_t s = j6_object_wait(sys, j6_signal_system_has_log, &sigs);
+		if (s != j6_status_ok) {
+			j6_system_log("fb driver got error waiting for the log, quitting");
 			return s;
 		}
 
-		if (size > 0) {
-			entry *e = reinterpret_cast<entry*>(message_buffer);
+		// Let entries pile up until the next frame is due. Without the
+		// time page, draw as soon as there's anything to draw.
+		uint64_t now = j6_time_now();
+		if (now && now < scr.next_frame())
+			j6_thread_sleep(scr.next_frame());
+
+		// Take everything logged since the last frame
+		do {
+			size_t size = sizeof(message_buffer);
+			s = j6_system_get_log(sys, message_buffer, &size);
+			if (s != j6_status_ok) {
+				j6_system_log("fb driver got error from get_log, quitting");
+				return s;
+			}
 
-			size_t eom = e->bytes - sizeof(entry);
-			e->message[eom] = 0;
+			size_t offset = 0;
+			while (offset < size) {
+				entry *e = reinterpret_cast<entry*>(message_buffer + offset);
+				if (e->bytes < sizeof(entry))
+					break;
 
-			scroll.add_line(e->message, eom);
-			if (++pending > pending_threshold) {
-				scroll.render(scr, fnt);
-				scr.update();
-				pending = 0;
-			}
-		} else {
-			if (pending) {
-				scroll.render(scr, fnt);
-				scr.update();
-				pending = 0;
+				scroll.add_line(e->message, e->bytes - sizeof(entry));
+				offset += e->bytes;
 			}
+
+			j6_object_wait(sys, 0, &sigs);
+		} while (sigs & j6_signal_system_has_log);
+
+		scroll.render(scr, fnt);
+
+		now = j6_time_now();
+		if (!now) {
+			scr.update();
+			continue;
+		}
+
+		while (!scr.present(now)) {
+			j6_thread_sleep(scr.next_frame());
+			now = j6_time_now();
 		}
 	}
 
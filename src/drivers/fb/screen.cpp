@@ -7,10 +7,27 @@ screen::screen(volatile void *addr, unsigned hres, unsigned vres, unsigned scanl
 	m_order(order),
 	m_scanline(scanline),
 	m_resx(hres),
-	m_resy(vres)
+	m_resy(vres),
+	m_front_valid(false),
+	m_frame_interval(0),
+	m_last_frame(0),
+	m_dirty_top(vres),
+	m_dirty_bottom(0)
 {
 	const size_t size = scanline * vres;
 	m_back = reinterpret_cast<pixel_t*>(malloc(size * sizeof(pixel_t)));
+	m_front = reinterpret_cast<pixel_t*>(malloc(size * sizeof(pixel_t)));
+
+	m_dirty_left = reinterpret_cast<unsigned*>(malloc(vres * sizeof(unsigned)));
+	m_dirty_right = reinterpret_cast<unsigned*>(malloc(vres * sizeof(unsigned)));
+	for (unsigned y = 0; y < vres; ++y) {
+		m_dirty_left[y] = hres;
+		m_dirty_right[y] = 0;
+	}
+
+	// The framebuffer's contents aren't known until the first update()
+	// writes all of it
+	mark_dirty(0, 0, hres, vres);
 }
 
 screen::pixel_t
@@ -37,12 +54,72 @@ screen::fill(pixel_t color)
 	const size_t len = m_scanline * m_resy;
 	asm volatile ( "rep stosl" : :
 		"a"(color), "c"(len), "D"(m_back) );
+
+	mark_dirty(0, 0, m_resx, m_resy);
+}
+
+void
+screen::mark_dirty(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+	if (x >= m_resx || y >= m_resy)
+		return;
+
+	unsigned right = (w > m_resx - x) ? m_resx : x + w;
+	unsigned bottom = (h > m_resy - y) ? m_resy : y + h;
+
+	for (unsigned row = y; row < bottom; ++row) {
+		if (x < m_dirty_left[row]) m_dirty_left[row] = x;
+		if (right > m_dirty_right[row]) m_dirty_right[row] = right;
+	}
+
+	if (y < m_dirty_top) m_dirty_top = y;
+	if (bottom > m_dirty_bottom) m_dirty_bottom = bottom;
 }
 
 void
 screen::update()
 {
-	const size_t len = m_scanline * m_resy * sizeof(pixel_t);
-	asm volatile ( "rep movsb" : :
-		"c"(len), "S"(m_back), "D"(m_fb) );
+	for (unsigned y = m_dirty_top; y < m_dirty_bottom; ++y) {
+		unsigned left = m_dirty_left[y];
+		unsigned right = m_dirty_right[y];
+		if (left >= right)
+			continue;
+
+		m_dirty_left[y] = m_resx;
+		m_dirty_right[y] = 0;
+
+		const size_t offset = y * m_scanline;
+		const pixel_t *back = m_back + offset;
+		pixel_t *front = m_front + offset;
+
+		// Trim the span to the pixels that actually changed
+		if (m_front_valid) {
+			while (left < right && back[left] == front[left]) ++left;
+			while (right > left && back[right - 1] == front[right - 1]) --right;
+			if (left == right)
+				continue;
+		}
+
+		size_t len = (right - left) * sizeof(pixel_t);
+		memcpy(front + left, back + left, len);
+
+		const pixel_t *src = back + left;
+		volatile pixel_t *dst = m_fb + offset + left;
+		asm volatile ( "rep movsb" : "+c"(len), "+S"(src), "+D"(dst) : : "memory" );
+	}
+
+	m_dirty_top = m_resy;
+	m_dirty_bottom = 0;
+	m_front_valid = true;
+}
+
+bool
+screen::present(uint64_t now)
+{
+	if (now < next_frame())
+		return false;
+
+	update();
+	m_last_frame = now;
+	return true;
 }
@@ -18,13 +18,40 @@ public:
 
 	void fill(pixel_t color);
 
+	/// Draw a pixel to the back buffer. This does not mark the pixel as
+	/// dirty, callers must call mark_dirty() for the area they draw.
 	inline void draw_pixel(unsigned x, unsigned y, pixel_t color) {
 		const size_t index = x + y * m_scanline;
 		m_back[index] = color;
 	}
 
+	/// Get a row of the back buffer, for drawing many pixels at once.
+	/// Callers must call mark_dirty() for the area they draw.
+	inline pixel_t * row(unsigned y) { return m_back + y * m_scanline; }
+
+	/// Mark an area of the back buffer as changed, so the next update()
+	/// copies it to the framebuffer.
+	void mark_dirty(unsigned x, unsigned y, unsigned w, unsigned h);
+
+	/// Copy the dirty parts of the back buffer to the framebuffer. Only
+	/// pixels that differ from what was last copied are written.
 	void update();
 
+	/// Set the minimum time between frames drawn by present()
+	/// \arg us  The frame interval, in us
+	inline void set_frame_interval(uint64_t us) { m_frame_interval = us; }
+
+	/// Get the earliest time present() will draw the next frame
+	/// \returns  The time in us
+	inline uint64_t next_frame() const { return m_last_frame + m_frame_interval; }
+
+	/// Draw a frame with update(), if one is due. Drawing is paced this
+	/// way so that a burst of changes is written to the framebuffer a
+	/// bounded number of times per second.
+	/// \arg now  The current time, in us
+	/// \returns  False if it was too early to draw a frame
+	bool present(uint64_t now);
+
 private:
 	volatile pixel_t *m_fb;
 	pixel_t *m_back;
@@ -32,5 +59,21 @@ private:
 	unsigned m_scanline;
 	unsigned m_resx, m_resy;
 
+	/// A copy of what is in the framebuffer, so that update() can skip
+	/// unchanged pixels without reading the framebuffer itself
+	pixel_t *m_front;
+	bool m_front_valid;
+
+	uint64_t m_frame_interval;
+	uint64_t m_last_frame;
+
+	/// For each row, the dirty span is [m_dirty_left, m_dirty_right)
+	unsigned *m_dirty_left;
+	unsigned *m_dirty_right;
+
+	/// Only rows in [m_dirty_top, m_dirty_bottom) have dirty spans
+	unsigned m_dirty_top;
+	unsigned m_dirty_bottom;
+
 	screen() = delete;
 };
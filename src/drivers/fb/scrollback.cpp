@@ -13,6 +13,10 @@ scrollback::scrollback(unsigned lines, unsigned cols, unsigned margin) :
 {
 	m_data = reinterpret_cast<char*>(malloc(lines*cols));
 	memset(m_data, ' ', lines*cols);
+
+	// The screen starts out cleared to the background, the same as spaces
+	m_shown = reinterpret_cast<char*>(malloc(lines*cols));
+	memset(m_shown, ' ', lines*cols);
 }
 
 void
@@ -51,8 +55,19 @@ scrollback::render(screen &scr, font &fnt)
 	for (unsigned y = 0; y < m_rows; ++y) {
 		unsigned i = (start + y) % m_rows;
 		char *line = &m_data[i*m_cols];
-		for (unsigned x = 0; x < m_cols; ++x) {
-			fnt.draw_glyph(scr, line[x], fg, bg, m_margin+x*xstride, m_margin+y*ystride);
-		}
+		char *shown = &m_shown[y*m_cols];
+
+		// Redraw from the first changed character to the last one
+		unsigned first = 0;
+		while (first < m_cols && line[first] == shown[first]) ++first;
+		if (first == m_cols)
+			continue;
+
+		unsigned last = m_cols;
+		while (line[last - 1] == shown[last - 1]) --last;
+
+		fnt.draw_text(scr, line + first, last - first, fg, bg,
+				m_margin + first*xstride, m_margin + y*ystride, xstride);
+		memcpy(shown + first, line + first, last - first);
 	}
 }
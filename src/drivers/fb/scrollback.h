@@ -13,10 +13,13 @@ public:
 
 	char * get_line(unsigned i);
 
+	/// Draw the lines to the screen. Only characters that changed since
+	/// the last render are drawn.
 	void render(screen &scr, font &fnt);
 
 private:
 	char *m_data;
+	char *m_shown; ///< The characters currently drawn, by screen position
 	unsigned m_rows, m_cols;
 	unsigned m_start;
 	unsigned m_count;
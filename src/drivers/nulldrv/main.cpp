@@ -1,10 +1,12 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include "j6/types.h"
 #include "j6/errors.h"
 #include "j6/signals.h"
 #include "j6/syscalls.h"
+#include "j6/time.h"
 
 #include "io.h"
 #include "serial.h"
@@ -27,7 +29,7 @@ thread_proc()
 	j6_tag_t tag = 0;
 	j6_status_t result = j6_endpoint_receive(endp, &tag, &len, (void*)buffer);
 	if (result != j6_status_ok)
-		j6_thread_exit(result);
+		thrd_exit(result);
 
 	j6_system_log("sub thread received message");
 
@@ -38,15 +40,15 @@ thread_proc()
 	tag++;
 	result = j6_endpoint_send(endp, tag, len, (void*)buffer);
 	if (result != j6_status_ok)
-		j6_thread_exit(result);
+		thrd_exit(result);
 
 	j6_system_log("sub thread sent message");
 
 	for (int i = 1; i < 5; ++i)
-		j6_thread_sleep(i*10);
+		j6_thread_sleep(j6_time_now() + i*10000);
 
 	j6_system_log("sub thread exiting");
-	j6_thread_exit(0);
+	thrd_exit(0);
 }
 
 int
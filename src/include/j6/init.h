@@ -5,6 +5,13 @@
 #include <stdint.h>
 #include "j6/types.h"
 
+/// User thread stacks are allocated downward from this address. Each one
+/// has its own region of j6_thread_stack_size bytes, aligned to that size.
+#define j6_thread_stacks_top  0x0000800000000000ull
+
+/// Size of the region each user thread stack is given
+#define j6_thread_stack_size  0x0000000004000000ull
+
 enum j6_init_type {					// `value` is a:
 	j6_init_handle_self,			// Handle to the system
 	j6_init_handle_other,			// Handle to this process
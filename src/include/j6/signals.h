@@ -44,6 +44,7 @@
 
 // System signals
 #define j6_signal_system_has_log	(1ull << 16)
+#define j6_signal_system_low_memory	(1ull << 17)
 
 // Channel signals
 #define j6_signal_channel_can_send	(1ull << 16)
@@ -0,0 +1,55 @@
+#pragma once
+/// \file time.h
+/// The time page, which lets user code read the system clock without
+/// making a syscall
+
+#include <stdint.h>
+
+/// Address of the read-only time page in every user process
+#define j6_time_page_addr  0x00000ff000000000ull
+
+/// Layout of the time page. The kernel increments `seq` before and after
+/// every update, so a reader that sees an odd value, or a different value
+/// after reading the other fields, must retry.
+///
+/// The clock value in microseconds for a TSC value `tsc` is:
+///     us_base + (((tsc - tsc_base) * mult) >> shift)
+/// If `mult` is zero, the TSC can't be used and the clock is not readable
+/// from the time page.
+struct j6_time_page {
+	uint32_t seq;
+	uint32_t shift;
+	uint64_t mult;
+	uint64_t tsc_base;
+	uint64_t us_base;
+};
+
+/// Read the system clock from the time page.
+/// \returns  The kernel's monotonic clock value in microseconds since
+///           boot, or 0 if it's not readable
+static inline uint64_t
+j6_time_now(void)
+{
+	const struct j6_time_page *page =
+		(const struct j6_time_page *)j6_time_page_addr;
+
+	uint32_t seq, shift;
+	uint64_t mult, tsc_base, us_base, tsc;
+	do {
+		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		shift = page->shift;
+		mult = page->mult;
+		tsc_base = page->tsc_base;
+		us_base = page->us_base;
+		tsc = __builtin_ia32_rdtsc();
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+
+	if (!mult)
+		return 0;
+
+	// Another CPU's TSC may lag slightly behind the one the base was
+	// taken from, so never go backwards past the base
+	unsigned __int128 delta = tsc > tsc_base ? tsc - tsc_base : 0;
+	return us_base + (uint64_t)((delta * mult) >> shift);
+}
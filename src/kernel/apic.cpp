@@ -1,13 +1,24 @@
 #include "kutil/assert.h"
 #include "apic.h"
 #include "clock.h"
+#include "cpu/cpu_id.h"
 #include "interrupts.h"
 #include "io.h"
 #include "kernel_memory.h"
 #include "log.h"
+#include "msr.h"
 
 uint64_t lapic::s_ticks_per_us = 0;
 
+bool lapic::s_tsc_deadline = false;
+uint64_t lapic::s_us_to_tsc_mult = 0;
+uint64_t lapic::s_tsc_to_us_mult = 0;
+uint32_t lapic::s_us_to_tsc_shift = 0;
+uint32_t lapic::s_tsc_to_us_shift = 0;
+
+static constexpr uint32_t lapic_timer_periodic = 0x20000;
+static constexpr uint32_t lapic_timer_deadline = 0x40000;
+
 static constexpr uint16_t lapic_id         = 0x0020;
 static constexpr uint16_t lapic_spurious   = 0x00f0;
 
@@ -32,7 +43,7 @@ apic_read(uint32_t volatile *apic, uint16_t offset)
 static void
 apic_write(uint32_t volatile *apic, uint16_t offset, uint32_t value)
 {
-	log::debug(logs::apic, "LAPIC write: %x = %08lx", offset, value);
+	log_debug(logs::apic, "LAPIC write: %x = %08lx", offset, value);
 	*(apic + offset/sizeof(uint32_t)) = value;
 }
 
@@ -58,11 +69,12 @@ apic::apic(uintptr_t base) :
 
 lapic::lapic(uintptr_t base) :
 	apic(base),
-	m_divisor(0)
+	m_divisor(0),
+	m_deadline(0)
 {
 	apic_write(m_base, lapic_lvt_error, static_cast<uint32_t>(isr::isrAPICError));
 	apic_write(m_base, lapic_spurious, static_cast<uint32_t>(isr::isrSpurious));
-	log::info(logs::apic, "LAPIC created, base %lx", m_base);
+	log_info(logs::apic, "LAPIC created, base %lx", m_base);
 }
 
 uint8_t
@@ -111,9 +123,21 @@ lapic::ipi_wait()
 void
 lapic::calibrate_timer()
 {
+	cpu::cpu_id cpu;
+	uint64_t tsc_frequency = clock::get().tsc_frequency();
+	if (tsc_frequency && cpu.has_feature(cpu::feature::tsc_deadline)) {
+		constexpr uint64_t us_per_second = 1000000;
+		clock::conversion(us_per_second, tsc_frequency, s_us_to_tsc_mult, s_us_to_tsc_shift);
+		clock::conversion(tsc_frequency, us_per_second, s_tsc_to_us_mult, s_tsc_to_us_shift);
+		s_tsc_deadline = true;
+
+		log_info(logs::apic, "Using TSC-deadline mode for the APIC timer.");
+		return;
+	}
+
 	interrupts_disable();
 
-	log::info(logs::apic, "Calibrating APIC timer...");
+	log_info(logs::apic, "Calibrating APIC timer...");
 
 	const uint32_t initial = -1u;
 	enable_timer(isr::isrSpurious);
@@ -127,7 +151,7 @@ lapic::calibrate_timer()
 	uint64_t ticks_total = initial - remaining;
 	s_ticks_per_us = ticks_total / us;
 
-	log::info(logs::apic, "APIC timer ticks %d times per microsecond.", s_ticks_per_us);
+	log_info(logs::apic, "APIC timer ticks %d times per microsecond.", s_ticks_per_us);
 
 	interrupts_enable();
 }
@@ -158,16 +182,28 @@ void
 lapic::enable_timer(isr vector, bool repeat)
 {
 	uint32_t lvte = static_cast<uint8_t>(vector);
-	if (repeat)
-		lvte |= 0x20000;
+	if (s_tsc_deadline) {
+		kassert(!repeat, "Repeating APIC timers aren't supported in TSC-deadline mode");
+		lvte |= lapic_timer_deadline;
+	} else if (repeat) {
+		lvte |= lapic_timer_periodic;
+	}
 	apic_write(m_base, lapic_lvt_timer, lvte);
 
-	log::debug(logs::apic, "Enabling APIC timer at isr %02x", vector);
+	// The LVT write must complete before any write to the deadline MSR,
+	// or that write may be ignored
+	if (s_tsc_deadline)
+		asm volatile ("mfence" ::: "memory");
+
+	log_debug(logs::apic, "Enabling APIC timer at isr %02x", vector);
 }
 
 uint32_t
 lapic::reset_timer(uint64_t interval)
 {
+	if (s_tsc_deadline)
+		return reset_deadline(interval);
+
 	uint64_t remaining = ticks_to_us(apic_read(m_base, lapic_timer_cur));
 	uint64_t ticks = us_to_ticks(interval);
 
@@ -184,6 +220,21 @@ lapic::reset_timer(uint64_t interval)
 	return remaining;
 }
 
+uint32_t
+lapic::reset_deadline(uint64_t interval)
+{
+	uint64_t now = __builtin_ia32_rdtsc();
+	uint64_t remaining = m_deadline > now ?
+		clock::scale(m_deadline - now, s_tsc_to_us_mult, s_tsc_to_us_shift) : 0;
+
+	// Writing 0 disarms the timer
+	m_deadline = interval ?
+		now + clock::scale(interval, s_us_to_tsc_mult, s_us_to_tsc_shift) : 0;
+	wrmsr(msr::ia32_tsc_deadline, m_deadline);
+
+	return remaining;
+}
+
 void
 lapic::enable_lint(uint8_t num, isr vector, bool nmi, uint16_t flags)
 {
@@ -201,7 +252,7 @@ lapic::enable_lint(uint8_t num, isr vector, bool nmi, uint16_t flags)
 		lvte |= (1 << 15);
 
 	apic_write(m_base, off, lvte);
-	log::debug(logs::apic, "APIC LINT%d enabled as %s %d %s-triggered, active %s.",
+	log_debug(logs::apic, "APIC LINT%d enabled as %s %d %s-triggered, active %s.",
 			num, nmi ? "NMI" : "ISR", vector,
 			polarity == 3 ? "level" : "edge",
 			trigger == 3 ? "low" : "high");
@@ -212,7 +263,7 @@ lapic::enable()
 {
 	apic_write(m_base, lapic_spurious,
 			apic_read(m_base, lapic_spurious) | 0x100);
-	log::debug(logs::apic, "LAPIC enabled!");
+	log_debug(logs::apic, "LAPIC enabled!");
 }
 
 void
@@ -220,7 +271,7 @@ lapic::disable()
 {
 	apic_write(m_base, lapic_spurious,
 			apic_read(m_base, lapic_spurious) & ~0x100);
-	log::debug(logs::apic, "LAPIC disabled.");
+	log_debug(logs::apic, "LAPIC disabled.");
 }
 
 
@@ -234,7 +285,7 @@ ioapic::ioapic(uintptr_t base, uint32_t base_gsi) :
 	m_id = (id >> 24) & 0xff;
 	m_version = version & 0xff;
 	m_num_gsi = (version >> 16) & 0xff;
-	log::debug(logs::apic, "IOAPIC %d loaded, version %d, GSIs %d-%d",
+	log_debug(logs::apic, "IOAPIC %d loaded, version %d, GSIs %d-%d",
 			m_id, m_version, base_gsi, base_gsi + (m_num_gsi - 1));
 
 	for (uint8_t i = 0; i < m_num_gsi; ++i) {
@@ -247,7 +298,7 @@ ioapic::ioapic(uintptr_t base, uint32_t base_gsi) :
 void
 ioapic::redirect(uint8_t irq, isr vector, uint16_t flags, bool masked)
 {
-	log::debug(logs::apic, "IOAPIC %d redirecting irq %3d to vector %3d [%04x]%s",
+	log_debug(logs::apic, "IOAPIC %d redirecting irq %3d to vector %3d [%04x]%s",
 			m_id, irq, vector, flags, masked ? " (masked)" : "");
 
 	uint64_t entry = static_cast<uint64_t>(vector);
@@ -270,7 +321,7 @@ ioapic::redirect(uint8_t irq, isr vector, uint16_t flags, bool masked)
 void
 ioapic::mask(uint8_t irq, bool masked)
 {
-	log::debug(logs::apic, "IOAPIC %d %smasking irq %3d",
+	log_debug(logs::apic, "IOAPIC %d %smasking irq %3d",
 			m_id, masked ? "" : "un", irq);
 
 	uint32_t entry = ioapic_read(m_base, (2 * irq) + 0x10);
@@ -285,7 +336,7 @@ ioapic::mask(uint8_t irq, bool masked)
 void
 ioapic::dump_redirs() const
 {
-	log::debug(logs::apic, "IOAPIC %d redirections:", m_id);
+	log_debug(logs::apic, "IOAPIC %d redirections:", m_id);
 
 	for (uint8_t i = 0; i < m_num_gsi; ++i) {
 		uint64_t low = ioapic_read(m_base, 0x10 + (2 *i));
@@ -301,7 +352,7 @@ ioapic::dump_redirs() const
 		uint8_t mask = (redir >> 16) & 0x1;
 		uint8_t dest = (redir >> 56) & 0xff;
 
-		log::debug(logs::apic, "  %2d: vec %3d %s active, %s-triggered %s dest %d: %x",
+		log_debug(logs::apic, "  %2d: vec %3d %s active, %s-triggered %s dest %d: %x",
 				m_base_gsi + i, vector,
 				polarity ? "low" : "high",
 				trigger ? "level" : "edge",
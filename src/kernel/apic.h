@@ -69,7 +69,8 @@ public:
 	/// \arg repeat   If false, this timer is one-off, otherwise repeating
 	void enable_timer(isr vector, bool repeat = true);
 
-	/// Reset the timer countdown.
+	/// Reset the timer countdown. In TSC-deadline mode, this arms the timer
+	/// with an absolute TSC deadline instead of a count.
 	/// \arg interval The interval in us before an interrupt, or 0 to stop the timer
 	/// \returns      The interval in us that was remaining before reset
 	uint32_t reset_timer(uint64_t interval);
@@ -88,9 +89,14 @@ public:
 	void enable();  ///< Enable servicing of interrupts
 	void disable(); ///< Disable (temporarily) servicing of interrupts
 
-	/// Calibrate the timer speed against the clock
+	/// Calibrate the timer speed against the clock. If the CPU supports
+	/// TSC-deadline mode and the clock has measured the TSC, the timer
+	/// uses that mode instead, and no calibration is needed.
 	void calibrate_timer();
 
+	/// Check if the timer is using TSC-deadline mode
+	inline static bool tsc_deadline() { return s_tsc_deadline; }
+
 private:
 	inline static uint64_t ticks_to_us(uint64_t ticks)    { return ticks / s_ticks_per_us; }
 	inline static uint64_t us_to_ticks(uint64_t interval) { return interval * s_ticks_per_us; }
@@ -98,8 +104,18 @@ private:
 	void set_divisor(uint8_t divisor);
 	void set_repeat(bool repeat);
 
+	/// reset_timer() for TSC-deadline mode
+	uint32_t reset_deadline(uint64_t interval);
+
 	uint32_t m_divisor;
+	uint64_t m_deadline; ///< TSC value the timer is armed for, or 0
 	static uint64_t s_ticks_per_us;
+
+	static bool s_tsc_deadline;
+	static uint64_t s_us_to_tsc_mult;
+	static uint64_t s_tsc_to_us_mult;
+	static uint32_t s_us_to_tsc_shift;
+	static uint32_t s_tsc_to_us_shift;
 };
 
 
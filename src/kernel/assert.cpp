@@ -1,9 +1,12 @@
 #include "kutil/assert.h"
 #include "console.h"
+#include "serial.h"
 
 [[noreturn]] void
 __kernel_assert(const char *file, unsigned line, const char *message)
 {
+	g_com1.panic();
+
 	console *cons = console::get();
 	if (cons) {
 		cons->set_color(9 , 0);
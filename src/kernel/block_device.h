@@ -8,4 +8,14 @@ class block_device
 {
 public:
 	virtual size_t read(size_t offset, size_t length, void *buffer) = 0;
+
+	/// Write to the device. Devices that cannot be written write nothing.
+	/// \arg offset  The offset in bytes at which to start writing
+	/// \arg length  The number of bytes to write
+	/// \arg buffer  The data to write
+	/// \returns     The number of bytes written
+	virtual size_t write(size_t offset, size_t length, const void *buffer) { return 0; }
+
+	/// Get the size of the device in bytes, or 0 if it is not known
+	virtual size_t size() const { return 0; }
 };
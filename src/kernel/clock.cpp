@@ -1,16 +1,132 @@
+#include "j6/time.h"
+#include "kutil/assert.h"
+#include "kutil/memory.h"
 #include "clock.h"
+#include "cpu.h"
+#include "cpu/cpu_id.h"
+#include "frame_allocator.h"
+#include "kernel_memory.h"
+#include "log.h"
+#include "objects/vm_area.h"
 
 clock * clock::s_instance = nullptr;
 
-clock::clock(uint64_t rate, clock::source source_func, void *data) :
-	m_rate(rate),
+static constexpr uint64_t us_per_second = 1000000;
+
+/// How long to measure the TSC against the clock source
+static constexpr uint64_t tsc_calibration_us = 10000;
+
+/// How many TSC values an AP sends the BSP to check
+static constexpr unsigned tsc_sync_rounds = 8;
+
+/// How long either side of a TSC check waits for the other
+static constexpr uint64_t tsc_sync_timeout_us = 5000;
+
+/// Handshake state for checking an AP's TSC against the BSP's
+enum class tsc_sync : uint32_t { idle, ready, request, done };
+
+/// The whole handshake is one word, so each step is a compare-and-swap
+/// that only the AP being checked can make. An AP that starts late or
+/// gives up early can't disturb the check of the next one. States have
+/// the top bit set and carry the AP's index, while the AP's reply to a
+/// request is its TSC value, with the top bit clear.
+static constexpr uint64_t tsc_sync_tag = 1ull << 63;
+
+static constexpr uint64_t
+tsc_sync_word(unsigned cpu, tsc_sync state)
+{
+	return tsc_sync_tag | (uint64_t(cpu) << 32) | static_cast<uint32_t>(state);
+}
+
+static constexpr uint64_t tsc_sync_idle = tsc_sync_word(0, tsc_sync::idle);
+
+static uint64_t g_tsc_sync = tsc_sync_idle;
+
+static uint64_t
+tsc_clock_source(void*)
+{
+	return __builtin_ia32_rdtsc();
+}
+
+/// Wait for the TSC check handshake word to reach a given value
+/// \returns  False if the wait timed out
+static bool
+tsc_sync_wait(const clock &clk, uint64_t word)
+{
+	uint64_t give_up = clk.value() + tsc_sync_timeout_us;
+	while (__atomic_load_n(&g_tsc_sync, __ATOMIC_ACQUIRE) != word) {
+		if (clk.value() > give_up)
+			return false;
+		asm ("pause");
+	}
+	return true;
+}
+
+/// Try to move the TSC check handshake word from one value to another
+static inline bool
+tsc_sync_swap(uint64_t from, uint64_t to)
+{
+	return __atomic_compare_exchange_n(&g_tsc_sync, &from, to, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+clock::clock(uint64_t frequency, clock::source source_func, void *data) :
+	m_source_base(0),
+	m_us_base(0),
 	m_data(data),
-	m_source(source_func)
+	m_source(source_func),
+	m_frequency(frequency),
+	m_tsc_frequency(0),
+	m_fallback(nullptr),
+	m_fallback_data(nullptr),
+	m_fallback_frequency(0),
+	m_time_page(nullptr),
+	m_time_area(nullptr)
 {
 	// TODO: make this atomic
 	if (s_instance == nullptr)
 		s_instance = this;
+
+	conversion(frequency, us_per_second, m_mult, m_shift);
 	update();
+
+	uintptr_t phys = 0;
+	size_t n = frame_allocator::get().allocate(1, &phys);
+	kassert(n, "Failed to allocate the time page");
+
+	m_time_page = memory::to_virtual<j6_time_page>(phys);
+	kutil::memset(m_time_page, 0, memory::frame_size);
+
+	// The page belongs to the clock, not the area: flagging it as mmio
+	// keeps it from being freed when the last process unmaps it, and
+	// lets cloned processes share it. Retain the area so it's never
+	// deleted.
+	m_time_area = new vm_area_fixed(phys, memory::frame_size, vm_flags::mmio);
+	m_time_area->handle_retain();
+}
+
+void
+clock::conversion(uint64_t from, uint64_t to, uint64_t &mult, uint32_t &shift)
+{
+	using u128 = unsigned __int128;
+
+	shift = 63;
+	while (shift && ((u128(to) << shift) / from) >> 32)
+		--shift;
+	mult = (u128(to) << shift) / from;
+}
+
+void
+clock::set_source(uint64_t frequency, clock::source source_func, void *data)
+{
+	uint64_t now = value();
+
+	conversion(frequency, us_per_second, m_mult, m_shift);
+	m_source = source_func;
+	m_data = data;
+	m_frequency = frequency;
+	m_source_base = source_func(data);
+	m_us_base = now;
 }
 
 void
@@ -20,3 +136,156 @@ clock::spinwait(uint64_t us) const
 	while (value() < when) asm ("pause");
 }
 
+void
+clock::calibrate_tsc()
+{
+	cpu::cpu_id cpu;
+	if (!cpu.has_feature(cpu::feature::tsc)) {
+		log_warn(logs::clock, "No TSC, user processes can't read the clock");
+		return;
+	}
+
+	// Measure in raw source ticks, which are finer than microseconds
+	uint64_t src0 = m_source(m_data);
+	uint64_t tsc0 = __builtin_ia32_rdtsc();
+	spinwait(tsc_calibration_us);
+	uint64_t src1 = m_source(m_data);
+	uint64_t tsc1 = __builtin_ia32_rdtsc();
+
+	uint64_t src_delta = src1 - src0;
+	uint64_t tsc_delta = tsc1 - tsc0;
+	kassert(src_delta && tsc_delta, "TSC or clock did not advance during calibration");
+
+	uint64_t tsc_frequency =
+		static_cast<unsigned __int128>(tsc_delta) * m_frequency / src_delta;
+	m_tsc_frequency = tsc_frequency;
+
+	bool invariant = cpu.has_feature(cpu::feature::invariant_tsc);
+	log_info(logs::clock, "TSC rate %lld kHz, %s",
+			tsc_frequency / 1000, invariant ? "invariant" : "not invariant");
+
+	if (invariant) {
+		m_fallback = m_source;
+		m_fallback_data = m_data;
+		m_fallback_frequency = m_frequency;
+
+		set_source(tsc_frequency, tsc_clock_source, nullptr);
+		publish(m_source_base, m_us_base, m_mult, m_shift);
+		log_info(logs::clock, "Using the TSC as the clock source");
+	} else {
+		// The TSC rate can change with power states, so user code can't
+		// convert it to clock time
+		publish(0, 0, 0, 0);
+		log_warn(logs::clock, "TSC is not invariant, user processes can't read the clock");
+	}
+}
+
+bool
+clock::check_tsc_bsp(unsigned cpu)
+{
+	// Wait for the AP to claim the handshake, clearing out any claim left
+	// by an AP that started too late to be checked
+	uint64_t ready = tsc_sync_word(cpu, tsc_sync::ready);
+	uint64_t give_up = value() + tsc_sync_timeout_us;
+	while (true) {
+		uint64_t word = __atomic_load_n(&g_tsc_sync, __ATOMIC_ACQUIRE);
+		if (word == ready)
+			break;
+
+		if (word != tsc_sync_idle)
+			tsc_sync_swap(word, tsc_sync_idle);
+
+		if (value() > give_up) {
+			log_warn(logs::clock, "CPU%02x didn't start its TSC check", cpu);
+			return true;
+		}
+		asm ("pause");
+	}
+
+	// The AP's TSC must land between two reads of ours every time
+	bool synced = true;
+	uint64_t request = tsc_sync_word(cpu, tsc_sync::request);
+	for (unsigned i = 0; i < tsc_sync_rounds; ++i) {
+		uint64_t before = __builtin_ia32_rdtsc();
+		__atomic_store_n(&g_tsc_sync, request, __ATOMIC_RELEASE);
+
+		uint64_t theirs = request;
+		give_up = value() + tsc_sync_timeout_us;
+		while ((theirs = __atomic_load_n(&g_tsc_sync, __ATOMIC_ACQUIRE)) & tsc_sync_tag) {
+			if (value() > give_up)
+				break;
+			asm ("pause");
+		}
+		if (theirs & tsc_sync_tag)
+			break;
+
+		uint64_t after = __builtin_ia32_rdtsc();
+		if (theirs < before || theirs > after)
+			synced = false;
+	}
+
+	// Take the handshake back even if the AP doesn't acknowledge
+	uint64_t done = tsc_sync_word(cpu, tsc_sync::done);
+	__atomic_store_n(&g_tsc_sync, done, __ATOMIC_RELEASE);
+	tsc_sync_wait(*this, tsc_sync_idle);
+	tsc_sync_swap(done, tsc_sync_idle);
+
+	if (!synced && m_time_page->mult) {
+		log_warn(logs::clock, "CPU%02x TSC is out of sync, not using the TSC", cpu);
+		if (m_fallback) {
+			set_source(m_fallback_frequency, m_fallback, m_fallback_data);
+			m_fallback = nullptr;
+		}
+		publish(0, 0, 0, 0);
+	}
+
+	return synced;
+}
+
+void
+clock::check_tsc_ap()
+{
+	unsigned cpu = current_cpu().index;
+	uint64_t ready = tsc_sync_word(cpu, tsc_sync::ready);
+	uint64_t request = tsc_sync_word(cpu, tsc_sync::request);
+	uint64_t done = tsc_sync_word(cpu, tsc_sync::done);
+
+	// Claim the handshake once the BSP is done with any other AP
+	uint64_t give_up = value() + tsc_sync_timeout_us;
+	while (!tsc_sync_swap(tsc_sync_idle, ready)) {
+		if (value() > give_up)
+			return;
+		asm ("pause");
+	}
+
+	give_up = value() + tsc_sync_timeout_us;
+	while (true) {
+		uint64_t word = __atomic_load_n(&g_tsc_sync, __ATOMIC_ACQUIRE);
+		if (word == request) {
+			uint64_t tsc = __builtin_ia32_rdtsc() & ~tsc_sync_tag;
+			tsc_sync_swap(request, tsc);
+			give_up = value() + tsc_sync_timeout_us;
+		} else if (word == done || value() > give_up) {
+			break;
+		}
+		asm ("pause");
+	}
+
+	tsc_sync_swap(done, tsc_sync_idle);
+}
+
+void
+clock::publish(uint64_t tsc_base, uint64_t us_base, uint64_t mult, uint32_t shift)
+{
+	// Seqlock write: readers retry if seq is odd or changes under them
+	uint32_t seq = m_time_page->seq;
+	__atomic_store_n(&m_time_page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	m_time_page->shift = shift;
+	m_time_page->mult = mult;
+	m_time_page->tsc_base = tsc_base;
+	m_time_page->us_base = us_base;
+
+	__atomic_store_n(&m_time_page->seq, seq + 2, __ATOMIC_RELEASE);
+}
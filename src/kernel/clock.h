@@ -4,6 +4,9 @@
 
 #include <stdint.h>
 
+struct j6_time_page;
+class vm_area;
+
 class clock
 {
 public:
@@ -12,16 +15,20 @@ public:
 	using source = uint64_t (*)(void*);
 
 	/// Constructor.
-	/// \arg rate   Number of source ticks per us
-	/// \arg source Function for the clock source
-	/// \arg data   Data to pass to the source function
-	clock(uint64_t rate, source source_func, void *data);
+	/// \arg frequency  Number of source ticks per second
+	/// \arg source     Function for the clock source
+	/// \arg data       Data to pass to the source function
+	clock(uint64_t frequency, source source_func, void *data);
 
 	/// Get the current value of the clock.
-	/// \returns Current value of the source, in us
-	/// TODO: optimize divison by finding a multiply and
-	/// shift value instead
-	inline uint64_t value() const { return m_source(m_data) / m_rate; }
+	/// \returns Current value of the clock, in us
+	inline uint64_t value() const {
+		// Another CPU's TSC may lag slightly behind the one the base
+		// was taken from, so never go backwards past the base
+		int64_t ticks = m_source(m_data) - m_source_base;
+		if (ticks < 0) ticks = 0;
+		return m_us_base + scale(ticks, m_mult, m_shift);
+	}
 
 	/// Update the internal state via the source
 	/// \returns Current value of the clock
@@ -31,14 +38,78 @@ public:
 	/// \arg interval  Time to wait, in us
 	void spinwait(uint64_t us) const;
 
+	/// Measure the TSC rate against this clock's source. If the TSC is
+	/// invariant, it becomes this clock's source, with the previous source
+	/// kept as a fallback, and the TSC to clock conversion is published in
+	/// the time page. Otherwise the time page is left disabled.
+	void calibrate_tsc();
+
+	/// Check an AP's TSC against the BSP's. The BSP calls this for each AP
+	/// after the AP starts, while the AP calls check_tsc_ap(). If the TSCs
+	/// are out of sync, the clock falls back from the TSC to its previous
+	/// source, and the time page is disabled.
+	/// \arg cpu  Index of the AP being checked, for logging
+	/// \returns  False if the AP's TSC was out of sync
+	bool check_tsc_bsp(unsigned cpu);
+
+	/// The AP side of check_tsc_bsp(). Gives up if the BSP doesn't start
+	/// the check in a few milliseconds.
+	void check_tsc_ap();
+
+	/// Get the TSC rate measured by calibrate_tsc()
+	/// \returns  TSC ticks per second, or 0 if it hasn't been measured
+	inline uint64_t tsc_frequency() const { return m_tsc_frequency; }
+
+	/// Get the VMA holding the read-only time page, which is mapped into
+	/// every user process at j6_time_page_addr
+	inline vm_area * time_page_area() const { return m_time_area; }
+
 	/// Get the master clock
 	static clock & get() { return *s_instance; }
 
+	/// Check if the master clock has been created yet
+	static bool ready() { return s_instance != nullptr; }
+
+	/// Multiply a tick count by a mult/shift conversion factor
+	static inline uint64_t scale(uint64_t ticks, uint64_t mult, uint32_t shift) {
+		return (static_cast<unsigned __int128>(ticks) * mult) >> shift;
+	}
+
+	/// Find the mult/shift pair that converts ticks at one frequency to
+	/// ticks at another, with the most precision that keeps mult in 32 bits.
+	/// \arg from   Source ticks per second
+	/// \arg to     Destination ticks per second
+	/// \arg mult   [out] The multiplier
+	/// \arg shift  [out] The shift
+	static void conversion(uint64_t from, uint64_t to, uint64_t &mult, uint32_t &shift);
+
 private:
+	/// Switch to a new source, continuing from the current clock value
+	/// \arg frequency  Number of source ticks per second
+	/// \arg source     Function for the clock source
+	/// \arg data       Data to pass to the source function
+	void set_source(uint64_t frequency, source source_func, void *data);
+
 	uint64_t m_current; ///< current us count
-	uint64_t m_rate; ///< source ticks per us
+	uint64_t m_source_base; ///< source value at m_us_base
+	uint64_t m_us_base; ///< clock value when the source was set
+	uint64_t m_mult; ///< source ticks to us multiplier
+	uint32_t m_shift; ///< source ticks to us shift
 	void *m_data;
 	source m_source;
+	uint64_t m_frequency; ///< source ticks per second
+	uint64_t m_tsc_frequency; ///< measured TSC ticks per second
+
+	/// The source to fall back to if the TSC turns out to be unusable
+	source m_fallback;
+	void *m_fallback_data;
+	uint64_t m_fallback_frequency;
+
+	j6_time_page *m_time_page;
+	vm_area *m_time_area;
+
+	/// Update the time page's TSC conversion under its seqlock
+	void publish(uint64_t tsc_base, uint64_t us_base, uint64_t mult, uint32_t shift);
 
 	static clock *s_instance;
 };
@@ -3,9 +3,11 @@
 #include "kutil/memory.h"
 #include "cpu.h"
 #include "cpu/cpu_id.h"
+#include "apic.h"
 #include "device_manager.h"
 #include "gdt.h"
 #include "idt.h"
+#include "interrupts.h"
 #include "kernel_memory.h"
 #include "log.h"
 #include "msr.h"
@@ -15,19 +17,42 @@
 
 cpu_data g_bsp_cpu_data;
 
+extern "C" {
+	// Read by task_switch to pick between xsave and fxsave
+	uint8_t g_fpu_xsave = 0;
+}
+
+static size_t g_fpu_state_size = 0;
+
+static constexpr unsigned max_cpus = 64;
+static cpu_data *g_online_cpus[max_cpus];
+static unsigned g_online_count = 0;
+
+static constexpr uint64_t cr4_osfxsr     = 1 << 9;
+static constexpr uint64_t cr4_osxmmexcpt = 1 << 10;
+static constexpr uint64_t cr4_osxsave    = 1 << 18;
+
+static constexpr uint64_t xcr0_x87 = 1 << 0;
+static constexpr uint64_t xcr0_sse = 1 << 1;
+static constexpr uint64_t xcr0_avx = 1 << 2;
+
+/// Default x87 control word and MXCSR values: all exceptions masked
+static constexpr uint16_t fpu_default_fcw = 0x037f;
+static constexpr uint32_t fpu_default_mxcsr = 0x1f80;
+
 void
 cpu_validate()
 {
 	cpu::cpu_id cpu;
 
-	log::info(logs::boot, "CPU: %s", cpu.brand_name());
-	log::debug(logs::boot, "    Vendor is %s", cpu.vendor_id());
+	log_info(logs::boot, "CPU: %s", cpu.brand_name());
+	log_debug(logs::boot, "    Vendor is %s", cpu.vendor_id());
 
-	log::debug(logs::boot, "    Higest basic CPUID: 0x%02x", cpu.highest_basic());
-	log::debug(logs::boot, "    Higest ext CPUID:   0x%02x", cpu.highest_ext() & ~cpu::cpu_id::cpuid_extended);
+	log_debug(logs::boot, "    Higest basic CPUID: 0x%02x", cpu.highest_basic());
+	log_debug(logs::boot, "    Higest ext CPUID:   0x%02x", cpu.highest_ext() & ~cpu::cpu_id::cpuid_extended);
 
 #define CPU_FEATURE_OPT(name, ...) \
-	log::debug(logs::boot, "    Supports %9s: %s", #name, cpu.has_feature(cpu::feature::name) ? "yes" : "no");
+	log_debug(logs::boot, "    Supports %9s: %s", #name, cpu.has_feature(cpu::feature::name) ? "yes" : "no");
 
 #define CPU_FEATURE_REQ(name, feat_leaf, feat_sub, regname, bit) \
 	CPU_FEATURE_OPT(name, feat_leaf, feat_sub, regname, bit); \
@@ -38,6 +63,56 @@ cpu_validate()
 #undef CPU_FEATURE_REQ
 }
 
+static void
+fpu_enable(bool bsp)
+{
+	cpu::cpu_id cpu;
+	bool xsave = cpu.has_feature(cpu::feature::xsave);
+
+	uint64_t cr4 = 0;
+	asm volatile ( "mov %%cr4, %0" : "=r" (cr4) );
+	cr4 |= cr4_osfxsr | cr4_osxmmexcpt;
+	if (xsave) cr4 |= cr4_osxsave;
+	asm volatile ( "mov %0, %%cr4" :: "r" (cr4) );
+
+	if (xsave) {
+		uint64_t xcr0 = xcr0_x87 | xcr0_sse;
+		if (cpu.has_feature(cpu::feature::avx))
+			xcr0 |= xcr0_avx;
+
+		asm volatile ( "xsetbv" ::
+			"c" (0), "a" (xcr0 & 0xffffffff), "d" (xcr0 >> 32) );
+	}
+
+	if (!bsp)
+		return;
+
+	// With XCR0 set, CPUID leaf 0xd reports the xsave area size for
+	// the currently enabled components
+	size_t size = xsave ? cpu.get(0xd, 0).ebx : 512;
+	g_fpu_state_size = (size + 63) & ~63ull;
+	g_fpu_xsave = xsave;
+
+	log_debug(logs::boot, "FPU state: %s, %d bytes per thread",
+			xsave ? "xsave" : "fxsave", g_fpu_state_size);
+}
+
+size_t
+fpu_state_size()
+{
+	return g_fpu_state_size;
+}
+
+void
+fpu_init_state(void *area)
+{
+	// A zeroed xsave header marks every component as in its initial
+	// state, but MXCSR is always loaded from the legacy region
+	kutil::memset(area, 0, g_fpu_state_size);
+	*reinterpret_cast<uint16_t*>(area) = fpu_default_fcw;
+	*kutil::offset_pointer(reinterpret_cast<uint32_t*>(area), 24) = fpu_default_mxcsr;
+}
+
 void
 cpu_early_init(cpu_data *cpu)
 {
@@ -59,8 +134,80 @@ cpu_init(cpu_data *cpu, bool bsp)
 	// Set up the syscall MSRs
 	syscall_enable();
 
+	// Let user code use SSE and AVX, whose state task_switch saves
+	fpu_enable(bsp);
+
 	// Set up the page attributes table
 	uint64_t pat = rdmsr(msr::ia32_pat);
 	pat = (pat & 0x00ffffffffffffffull) | (0x01ull << 56); // set PAT 7 to WC
 	wrmsr(msr::ia32_pat, pat);
 }
+
+void
+cpu_online(cpu_data *cpu)
+{
+	unsigned i = __atomic_fetch_add(&g_online_count, 1, __ATOMIC_ACQ_REL);
+	kassert(i < max_cpus, "Too many CPUs online");
+	__atomic_store_n(&g_online_cpus[i], cpu, __ATOMIC_RELEASE);
+}
+
+static inline void
+flush_tlb()
+{
+	uintptr_t cr3 = 0;
+	__asm__ __volatile__ (
+		"mov %%cr3, %0; mov %0, %%cr3"
+		: "=r" (cr3) :: "memory" );
+}
+
+void
+tlb_shootdown_handle()
+{
+	cpu_data &cpu = current_cpu();
+	uint64_t requested = __atomic_load_n(&cpu.tlb_requested, __ATOMIC_ACQUIRE);
+	if (requested == cpu.tlb_flushed)
+		return;
+
+	flush_tlb();
+	__atomic_store_n(&cpu.tlb_flushed, requested, __ATOMIC_RELEASE);
+}
+
+void
+tlb_shootdown()
+{
+	// Stay on this CPU while using its APIC
+	interrupt_guard guard;
+	cpu_data &self = current_cpu();
+	if (!self.apic)
+		return;
+
+	uint64_t requests[max_cpus];
+	unsigned count = __atomic_load_n(&g_online_count, __ATOMIC_ACQUIRE);
+	const uint8_t vector = static_cast<uint8_t>(isr::isrTLBShootdown);
+
+	// Requests are counters rather than flags, so that a CPU flushing for
+	// one request can't be mistaken as having flushed for a later one
+	for (unsigned i = 0; i < count; ++i) {
+		cpu_data *cpu = __atomic_load_n(&g_online_cpus[i], __ATOMIC_ACQUIRE);
+		if (!cpu || cpu == &self) {
+			requests[i] = 0;
+			continue;
+		}
+
+		requests[i] = __atomic_add_fetch(&cpu->tlb_requested, 1, __ATOMIC_ACQ_REL);
+		self.apic->send_ipi(ipi::fixed, vector, cpu->id);
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		if (!requests[i])
+			continue;
+
+		cpu_data *cpu = g_online_cpus[i];
+		while (__atomic_load_n(&cpu->tlb_flushed, __ATOMIC_ACQUIRE) < requests[i]) {
+			// Another CPU may be waiting on this one with its
+			// interrupts disabled, too
+			tlb_shootdown_handle();
+			__asm__ __volatile__ ( "pause" ::: "memory" );
+		}
+	}
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+struct free_page_header;
 class GDT;
 class lapic;
 class process;
@@ -36,6 +38,18 @@ struct cpu_data
 	// Members beyond this point do not appear in
 	// the assembly version
 	lapic *apic;
+
+	// This CPU's cache of free page table pages, see
+	// page_table::get_table_page()
+	free_page_header *table_zeroed;
+	free_page_header *table_dirty;
+	uint32_t table_zeroed_count;
+	uint32_t table_dirty_count;
+
+	// TLB shootdowns requested of this CPU, and the last one it has
+	// completed, see tlb_shootdown()
+	uint64_t tlb_requested;
+	uint64_t tlb_flushed;
 };
 
 extern "C" cpu_data * _current_gsbase();
@@ -54,6 +68,30 @@ void cpu_early_init(cpu_data *cpu);
 /// Get the cpu_data struct for the current executing CPU
 inline cpu_data & current_cpu() { return *_current_gsbase(); }
 
+/// Mark a CPU as online: its local APIC is enabled, and it can take
+/// TLB shootdowns from other CPUs.
+/// \arg cpu  The cpu_data structure for this CPU
+void cpu_online(cpu_data *cpu);
+
+/// Flush the TLBs of every other online CPU, and wait until they have
+/// done so. Call this after changing mappings in a way that revokes
+/// access, before the old frames can be reused. Never call it with a
+/// spinlock held: a CPU spinning on that lock with interrupts disabled
+/// could never answer.
+void tlb_shootdown();
+
+/// Complete any TLB shootdown requested of the current CPU.
+void tlb_shootdown_handle();
+
+/// Get the size of the per-thread FPU/SSE/AVX state save area. Only valid
+/// after cpu_init has been called on the BSP.
+size_t fpu_state_size();
+
+/// Fill in a thread's FPU state save area with the default state that
+/// task_switch will restore the first time the thread runs.
+/// \arg area  The save area, 64-byte aligned and fpu_state_size() long
+void fpu_init_state(void *area);
+
 /// Validate the required CPU features are present. Really, the bootloader already
 /// validated the required features, but still iterate the options and log about them.
 void cpu_validate();
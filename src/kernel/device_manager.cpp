@@ -12,9 +12,13 @@
 #include "kernel_memory.h"
 #include "log.h"
 #include "objects/endpoint.h"
+#include "serial.h"
 
 
 static endpoint * const ignore_endpoint = reinterpret_cast<endpoint*>(-1ull);
+static endpoint * const serial_endpoint = reinterpret_cast<endpoint*>(-2ull);
+
+static constexpr uint8_t com1_irq = 4;
 
 static const char expected_signature[] = "RSD PTR ";
 
@@ -54,14 +58,6 @@ void irq2_callback(void *)
 {
 }
 
-void irq4_callback(void *)
-{
-	// TODO: move this to a real serial driver
-	console *cons = console::get();
-	cons->echo();
-}
-
-
 device_manager::device_manager() :
 	m_lapic_base(0)
 {
@@ -144,10 +140,10 @@ device_manager::load_xsdt(const acpi_table_header *header)
 	const auto *xsdt = check_get_table<acpi_xsdt>(header);
 
 	char sig[5] = {0,0,0,0,0};
-	log::info(logs::device, "ACPI 2.0+ tables loading");
+	log_info(logs::device, "ACPI 2.0+ tables loading");
 
 	put_sig(sig, xsdt->header.type);
-	log::debug(logs::device, "  Found table %s", sig);
+	log_debug(logs::device, "  Found table %s", sig);
 
 	size_t num_tables = acpi_table_entries(xsdt, sizeof(void*));
 	for (size_t i = 0; i < num_tables; ++i) {
@@ -155,7 +151,7 @@ device_manager::load_xsdt(const acpi_table_header *header)
 			memory::to_virtual(xsdt->headers[i]);
 
 		put_sig(sig, header->type);
-		log::debug(logs::device, "  Found table %s", sig);
+		log_debug(logs::device, "  Found table %s", sig);
 
 		kassert(header->validate(), "Table failed validation.");
 
@@ -226,7 +222,7 @@ device_manager::load_apic(const acpi_table_header *header)
 				uint8_t id = kutil::read_from<uint8_t>(p+3);
 				m_apic_ids.append(id);
 
-				log::debug(logs::device, "    Local APIC uid %x id %x", uid, id);
+				log_debug(logs::device, "    Local APIC uid %x id %x", uid, id);
 			}
 			break;
 
@@ -235,7 +231,7 @@ device_manager::load_apic(const acpi_table_header *header)
 				uint32_t base_gsi = kutil::read_from<uint32_t>(p+8);
 				m_ioapics.emplace(base, base_gsi);
 
-				log::debug(logs::device, "    IO APIC gsi %x base %x", base_gsi, base);
+				log_debug(logs::device, "    IO APIC gsi %x base %x", base_gsi, base);
 			}
 			break;
 
@@ -246,7 +242,7 @@ device_manager::load_apic(const acpi_table_header *header)
 				o.flags = kutil::read_from<uint16_t>(p+8);
 				m_overrides.append(o);
 
-				log::debug(logs::device, "    Intr source override IRQ %d -> %d Pol %d Tri %d",
+				log_debug(logs::device, "    Intr source override IRQ %d -> %d Pol %d Tri %d",
 						o.source, o.gsi, (o.flags & 0x3), ((o.flags >> 2) & 0x3));
 			}
 			break;
@@ -258,13 +254,13 @@ device_manager::load_apic(const acpi_table_header *header)
 			nmi.flags = kutil::read_from<uint16_t>(p + 3);
 			m_nmis.append(nmi);
 
-			log::debug(logs::device, "    LAPIC NMI Proc %02x LINT%d Pol %d Tri %d",
+			log_debug(logs::device, "    LAPIC NMI Proc %02x LINT%d Pol %d Tri %d",
 					nmi.cpu, nmi.lint, nmi.flags & 0x3, (nmi.flags >> 2) & 0x3);
 			}
 			break;
 
 		default:
-			log::debug(logs::device, "    APIC entry type %d", type);
+			log_debug(logs::device, "    APIC entry type %d", type);
 		}
 
 		p += length;
@@ -288,7 +284,7 @@ device_manager::load_mcfg(const acpi_table_header *header)
 		m_pci[i].bus_end = mcfge.bus_end;
 		m_pci[i].base = memory::to_virtual<uint32_t>(mcfge.base);
 
-		log::debug(logs::device, "  Found MCFG entry: base %lx  group %d  bus %d-%d",
+		log_debug(logs::device, "  Found MCFG entry: base %lx  group %d  bus %d-%d",
 				mcfge.base, mcfge.group, mcfge.bus_start, mcfge.bus_end);
 	}
 
@@ -300,7 +296,7 @@ device_manager::load_hpet(const acpi_table_header *header)
 {
 	const auto *hpet = check_get_table<acpi_hpet>(header);
 
-	log::debug(logs::device, "  Found HPET device #%3d: base %016lx  pmin %d  attr %02x",
+	log_debug(logs::device, "  Found HPET device #%3d: base %016lx  pmin %d  attr %02x",
 			hpet->index, hpet->base_address.address, hpet->periodic_min, hpet->attributes);
 
 	uint32_t hwid = hpet->hardware_id;
@@ -310,9 +306,9 @@ device_manager::load_hpet(const acpi_table_header *header)
 	uint8_t legacy_replacement = (hwid >> 15) & 1;
 	uint32_t pci_vendor_id = (hwid >> 16);
 
-	log::debug(logs::device, "      rev:%02d comparators:%02d count_size_cap:%1d legacy_repl:%1d",
+	log_debug(logs::device, "      rev:%02d comparators:%02d count_size_cap:%1d legacy_repl:%1d",
 			rev_id, comparators, count_size_cap, legacy_replacement);
-	log::debug(logs::device, "      pci vendor id: %04x", pci_vendor_id);
+	log_debug(logs::device, "      pci vendor id: %04x", pci_vendor_id);
 
 	m_hpets.emplace(hpet->index,
 		reinterpret_cast<uint64_t*>(hpet->base_address.address + ::memory::page_offset));
@@ -322,7 +318,7 @@ void
 device_manager::probe_pci()
 {
 	for (auto &pci : m_pci) {
-		log::debug(logs::device, "Probing PCI group at base %016lx", pci.base);
+		log_debug(logs::device, "Probing PCI group at base %016lx", pci.base);
 
 		for (int bus = pci.bus_start; bus <= pci.bus_end; ++bus) {
 			for (int dev = 0; dev < 32; ++dev) {
@@ -358,7 +354,7 @@ device_manager::init_drivers()
 			continue;
 
 		if (device.progif() != 1) {
-			log::warn(logs::device, "Found SATA device %d:%d:%d, but not an AHCI interface.",
+			log_warn(logs::device, "Found SATA device %d:%d:%d, but not an AHCI interface.",
 					device.bus(), device.device(), device.function());
 		}
 
@@ -371,11 +367,12 @@ device_manager::init_drivers()
 		h.enable();
 
 		// becomes the singleton
-		master_clock = new clock(h.rate(), hpet_clock_source, &h);
-		log::info(logs::clock, "Created master clock using HPET 0: Rate %d", h.rate());
+		master_clock = new clock(h.frequency(), hpet_clock_source, &h);
+		log_info(logs::clock, "Created master clock using HPET 0: Rate %d Hz", h.frequency());
+		master_clock->calibrate_tsc();
 	} else {
 		//TODO: Other clocks, APIC clock?
-		master_clock = new clock(5000, fake_clock_source, nullptr);
+		master_clock = new clock(5000000000, fake_clock_source, nullptr);
 	}
 
 	kassert(master_clock, "Failed to allocate master clock");
@@ -391,10 +388,46 @@ device_manager::dispatch_irq(unsigned irq)
 	if (!e || e == ignore_endpoint)
 		return e == ignore_endpoint;
 
+	if (e == serial_endpoint) {
+		g_com1.handle_interrupt();
+		return true;
+	}
+
 	e->signal_irq(irq);
 	return true;
 }
 
+void
+device_manager::init_serial()
+{
+	uint32_t gsi = com1_irq;
+	uint16_t flags = 0;
+	if (const irq_override *o = get_irq_override(com1_irq)) {
+		gsi = o->gsi;
+		flags = o->flags;
+	}
+
+	if (gsi >= m_irqs.count()) {
+		log_warn(logs::device, "Serial IRQ %d out of range, not using it", gsi);
+		return;
+	}
+
+	for (auto &io : m_ioapics) {
+		uint32_t base = io.get_base_gsi();
+		if (gsi < base || gsi >= base + io.get_num_gsi())
+			continue;
+
+		m_irqs[gsi] = serial_endpoint;
+		io.redirect(gsi - base, isr::irq00 + gsi, flags, false);
+		g_com1.enable_interrupts();
+
+		log_info(logs::device, "Serial output is interrupt driven on IRQ %d", gsi);
+		return;
+	}
+
+	log_warn(logs::device, "No IOAPIC for serial IRQ %d, not using it", gsi);
+}
+
 bool
 device_manager::bind_irq(unsigned irq, endpoint *target)
 {
@@ -425,7 +458,7 @@ device_manager::allocate_msi(const char *name, pci_device &device, irq_callback
 	isr vector = isr::irq00 + irq;
 	m_irqs.append({name, cb, data});
 
-	log::debug(logs::device, "Allocating IRQ %02x to %s.", irq, name);
+	log_debug(logs::device, "Allocating IRQ %02x to %s.", irq, name);
 
 	device.write_msi_regs(
 			0xFEE00000,
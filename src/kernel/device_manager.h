@@ -37,6 +37,10 @@ public:
 	/// Intialize drivers for the current device list.
 	void init_drivers();
 
+	/// Route the COM1 interrupt to the kernel's serial driver, and have it
+	/// send console output from its transmit interrupt.
+	void init_serial();
+
 	/// Bind an IRQ to an endpoint
 	/// \arg irq    The IRQ number to bind
 	/// \arg target The endpoint to recieve messages when the IRQ is signalled
@@ -18,8 +18,24 @@ frame_allocator::get()
 
 frame_allocator::frame_allocator(kernel::args::frame_block *frames, size_t count) :
 	m_blocks {frames},
-	m_count {count}
+	m_count {count},
+	m_free {0},
+	m_low_mark {0},
+	m_low_handler {nullptr}
 {
+	for (size_t i = 0; i < count; ++i) {
+		frame_block &block = m_blocks[i];
+		size_t words = (block.count + 63) / 64;
+		for (size_t j = 0; j < words; ++j)
+			m_free += __builtin_popcountll(block.bitmap[j]);
+	}
+}
+
+void
+frame_allocator::set_low_handler(size_t frames, low_handler handler)
+{
+	m_low_mark = frames;
+	m_low_handler = handler;
 }
 
 inline unsigned
@@ -32,8 +48,24 @@ bsf(uint64_t v)
 size_t
 frame_allocator::allocate(size_t count, uintptr_t *address)
 {
-	kutil::scoped_lock lock {m_lock};
+	size_t n = 0;
+	{
+		kutil::scoped_lock lock {m_lock};
+		n = take(count, address);
+		m_free -= n;
+	}
 
+	// Running out isn't fatal: callers fail the allocation, and the low
+	// handler wakes the reclaimer to free some frames up
+	if (m_low_handler && m_free < m_low_mark)
+		m_low_handler();
+
+	return n;
+}
+
+size_t
+frame_allocator::take(size_t count, uintptr_t *address)
+{
 	for (long i = m_count - 1; i >= 0; --i) {
 		frame_block &block = m_blocks[i];
 
@@ -59,23 +91,23 @@ frame_allocator::allocate(size_t count, uintptr_t *address)
 		*address = block.base + frame * frame_size;
 
 		// Clear the bits to mark these pages allocated
-		m3 &= ~(((1 << n) - 1) << o3);
+		uint64_t run = n < 64 ? (1ull << n) - 1 : ~0ull;
+		m3 &= ~(run << o3);
 		block.bitmap[(o1 << 6) + o2] = m3;
 		if (!m3) {
 			// if that was it for this group, clear the next level bit
-			m2 &= ~(1 << o2);
+			m2 &= ~(1ull << o2);
 			block.map2[o1] = m2;
 
 			if (!m2) {
 				// if that was cleared too, update the top level
-				block.map1 &= ~(1 << o1);
+				block.map1 &= ~(1ull << o1);
 			}
 		}
 
 		return n;
 	}
 
-	kassert(false, "frame_allocator ran out of free frames!");
 	return 0;
 }
 
@@ -102,9 +134,13 @@ frame_allocator::free(uintptr_t address, size_t count)
 		unsigned o3 = frame & 0x3f;
 
 		while (count--) {
-			block.map1 |= (1 << o1);
-			block.map2[o1] |= (1 << o2);
-			block.bitmap[o2] |= (1 << o3);
+			uint64_t &bits = block.bitmap[(o1 << 6) + o2];
+			if (!(bits & (1ull << o3)))
+				++m_free;
+
+			block.map1 |= (1ull << o1);
+			block.map2[o1] |= (1ull << o2);
+			bits |= (1ull << o3);
 			if (++o3 == 64) {
 				o3 = 0;
 				if (++o2 == 64) {
@@ -140,12 +176,16 @@ frame_allocator::used(uintptr_t address, size_t count)
 		unsigned o3 = frame & 0x3f;
 
 		while (count--) {
-			block.bitmap[o2] &= ~(1 << o3);
-			if (!block.bitmap[o2]) {
-				block.map2[o1] &= ~(1 << o2);
+			uint64_t &bits = block.bitmap[(o1 << 6) + o2];
+			if (bits & (1ull << o3))
+				--m_free;
+
+			bits &= ~(1ull << o3);
+			if (!bits) {
+				block.map2[o1] &= ~(1ull << o2);
 
 				if (!block.map2[o1]) {
-					block.map1 &= ~(1 << o1);
+					block.map1 &= ~(1ull << o1);
 				}
 			}
 
@@ -16,6 +16,9 @@ class frame_allocator
 public:
 	using frame_block = kernel::args::frame_block;
 
+	/// Callback for when free memory runs low
+	using low_handler = void (*)();
+
 	/// Constructor
 	/// \arg blocks The bootloader-supplied frame bitmap block list
 	/// \arg count  Number of entries in the block list
@@ -26,7 +29,8 @@ public:
 	/// be contiguous.
 	/// \arg count    The maximum number of frames to get
 	/// \arg address  [out] The physical address of the first frame
-	/// \returns      The number of frames retrieved
+	/// \returns      The number of frames retrieved, or 0 if there are
+	///               no free frames
 	size_t allocate(size_t count, uintptr_t *address);
 
 	/// Free previously allocated frames.
@@ -39,12 +43,29 @@ public:
 	/// \arg count    The number of frames to be freed
 	void used(uintptr_t address, size_t count);
 
+	/// Get the number of free frames
+	inline size_t free_count() const { return m_free; }
+
+	/// Set a handler to be called after any allocation that leaves fewer
+	/// than the given number of frames free. The handler is called outside
+	/// of the allocator's lock.
+	/// \arg frames   The low watermark, in frames
+	/// \arg handler  The function to call, or null to clear it
+	void set_low_handler(size_t frames, low_handler handler);
+
 	/// Get the global frame allocator
 	static frame_allocator & get();
 
 private:
+	/// Take frames from the free bitmaps. Must be called with m_lock held.
+	size_t take(size_t count, uintptr_t *address);
+
 	frame_block *m_blocks;
 	size_t m_count;
+	size_t m_free;
+
+	size_t m_low_mark;
+	low_handler m_low_handler;
 
 	kutil::spinlock m_lock;
 
@@ -4,11 +4,13 @@
 #include "device_manager.h"
 #include "fs/gpt.h"
 #include "log.h"
+#include "swap.h"
 
 namespace fs {
 
 const kutil::guid efi_system_part = kutil::make_guid(0xC12A7328, 0xF81F, 0x11D2, 0xBA4B, 0x00A0C93EC93B);
 const kutil::guid efi_unused_part = kutil::make_guid(0, 0, 0, 0, 0);
+const kutil::guid linux_swap_part = kutil::make_guid(0x0657FD6D, 0xA4AB, 0x43C4, 0x84E5, 0x0933C84B4F4F);
 
 const uint64_t gpt_signature = 0x5452415020494645; // "EFI PART"
 const size_t block_size = 512;
@@ -42,21 +44,34 @@ struct gpt_entry
 } __attribute__ ((packed));
 
 
-partition::partition(block_device *parent, size_t start, size_t length) :
+partition::partition(block_device *parent, size_t start, size_t length, const kutil::guid &type) :
 	m_parent(parent),
 	m_start(start),
-	m_length(length)
+	m_length(length),
+	m_type(type)
 {
 }
 
 size_t
 partition::read(size_t offset, size_t length, void *buffer)
 {
+	if (offset >= m_length)
+		return 0;
 	if (offset + length > m_length)
-		offset = m_length - offset;
+		length = m_length - offset;
 	return m_parent->read(m_start + offset, length, buffer);
 }
 
+size_t
+partition::write(size_t offset, size_t length, const void *buffer)
+{
+	if (offset >= m_length)
+		return 0;
+	if (offset + length > m_length)
+		length = m_length - offset;
+	return m_parent->write(m_start + offset, length, buffer);
+}
+
 
 unsigned
 partition::load(block_device *device)
@@ -71,7 +86,7 @@ partition::load(block_device *device)
 		return 0;
 
 	size_t arraysize = header->entry_length * header->entry_count;
-	log::debug(logs::fs, "Found GPT header: %d paritions, size 0x%lx",
+	log_debug(logs::fs, "Found GPT header: %d paritions, size 0x%lx",
 			header->entry_count, arraysize);
 
 	uint8_t *array = new uint8_t[arraysize];
@@ -91,20 +106,26 @@ partition::load(block_device *device)
 		for (int i = 0; i < sizeof(name); ++i)
 			name[i] = entry->name_wide[i];
 
-		log::debug(logs::fs, "Found partition %02x at %lx-%lx", i, entry->start_lba, entry->end_lba);
+		log_debug(logs::fs, "Found partition %02x at %lx-%lx", i, entry->start_lba, entry->end_lba);
 		if (entry->type == efi_system_part)
-			log::debug(logs::fs, "   type EFI SYSTEM PARTITION");
+			log_debug(logs::fs, "   type EFI SYSTEM PARTITION");
+		else if (entry->type == linux_swap_part)
+			log_debug(logs::fs, "   type SWAP");
 		else
-			log::debug(logs::fs, "   type %G", entry->type);
-		log::debug(logs::fs, "   name %s", name);
-		log::debug(logs::fs, "   attr %016lx", entry->attributes);
+			log_debug(logs::fs, "   type %G", entry->type);
+		log_debug(logs::fs, "   name %s", name);
+		log_debug(logs::fs, "   attr %016lx", entry->attributes);
 
 		found += 1;
 		partition *part = new partition(
 				device,
 				entry->start_lba * block_size,
-				(entry->end_lba - entry->start_lba) * block_size);
+				(entry->end_lba - entry->start_lba) * block_size,
+				entry->type);
 		dm.register_block_device(part);
+
+		if (entry->type == linux_swap_part)
+			page_reclaimer::get().add_device(part);
 	}
 
 	return found;
@@ -1,6 +1,7 @@
 #pragma once
 /// \file gpt.h
 /// Definitions for dealing with GUID Partition Tables
+#include "kutil/guid.h"
 #include "block_device.h"
 
 namespace fs {
@@ -14,16 +15,30 @@ public:
 	/// \arg parent  The block device this partition is a part of
 	/// \arg start   The starting offset in bytes from the start of the parent
 	/// \arg lenght  The length in bytes of this partition
-	partition(block_device *parent, size_t start, size_t length);
+	/// \arg type    The partition type GUID
+	partition(block_device *parent, size_t start, size_t length, const kutil::guid &type);
 
 	/// Read bytes from the partition.
 	/// \arg offset  The offset in bytes at which to start reading
 	/// \arg length  The number of bytes to read
 	/// \arg buffer  [out] Data is read into this buffer
 	/// \returns     The number of bytes read
-	virtual size_t read(size_t offset, size_t length, void *buffer);
+	virtual size_t read(size_t offset, size_t length, void *buffer) override;
 
-	/// Find partitions on a block device and add them to the device manager
+	/// Write bytes to the partition.
+	/// \arg offset  The offset in bytes at which to start writing
+	/// \arg length  The number of bytes to write
+	/// \arg buffer  The data to write
+	/// \returns     The number of bytes written
+	virtual size_t write(size_t offset, size_t length, const void *buffer) override;
+
+	virtual size_t size() const override { return m_length; }
+
+	/// Get the partition type GUID
+	inline const kutil::guid & type() const { return m_type; }
+
+	/// Find partitions on a block device and add them to the device manager.
+	/// Swap partitions are also handed to the page reclaimer.
 	/// \arg device  The device to search for partitions
 	/// \returns     The number of partitions found
 	static unsigned load(block_device *device);
@@ -32,6 +47,7 @@ private:
 	block_device *m_parent;
 	size_t m_start;
 	size_t m_length;
+	kutil::guid m_type;
 };
 
 } // namespace fs
@@ -0,0 +1,130 @@
+#include "j6/errors.h"
+#include "kutil/assert.h"
+#include "futex.h"
+#include "log.h"
+#include "objects/process.h"
+#include "objects/thread.h"
+#include "user_access.h"
+#include "vm_space.h"
+
+static futex_table g_futex_table;
+
+futex_table::futex_table()
+{
+}
+
+futex_table &
+futex_table::get()
+{
+	return g_futex_table;
+}
+
+bool
+futex_table::key(const uint32_t *addr, vm_area *&area, uintptr_t &offset)
+{
+	uintptr_t a = reinterpret_cast<uintptr_t>(addr);
+	if (a & (sizeof(uint32_t) - 1))
+		return false;
+
+	uintptr_t base = 0;
+	area = process::current().space().get(a, &base);
+	if (!area)
+		return false;
+
+	offset = a - base;
+	return true;
+}
+
+size_t
+futex_table::hash(const vm_area *area, uintptr_t offset)
+{
+	uint64_t k = reinterpret_cast<uintptr_t>(area) ^ (offset >> 2);
+	k *= 0x9e3779b97f4a7c15ull;
+	return k >> (64 - __builtin_ctzll(bucket_count));
+}
+
+j6_status_t
+futex_table::wait(const uint32_t *addr, uint32_t expected)
+{
+	vm_area *area = nullptr;
+	uintptr_t offset = 0;
+	if (!key(addr, area, offset))
+		return j6_err_invalid_arg;
+
+	thread &th = thread::current();
+	size_t index = hash(area, offset);
+	bucket &b = m_buckets[index];
+
+	kutil::spinlock::waiter lock_waiter;
+	uint32_t value = 0;
+	while (true) {
+		// Fault the page in first, since the fault handler can't run
+		// with the bucket lock held
+		value = *static_cast<const volatile uint32_t*>(addr);
+
+		// A waker must change the word before taking the bucket lock, so
+		// reading it under the lock orders this check against any wake.
+		// If the page was evicted in between, try again.
+		b.lock.acquire(&lock_waiter);
+		if (read_user_u32(addr, &value))
+			break;
+		b.lock.release(&lock_waiter);
+	}
+
+	if (value != expected) {
+		b.lock.release(&lock_waiter);
+		return j6_status_changed;
+	}
+
+	waiter w;
+	w.area = area;
+	w.offset = offset;
+	w.th = &th;
+	b.waiters.push_back(&w);
+
+	// Releases the bucket lock before rescheduling, and only returns
+	// after a waker has removed w from the list
+	th.wait_on_futex(b.lock, &lock_waiter, index);
+	return th.get_wait_result();
+}
+
+j6_status_t
+futex_table::wake(const uint32_t *addr, size_t count, size_t &woken)
+{
+	woken = 0;
+
+	vm_area *area = nullptr;
+	uintptr_t offset = 0;
+	if (!key(addr, area, offset))
+		return j6_err_invalid_arg;
+
+	bucket &b = m_buckets[hash(area, offset)];
+	kutil::scoped_lock lock {b.lock};
+
+	waiter *w = b.waiters.front();
+	while (w && woken < count) {
+		waiter *next = w->next();
+		if (w->area == area && w->offset == offset) {
+			b.waiters.remove(w);
+			w->th->wake_on_futex();
+			++woken;
+		}
+		w = next;
+	}
+
+	return j6_status_ok;
+}
+
+void
+futex_table::cancel(thread *th)
+{
+	bucket &b = m_buckets[th->get_wait_data()];
+	kutil::scoped_lock lock {b.lock};
+
+	for (waiter *w = b.waiters.front(); w; w = w->next()) {
+		if (w->th == th) {
+			b.waiters.remove(w);
+			return;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+/// \file futex.h
+/// Wait queues for threads blocked on user memory words
+
+#include <stddef.h>
+#include <stdint.h>
+#include "j6/types.h"
+#include "kutil/linked_list.h"
+#include "kutil/spinlock.h"
+
+class thread;
+class vm_area;
+
+/// A hash table of wait queues for threads blocked on a 32-bit word of
+/// user memory. Waiters are keyed by the VMA and offset of the word
+/// rather than its virtual address, so processes sharing a VMA can wait
+/// on and wake each other, even if it's mapped at different addresses.
+class futex_table
+{
+public:
+	/// Number of wait queue buckets in the table
+	static constexpr size_t bucket_count = 256;
+
+	futex_table();
+
+	/// Get the global futex table
+	static futex_table & get();
+
+	/// Block the current thread while the word at addr holds the expected
+	/// value. The check and the enqueue happen under the bucket lock, so a
+	/// wake after the word is changed can't be missed.
+	/// \arg addr      The address of the word in the current process
+	/// \arg expected  The value the word must hold to block
+	/// \returns       j6_status_ok once woken, j6_status_changed if the
+	///                word didn't hold the expected value, or an error
+	j6_status_t wait(const uint32_t *addr, uint32_t expected);
+
+	/// Wake threads blocked on the word at addr, in the order they waited.
+	/// \arg addr   The address of the word in the current process
+	/// \arg count  The maximum number of threads to wake
+	/// \arg woken  [out] Receives the number of threads woken
+	/// \returns    j6_status_ok, or an error if addr isn't a mapped word
+	j6_status_t wake(const uint32_t *addr, size_t count, size_t &woken);
+
+	/// Remove a thread that is exiting from the queue it's blocked on.
+	/// \arg th  The thread, which must be blocked on a futex
+	void cancel(thread *th);
+
+private:
+	struct waiter_data
+	{
+		vm_area *area;
+		uintptr_t offset;
+		thread *th;
+	};
+
+	using waiter = kutil::list_node<waiter_data>;
+
+	struct bucket
+	{
+		kutil::linked_list<waiter_data> waiters;
+		kutil::spinlock lock;
+	};
+
+	/// Find the VMA and offset of a word in the current process.
+	/// \arg addr    The address of the word
+	/// \arg area    [out] Receives the VMA containing the word
+	/// \arg offset  [out] Receives the offset of the word in the VMA
+	/// \returns     False if addr is misaligned or not mapped
+	static bool key(const uint32_t *addr, vm_area *&area, uintptr_t &offset);
+
+	/// Get the bucket index for a key
+	static size_t hash(const vm_area *area, uintptr_t offset);
+
+	bucket m_buckets[bucket_count];
+};
@@ -20,8 +20,8 @@ public:
 	/// Configure the timer and start it running.
 	void enable();
 
-	/// Get the timer rate in ticks per us
-	inline uint64_t rate() const { return 1000000000/m_period; }
+	/// Get the timer rate in ticks per second
+	inline uint64_t frequency() const { return 1000000000000000ull/m_period; }
 
 	/// Get the current timer value
 	uint64_t value() const;
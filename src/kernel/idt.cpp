@@ -99,9 +99,9 @@ IDT::dump(unsigned index) const
 	if (index != -1) {
 		start = index;
 		count = 1;
-		log::info(logs::boot, "IDT FOR INDEX %02x", index);
+		log_info(logs::boot, "IDT FOR INDEX %02x", index);
 	} else {
-		log::info(logs::boot, "Loaded IDT at: %lx size: %d bytes", m_ptr.base, m_ptr.limit+1);
+		log_info(logs::boot, "Loaded IDT at: %lx size: %d bytes", m_ptr.base, m_ptr.limit+1);
 	}
 
 	const descriptor *idt =
@@ -124,7 +124,7 @@ IDT::dump(unsigned index) const
 		}
 
 		if (idt[i].flags & 0x80) {
-			log::debug(logs::boot,
+			log_debug(logs::boot,
 					"   Entry %3d: Base:%lx Sel(rpl %d, ti %d, %3d) IST:%d %s DPL:%d", i, base,
 					(idt[i].selector & 0x3),
 					((idt[i].selector & 0x4) >> 2),
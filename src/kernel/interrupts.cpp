@@ -15,8 +15,10 @@
 #include "log.h"
 #include "objects/process.h"
 #include "scheduler.h"
+#include "serial.h"
 #include "syscall.h"
 #include "tss.h"
+#include "user_access.h"
 #include "vm_space.h"
 
 static const uint16_t PIC1 = 0x20;
@@ -34,6 +36,14 @@ extern "C" {
 
 }
 
+/// Write out any queued console output, and stop this CPU
+static void
+halt_system()
+{
+	g_com1.panic();
+	_halt();
+}
+
 isr
 operator+(const isr &lhs, int rhs)
 {
@@ -119,7 +129,7 @@ isr_handler(cpu_state *regs)
 			print_regL("rip", regs->rip);
 			print_regM("rsp", regs->user_rsp);
 			print_regM("fla", regs->rflags);
-			_halt();
+			halt_system();
 		}
 		break;
 
@@ -130,7 +140,7 @@ isr_handler(cpu_state *regs)
 		cons->set_color();
 		print_regs(*regs);
 		print_stacktrace(2);
-		_halt();
+		halt_system();
 		break;
 
 	case isr::isrGPFault: {
@@ -168,13 +178,19 @@ isr_handler(cpu_state *regs)
 			print_stack(*regs);
 			*/
 		}
-		_halt();
+		halt_system();
 		break;
 
 	case isr::isrPageFault: {
 			uintptr_t cr2 = 0;
 			__asm__ __volatile__ ("mov %%cr2, %0" : "=r"(cr2));
 
+			// A fault-safe read of user memory just fails instead
+			if (regs->rip == reinterpret_cast<uintptr_t>(&read_user_u32_load)) {
+				regs->rip = reinterpret_cast<uintptr_t>(&read_user_u32_fixup);
+				break;
+			}
+
 			bool user = cr2 < memory::kernel_offset;
 			vm_space::fault_type ft =
 				static_cast<vm_space::fault_type>(regs->errorcode);
@@ -199,7 +215,7 @@ isr_handler(cpu_state *regs)
 			cons->puts("\n");
 			print_regs(*regs);
 			print_stacktrace(2);
-			_halt();
+			halt_system();
 		}
 		break;
 
@@ -207,6 +223,10 @@ isr_handler(cpu_state *regs)
 		scheduler::get().schedule();
 		break;
 
+	case isr::isrTLBShootdown:
+		tlb_shootdown_handle();
+		break;
+
 	case isr::isrLINT0:
 		cons->puts("\nLINT0\n");
 		break;
@@ -220,7 +240,7 @@ isr_handler(cpu_state *regs)
 			print_regs(*regs);
 			print_stacktrace(2);
 		}
-		_halt();
+		halt_system();
 		break;
 
 	/*
@@ -269,7 +289,7 @@ isr_handler(cpu_state *regs)
 
 		print_regs(*regs);
 		print_stacktrace(2);
-		_halt();
+		halt_system();
 	}
 
 	// Return the IST for this vector to what it was
@@ -31,3 +31,23 @@ extern "C" {
 
 /// Disable the legacy PIC
 void disable_legacy_pic();
+
+/// Disables interrupts on the current CPU for the lifetime of the object,
+/// restoring the previous interrupt flag afterwards. Use it to keep other
+/// threads off per-CPU data. Any spinlock taken inside one must always be
+/// taken with interrupts disabled.
+class interrupt_guard
+{
+public:
+	inline interrupt_guard() {
+		__asm__ __volatile__ ( "pushfq; popq %0; cli" : "=r" (m_flags) :: "memory" );
+	}
+
+	inline ~interrupt_guard() {
+		if (m_flags & 0x200) // IF
+			__asm__ __volatile__ ( "sti" ::: "memory" );
+	}
+
+private:
+	uint64_t m_flags;
+};
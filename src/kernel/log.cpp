@@ -2,11 +2,19 @@
 #include "kutil/memory.h"
 #include "kutil/no_construct.h"
 #include "console.h"
+#include "cpu.h"
 #include "log.h"
 #include "objects/system.h"
 #include "objects/thread.h"
 
-static uint8_t log_buffer[0x10000];
+/// The log buffer is split into this many per-CPU rings. CPUs past this
+/// many share rings.
+static constexpr unsigned log_rings = 8;
+
+alignas(64) static uint8_t log_buffer[0x10000];
+
+// Bounds of the log_sites section, from the linker script
+extern log::site __log_sites_start, __log_sites_end;
 
 // The logger is initialized _before_ global constructors are called,
 // so that we can start log output immediately. Keep its constructor
@@ -28,6 +36,12 @@ output_log(log::area_t area, log::level severity, const char *message)
 	cons->set_color();
 }
 
+static unsigned
+log_cpu()
+{
+	return current_cpu().index;
+}
+
 static void
 log_flush()
 {
@@ -40,7 +54,7 @@ logger_task()
 {
 	auto *cons = console::get();
 
-	log::info(logs::task, "Starting kernel logger task");
+	log_info(logs::task, "Starting kernel logger task");
 	g_logger.set_immediate(nullptr);
 	g_logger.set_flush(log_flush);
 
@@ -82,7 +96,17 @@ logger_task()
 
 void logger_init()
 {
-	new (&g_logger) log::logger(log_buffer, sizeof(log_buffer), output_log);
+	new (&g_logger) log::logger(log_buffer, sizeof(log_buffer), output_log, log_rings);
+	g_logger.set_sites(&__log_sites_start, &__log_sites_end);
+
+	// Kernel format strings are never unmapped, so messages can be
+	// stored unformatted and formatted by whoever reads the log
+	g_logger.set_binary(true);
+}
+
+void logger_init_cpus()
+{
+	g_logger.set_cpu(log_cpu);
 }
 
 void logger_clear_immediate()
@@ -6,5 +6,9 @@ namespace log = kutil::log;
 namespace logs = kutil::logs;
 
 void logger_init();
+
+/// Start writing to per-CPU log rings. Called once the BSP's cpu_data is
+/// in place, as the rings are picked with current_cpu().
+void logger_init_cpus();
 void logger_clear_immediate();
 void logger_task();
@@ -24,10 +24,12 @@
 #include "objects/vm_area.h"
 #include "scheduler.h"
 #include "serial.h"
+#include "swap.h"
 #include "symbol_table.h"
 #include "syscall.h"
 #include "tss.h"
 #include "vm_space.h"
+#include "zero_pool.h"
 
 #ifndef GIT_VERSION
 #define GIT_VERSION
@@ -50,6 +52,9 @@ using namespace kernel;
 volatile size_t ap_startup_count;
 static bool scheduler_ready = false;
 
+// Size of the RAM disk used as swap on debug boots with no swap partition
+constexpr size_t ram_swap_size = 16 * 1024 * 1024;
+
 /// Bootstrap the memory managers.
 void memory_initialize_pre_ctors(args::header &kargs);
 void memory_initialize_post_ctors(args::header &kargs);
@@ -92,17 +97,17 @@ kernel_main(args::header *header)
 
 	cpu_validate();
 
-	log::debug(logs::boot, "    jsix header is at: %016lx", header);
-	log::debug(logs::boot, "     Memory map is at: %016lx", header->mem_map);
-	log::debug(logs::boot, "ACPI root table is at: %016lx", header->acpi_table);
-	log::debug(logs::boot, "Runtime service is at: %016lx", header->runtime_services);
-	log::debug(logs::boot, "    Kernel PML4 is at: %016lx", header->pml4);
+	log_debug(logs::boot, "    jsix header is at: %016lx", header);
+	log_debug(logs::boot, "     Memory map is at: %016lx", header->mem_map);
+	log_debug(logs::boot, "ACPI root table is at: %016lx", header->acpi_table);
+	log_debug(logs::boot, "Runtime service is at: %016lx", header->runtime_services);
+	log_debug(logs::boot, "    Kernel PML4 is at: %016lx", header->pml4);
 
 	uint64_t cr0, cr4;
 	asm ("mov %%cr0, %0" : "=r"(cr0));
 	asm ("mov %%cr4, %0" : "=r"(cr4));
 	uint64_t efer = rdmsr(msr::ia32_efer);
-	log::debug(logs::boot, "Control regs: cr0:%lx cr4:%lx efer:%lx", cr0, cr4, efer);
+	log_debug(logs::boot, "Control regs: cr0:%lx cr4:%lx efer:%lx", cr0, cr4, efer);
 
 	bool has_video = false;
 	if (header->video.size > 0) {
@@ -110,7 +115,7 @@ kernel_main(args::header *header)
 		fb = &header->video;
 
 		const args::framebuffer &video = header->video;
-		log::debug(logs::boot, "Framebuffer: %dx%d[%d] type %d @ %llx size %llx",
+		log_debug(logs::boot, "Framebuffer: %dx%d[%d] type %d @ %llx size %llx",
 			video.horizontal,
 			video.vertical,
 			video.scanline,
@@ -136,6 +141,7 @@ kernel_main(args::header *header)
 	cpu->gdt = new (&g_bsp_gdt) GDT {cpu->tss};
 	cpu->rsp0 = idle_stack_end;
 	cpu_early_init(cpu);
+	logger_init_cpus();
 
 	disable_legacy_pic();
 
@@ -173,8 +179,10 @@ kernel_main(args::header *header)
 	cpu->apic = apic;
 
 	cpu_init(cpu, true);
+	cpu_online(cpu);
 
 	devices.init_drivers();
+	devices.init_serial();
 	apic->calibrate_timer();
 
 	const auto &apic_ids = devices.get_apic_ids();
@@ -203,7 +211,7 @@ kernel_main(args::header *header)
 			}
 		}
 	} else {
-		log::warn(logs::boot, "No block devices present.");
+		log_warn(logs::boot, "No block devices present.");
 	}
 	*/
 
@@ -217,6 +225,20 @@ kernel_main(args::header *header)
 	if (!has_video)
 		sched->create_kernel_task(logger_task, scheduler::max_priority/2, true);
 
+	sched->create_kernel_task(zero_pool::task, scheduler::max_priority, true);
+
+	// Debug boots without a swap partition swap to RAM instead, so that
+	// eviction and fault-back can still be exercised
+	page_reclaimer &reclaimer = page_reclaimer::get();
+	const uint16_t debug_flag = static_cast<uint16_t>(args::boot_flags::debug);
+	if (!reclaimer.has_swap() && (static_cast<uint16_t>(header->flags) & debug_flag)) {
+		log_info(logs::memory, "No swap partition, using a RAM disk stand-in");
+		reclaimer.add_ram_device(ram_swap_size);
+	}
+
+	if (reclaimer.has_swap())
+		sched->create_kernel_task(reclaimer_task, scheduler::max_priority/2, true);
+
 	sched->start();
 }
 
@@ -233,7 +255,7 @@ start_aps(lapic &apic, const kutil::vector<uint8_t> &ids, void *kpml4)
 	clock &clk = clock::get();
 
 	ap_startup_count = 1; // BSP processor
-	log::info(logs::boot, "Starting %d other CPUs", ids.count() - 1);
+	log_info(logs::boot, "Starting %d other CPUs", ids.count() - 1);
 
 	// Since we're using address space outside kernel space, make sure
 	// the kernel's vm_space is used
@@ -299,7 +321,7 @@ start_aps(lapic &apic, const kutil::vector<uint8_t> &ids, void *kpml4)
 
 		// Kick it off!
 		size_t current_count = ap_startup_count;
-		log::debug(logs::boot, "Starting AP %d: stack %llx", cpu->index, stack_end);
+		log_debug(logs::boot, "Starting AP %d: stack %llx", cpu->index, stack_end);
 
 		ipi startup = ipi::startup | ipi::assert;
 
@@ -310,8 +332,10 @@ start_aps(lapic &apic, const kutil::vector<uint8_t> &ids, void *kpml4)
 		}
 
 		// If the CPU already incremented ap_startup_count, it's done
-		if (ap_startup_count > current_count)
+		if (ap_startup_count > current_count) {
+			clk.check_tsc_bsp(cpu->index);
 			continue;
+		}
 
 		// Send the second SIPI (intel recommends this)
 		apic.send_ipi(startup, vector, id);
@@ -320,10 +344,15 @@ start_aps(lapic &apic, const kutil::vector<uint8_t> &ids, void *kpml4)
 			clk.spinwait(100);
 		}
 
-		log::warn(logs::boot, "No response from AP %d within timeout", id);
+		if (ap_startup_count > current_count) {
+			clk.check_tsc_bsp(cpu->index);
+			continue;
+		}
+
+		log_warn(logs::boot, "No response from AP %d within timeout", id);
 	}
 
-	log::info(logs::boot, "%d CPUs running", ap_startup_count);
+	log_info(logs::boot, "%d CPUs running", ap_startup_count);
 	vm_space::kernel_space().remove(vma);
 	return ap_startup_count;
 }
@@ -333,12 +362,14 @@ long_ap_startup(cpu_data *cpu)
 {
 	cpu_init(cpu, false);
 	++ap_startup_count;
+	clock::get().check_tsc_ap();
 	while (!scheduler_ready) asm ("pause");
 
 	uintptr_t apic_base =
 		device_manager::get().get_lapic_base();
 	cpu->apic = new lapic(apic_base);
 	cpu->apic->enable();
+	cpu_online(cpu);
 
 	scheduler::get().start();
 }
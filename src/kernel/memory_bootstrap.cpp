@@ -17,6 +17,7 @@
 #include "objects/thread.h"
 #include "objects/system.h"
 #include "objects/vm_area.h"
+#include "program_image.h"
 #include "vm_space.h"
 
 using memory::heap_start;
@@ -143,7 +144,7 @@ log_mtrrs()
 	uint64_t mtrrcap = rdmsr(msr::ia32_mtrrcap);
 	uint64_t mtrrdeftype = rdmsr(msr::ia32_mtrrdeftype);
 	unsigned vcap = mtrrcap & 0xff;
-	log::debug(logs::boot, "MTRRs: vcap=%d %s %s def=%02x %s %s",
+	log_debug(logs::boot, "MTRRs: vcap=%d %s %s def=%02x %s %s",
 		vcap,
 		(mtrrcap & (1<< 8)) ? "fix" : "",
 		(mtrrcap & (1<<10)) ? "wc" : "",
@@ -155,7 +156,7 @@ log_mtrrs()
 	for (unsigned i = 0; i < vcap; ++i) {
 		uint64_t base = rdmsr(find_mtrr(msr::ia32_mtrrphysbase, i));
 		uint64_t mask = rdmsr(find_mtrr(msr::ia32_mtrrphysmask, i));
-		log::debug(logs::boot, "       vcap[%2d] base:%016llx mask:%016llx type:%02x %s", i,
+		log_debug(logs::boot, "       vcap[%2d] base:%016llx mask:%016llx type:%02x %s", i,
 			(base & ~0xfffull),
 			(mask & ~0xfffull),
 			(base & 0xff),
@@ -178,14 +179,14 @@ log_mtrrs()
 
 	for (int i = 0; i < 11; ++i) {
 		uint64_t v = rdmsr(mtrr_fixed[i]);
-		log::debug(logs::boot, "      fixed[%2d] %02x %02x %02x %02x %02x %02x %02x %02x", i,
+		log_debug(logs::boot, "      fixed[%2d] %02x %02x %02x %02x %02x %02x %02x %02x", i,
 			((v <<  0) & 0xff), ((v <<  8) & 0xff), ((v << 16) & 0xff), ((v << 24) & 0xff),
 			((v << 32) & 0xff), ((v << 40) & 0xff), ((v << 48) & 0xff), ((v << 56) & 0xff));
 	}
 
 	uint64_t pat = rdmsr(msr::ia32_pat);
 	static const char *pat_names[] = {"UC ","WC ","XX ","XX ","WT ","WP ","WB ","UC-"};
-	log::debug(logs::boot, "      PAT: 0:%s 1:%s 2:%s 3:%s 4:%s 5:%s 6:%s 7:%s",
+	log_debug(logs::boot, "      PAT: 0:%s 1:%s 2:%s 3:%s 4:%s 5:%s 6:%s 7:%s",
 		pat_names[(pat >> (0*8)) & 7], pat_names[(pat >> (1*8)) & 7],
 		pat_names[(pat >> (2*8)) & 7], pat_names[(pat >> (3*8)) & 7],
 		pat_names[(pat >> (4*8)) & 7], pat_names[(pat >> (5*8)) & 7],
@@ -196,25 +197,16 @@ log_mtrrs()
 process *
 load_simple_process(args::program &program)
 {
-	using kernel::args::section_flags;
+	program_image &image = program_image::get(program);
 
 	process *p = new process;
-	vm_space &space = p->space();
-
-	for (const auto &sect : program.sections) {
-		vm_flags flags =
-			(bitfield_has(sect.type, section_flags::execute) ? vm_flags::exec : vm_flags::none) |
-			(bitfield_has(sect.type, section_flags::write) ? vm_flags::write : vm_flags::none);
-
-		vm_area *vma = new vm_area_fixed(sect.phys_addr, sect.size, flags);
-		space.add(sect.virt_addr, vma);
-	}
+	image.map_into(p->space());
 
 	uint64_t iopl = (3ull << 12);
 	uintptr_t trampoline = reinterpret_cast<uintptr_t>(initialize_main_thread);
 
 	thread *main = p->create_thread();
-	main->add_thunk_user(program.entrypoint, trampoline, iopl);
+	main->add_thunk_user(image.entrypoint(), trampoline, iopl);
 	main->set_state(thread::state::ready);
 
 	return p;
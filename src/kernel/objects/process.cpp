@@ -1,5 +1,7 @@
+#include "j6/time.h"
 #include "kutil/assert.h"
 #include "kutil/no_construct.h"
+#include "clock.h"
 #include "cpu.h"
 #include "objects/process.h"
 #include "objects/thread.h"
@@ -20,6 +22,9 @@ process::process() :
 {
 	j6_handle_t self = add_handle(this);
 	kassert(self == self_handle(), "Process self-handle is not 1");
+
+	if (clock::ready())
+		m_space.add(j6_time_page_addr, clock::get().time_page_area());
 }
 
 // The "kernel process"-only constructor
@@ -95,11 +100,14 @@ process::create_thread(uint8_t priority, bool user)
 	kassert(th, "Failed to create thread!");
 
 	if (user) {
-		uintptr_t stack_top = stacks_top - (m_threads.count() * stack_size);
-
+		// Stacks of exited threads aren't unmapped yet, so skip past any
+		// slot that's still in use rather than sharing it
 		vm_flags flags = vm_flags::zero|vm_flags::write;
 		vm_area *vma = new vm_area_open(stack_size, flags);
-		m_space.add(stack_top - stack_size, vma);
+
+		uintptr_t stack_top = stacks_top - (m_threads.count() * stack_size);
+		while (!m_space.add(stack_top - stack_size, vma))
+			stack_top -= stack_size;
 
 		// Space for null frame - because the page gets zeroed on
 		// allocation, just pointing rsp here does the trick
@@ -2,6 +2,7 @@
 /// \file process.h
 /// Definition of process kobject types
 
+#include "j6/init.h"
 #include "kutil/map.h"
 #include "kutil/vector.h"
 #include "objects/kobject.h"
@@ -13,10 +14,10 @@ class process :
 {
 public:
 	/// Top of memory area where thread stacks are allocated
-	constexpr static uintptr_t stacks_top = 0x0000800000000000;
+	constexpr static uintptr_t stacks_top = j6_thread_stacks_top;
 
 	/// Size of userspace thread stacks
-	constexpr static size_t stack_size = 0x4000000; // 64MiB
+	constexpr static size_t stack_size = j6_thread_stack_size; // 64MiB
 
 	/// Value that represents default priority
 	constexpr static uint8_t default_priority = 0xff;
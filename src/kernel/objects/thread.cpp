@@ -1,5 +1,6 @@
 #include "j6/signals.h"
 #include "cpu.h"
+#include "futex.h"
 #include "log.h"
 #include "objects/thread.h"
 #include "objects/process.h"
@@ -24,8 +25,10 @@ thread::thread(process &parent, uint8_t pri, uintptr_t rsp0) :
 
 	if (!rsp0)
 		setup_kernel_stack();
-	else
+	else {
 		m_tcb.rsp0 = rsp0;
+		m_tcb.fpu = 0;
+	}
 
 	m_self_handle = parent.add_handle(this);
 }
@@ -77,6 +80,17 @@ thread::wait_on_object(kobject *o)
 	schedule_if_current(this);
 }
 
+void
+thread::wait_on_futex(kutil::spinlock &lock, kutil::spinlock::waiter *waiter, size_t bucket)
+{
+	m_wait_type = wait_type::futex;
+	m_wait_data = bucket;
+	clear_state(state::ready);
+	lock.release(waiter);
+
+	schedule_if_current(this);
+}
+
 bool
 thread::wake_on_signals(kobject *obj, j6_signal_t signals)
 {
@@ -121,6 +135,19 @@ thread::wake_on_object(kobject *o)
 	return true;
 }
 
+bool
+thread::wake_on_futex()
+{
+	if (m_wait_type != wait_type::futex)
+		return false;
+
+	m_wait_type = wait_type::none;
+	m_wait_result = j6_status_ok;
+	m_wait_obj = 0;
+	set_state(state::ready);
+	return true;
+}
+
 void
 thread::wake_on_result(kobject *obj, j6_status_t result)
 {
@@ -135,6 +162,9 @@ void
 thread::exit(int32_t code)
 {
 	m_return_code = code;
+	if (m_wait_type == wait_type::futex)
+		futex_table::get().cancel(this);
+
 	set_state(state::exited);
 	clear_state(state::ready);
 	close();
@@ -203,14 +233,20 @@ thread::setup_kernel_stack()
 	uintptr_t stack_addr = g_kernel_stacks.get_section();
 	uintptr_t stack_end = stack_addr + stack_bytes;
 
-	uint64_t *null_frame = reinterpret_cast<uint64_t*>(stack_end - null_frame_size);
+	// The FPU state save area lives at the top of the kernel stack, where
+	// it's 64-byte aligned for xsave
+	uintptr_t fpu = stack_end - fpu_state_size();
+	fpu_init_state(reinterpret_cast<void*>(fpu));
+
+	uint64_t *null_frame = reinterpret_cast<uint64_t*>(fpu - null_frame_size);
 	for (unsigned i = 0; i < null_frame_entries; ++i)
 		null_frame[i] = 0;
 
-	log::debug(logs::memory, "Created kernel stack at %016lx size 0x%lx",
+	log_debug(logs::memory, "Created kernel stack at %016lx size 0x%lx",
 			stack_addr, stack_bytes);
 
 	m_tcb.kernel_stack = stack_addr;
+	m_tcb.fpu = fpu;
 	m_tcb.rsp0 = reinterpret_cast<uintptr_t>(null_frame);
 	m_tcb.rsp = m_tcb.rsp0;
 }
@@ -3,6 +3,7 @@
 /// Definition of thread kobject types
 
 #include "kutil/linked_list.h"
+#include "kutil/spinlock.h"
 #include "objects/kobject.h"
 
 struct page_table;
@@ -17,6 +18,10 @@ struct TCB
 	uintptr_t rsp3;
 	uintptr_t pml4;
 
+	// FPU/SSE/AVX state save area, or 0 for threads that never run
+	// user code and don't need one
+	uintptr_t fpu;
+
 	uint8_t priority;
 	// note: 3 bytes padding
 
@@ -35,7 +40,7 @@ class thread :
 	public kobject
 {
 public:
-	enum class wait_type : uint8_t { none, signal, time, object };
+	enum class wait_type : uint8_t { none, signal, time, object, futex };
 	enum class state : uint8_t {
 		ready    = 0x01,
 		loading  = 0x02,
@@ -80,13 +85,21 @@ public:
 	void wait_on_signals(kobject *obj, j6_signal_t signals);
 
 	/// Block the thread, waiting for a given clock value
-	/// \arg t  Clock value to wait for
+	/// \arg t  Clock value to wait for, in us
 	void wait_on_time(uint64_t t);
 
 	/// Block the thread, waiting on the given object
 	/// \arg o  The ojbect that should wake this thread
 	void wait_on_object(kobject *o);
 
+	/// Block the thread on a futex wait queue. The thread is marked as
+	/// blocked before the queue's lock is released, so a wake from another
+	/// CPU in between isn't lost.
+	/// \arg lock    The wait queue lock, held by the caller and released here
+	/// \arg waiter  The caller's waiter for lock
+	/// \arg bucket  The futex table bucket of the wait queue
+	void wait_on_futex(kutil::spinlock &lock, kutil::spinlock::waiter *waiter, size_t bucket);
+
 	/// Wake the thread if it is waiting on signals.
 	/// \arg obj     Object that changed signals
 	/// \arg signals Signal state of the object
@@ -103,6 +116,11 @@ public:
 	/// \returns  True if this action unblocked the thread
 	bool wake_on_object(kobject *o);
 
+	/// Wake the thread if it is blocked on a futex. Must be called with
+	/// the futex wait queue's lock held.
+	/// \returns  True if this action unblocked the thread
+	bool wake_on_futex();
+
 	/// Wake the thread with a given result code.
 	/// \arg obj     Object that changed signals
 	/// \arg result  Result code to return to the thread
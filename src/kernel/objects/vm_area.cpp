@@ -1,11 +1,32 @@
+#include "kutil/memory.h"
 #include "frame_allocator.h"
 #include "kernel_memory.h"
 #include "objects/vm_area.h"
 #include "page_tree.h"
+#include "swap.h"
 #include "vm_space.h"
+#include "zero_pool.h"
 
 using memory::frame_size;
 
+// Allocate a run of frames for an area. Zero-fill areas take frames
+// already zeroed from the zero pool when it has any.
+static size_t
+allocate_frames(vm_flags flags, size_t count, uintptr_t &phys)
+{
+	bool zero = flags && vm_flags::zero;
+	if (zero) {
+		size_t n = zero_pool::get().take(count, phys);
+		if (n)
+			return n;
+	}
+
+	size_t n = frame_allocator::get().allocate(count, &phys);
+	if (n && zero)
+		kutil::memset(memory::to_virtual<void>(phys), 0, n * frame_size);
+	return n;
+}
+
 vm_area::vm_area(size_t size, vm_flags flags) :
 	m_size {size},
 	m_flags {flags},
@@ -51,6 +72,18 @@ vm_area::resize(size_t size)
 	return m_size;
 }
 
+size_t
+vm_area::get_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	return get_page(offset, phys) ? 1 : 0;
+}
+
+size_t
+vm_area::find_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	return 0;
+}
+
 bool
 vm_area::can_resize(size_t size)
 {
@@ -83,6 +116,23 @@ bool vm_area_fixed::get_page(uintptr_t offset, uintptr_t &phys)
 	return true;
 }
 
+size_t
+vm_area_fixed::get_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	return find_pages(offset, count, phys);
+}
+
+size_t
+vm_area_fixed::find_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	if (offset >= m_size)
+		return 0;
+
+	size_t pages = memory::page_count(m_size - offset);
+	phys = m_start + offset;
+	return count < pages ? count : pages;
+}
+
 
 vm_area_untracked::vm_area_untracked(size_t size, vm_flags flags) :
 	vm_area {size, flags}
@@ -97,7 +147,7 @@ vm_area_untracked::get_page(uintptr_t offset, uintptr_t &phys)
 	if (offset > m_size)
 		return false;
 
-	return frame_allocator::get().allocate(1, &phys);
+	return allocate_frames(m_flags, 1, phys) > 0;
 }
 
 bool
@@ -109,18 +159,566 @@ vm_area_untracked::add_to(vm_space *space)
 }
 
 
+// Evicted pages are keyed by page index. The high bit keeps page 0 from
+// looking like an empty slot.
+static constexpr uint64_t page_key_bit = 1ull << 63;
+static inline uint64_t page_key(uintptr_t offset) { return (offset >> 12) | page_key_bit; }
+
 vm_area_open::vm_area_open(size_t size, vm_flags flags) :
 	m_mapped {nullptr},
+	m_evicting {false},
+	m_evict_offset {0},
+	m_evict_phys {0},
+	m_hand {0},
 	vm_area {size, flags}
 {
+	page_reclaimer::get().track(this);
+}
+
+vm_area_open::~vm_area_open()
+{
+	drop_swapped(0, memory::page_align_up(m_size) / frame_size);
+	page_tree::clear(m_mapped, true);
+}
+
+void
+vm_area_open::on_no_handles()
+{
+	// If the reclaimer is in the middle of scanning this area, it deletes
+	// the area itself once it's done
+	if (page_reclaimer::get().untrack(this))
+		vm_area::on_no_handles();
+	else
+		kobject::on_no_handles();
+}
+
+bool
+vm_area_open::remove_from(vm_space *space)
+{
+	vm_area::remove_from(space);
+	return false;
+}
+
+size_t
+vm_area_open::resize(size_t size)
+{
+	size_t old_pages = memory::page_align_up(m_size) / frame_size;
+	if (vm_area::resize(size) != size)
+		return m_size;
+
+	size_t new_pages = memory::page_align_up(size) / frame_size;
+	if (new_pages < old_pages) {
+		size_t count = old_pages - new_pages;
+		uintptr_t offset = new_pages * frame_size;
+		for (auto *space : m_spaces)
+			space->clear(*this, offset, count);
+		release(offset, count);
+	}
+
+	return m_size;
 }
 
-vm_area_open::~vm_area_open() {}
+size_t
+vm_area_open::add_pages(uintptr_t offset, uintptr_t phys, size_t count)
+{
+	kutil::scoped_lock lock {m_lock};
+	return page_tree::add_run(m_mapped, offset, phys, count);
+}
+
+void
+vm_area_open::release(uintptr_t offset, size_t count)
+{
+	kutil::scoped_lock lock {m_lock};
+	drop_swapped(offset, count);
+	page_tree::remove(m_mapped, offset, count, true);
+}
 
 bool
 vm_area_open::get_page(uintptr_t offset, uintptr_t &phys)
 {
-	return page_tree::find_or_add(m_mapped, offset, phys);
+	return get_pages(offset, 1, phys) > 0;
+}
+
+size_t
+vm_area_open::get_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	if (offset >= m_size)
+		return 0;
+
+	size_t pages = memory::page_count(m_size - offset);
+	if (count > pages)
+		count = pages;
+
+	kutil::scoped_lock lock {m_lock};
+
+	size_t n = page_tree::find_run(m_mapped, offset, count, phys);
+	if (n)
+		return n;
+
+	if (m_evicting || m_swapped.count()) {
+		if (take_evicting(offset, phys))
+			return 1;
+
+		// Evicted pages need I/O to read back in, which can't be done
+		// with locks held. The caller must use load_page() first.
+		if (m_swapped.find(page_key(offset)))
+			return 0;
+
+		count = unswapped_run(offset, count);
+	}
+
+	// Nothing is at this offset yet, so allocate a run of frames and
+	// insert as many as fit before the next existing page.
+	n = allocate_frames(m_flags, count, phys);
+	if (!n)
+		return 0;
+
+	size_t added = page_tree::add_run(m_mapped, offset, phys, n);
+	if (added < n)
+		frame_allocator::get().free(phys + added * frame_size, n - added);
+
+	return added;
+}
+
+size_t
+vm_area_open::find_pages(uintptr_t offset, size_t count, uintptr_t &phys)
+{
+	kutil::scoped_lock lock {m_lock};
+	return page_tree::find_run(m_mapped, offset, count, phys);
+}
+
+static bool
+page_is_zero(uintptr_t phys)
+{
+	const uint64_t *p = memory::to_virtual<uint64_t>(phys);
+	for (size_t i = 0; i < frame_size / sizeof(uint64_t); ++i)
+		if (p[i]) return false;
+	return true;
+}
+
+size_t
+vm_area_open::unswapped_run(uintptr_t offset, size_t count)
+{
+	for (size_t i = 1; i < count; ++i) {
+		uintptr_t off = offset + i * frame_size;
+		if ((m_evicting && m_evict_offset == off) ||
+			m_swapped.find(page_key(off)))
+			return i;
+	}
+	return count;
+}
+
+bool
+vm_area_open::take_evicting(uintptr_t offset, uintptr_t &phys)
+{
+	if (!m_evicting || m_evict_offset != offset)
+		return false;
+
+	// The page is still being written out, so just take it back
+	m_evicting = false;
+	phys = m_evict_phys;
+	page_tree::add_run(m_mapped, offset, phys, 1);
+	return true;
+}
+
+bool
+vm_area_open::is_evicted(uintptr_t offset)
+{
+	kutil::scoped_lock lock {m_lock};
+	return m_swapped.find(page_key(offset)) != nullptr;
+}
+
+bool
+vm_area_open::load_page(uintptr_t offset)
+{
+	uint64_t slot = 0;
+	{
+		kutil::scoped_lock lock {m_lock};
+		uint64_t *entry = m_swapped.find(page_key(offset));
+
+		// Nothing to do if the page isn't evicted, or another thread is
+		// already reading it in
+		if (!entry || (*entry & slot_loading))
+			return true;
+
+		slot = *entry;
+		*entry |= slot_loading;
+	}
+
+	frame_allocator &fa = frame_allocator::get();
+	page_reclaimer &reclaimer = page_reclaimer::get();
+
+	uintptr_t phys = 0;
+	bool got = fa.allocate(1, &phys) > 0;
+	bool read = got && reclaimer.read_page(slot, phys);
+
+	kutil::scoped_lock lock {m_lock};
+	uint64_t *entry = m_swapped.find(page_key(offset));
+	if (!entry || *entry != (slot | slot_loading)) {
+		// The page was released while it was being read, and
+		// drop_swapped() already freed the slot
+		if (got) fa.free(phys, 1);
+		return true;
+	}
+
+	if (!read) {
+		*entry = slot;
+		if (got) fa.free(phys, 1);
+		return false;
+	}
+
+	m_swapped.erase(page_key(offset));
+	reclaimer.free_slot(slot);
+	page_tree::add_run(m_mapped, offset, phys, 1);
+	return true;
+}
+
+bool
+vm_area_open::load_all()
+{
+	kutil::vector<uintptr_t> offsets;
+	{
+		kutil::scoped_lock lock {m_lock};
+		for (auto &n : m_swapped)
+			offsets.append((n.key & ~page_key_bit) * frame_size);
+	}
+
+	for (uintptr_t offset : offsets)
+		if (!load_page(offset))
+			return false;
+
+	return true;
+}
+
+void
+vm_area_open::drop_swapped(uintptr_t offset, size_t count)
+{
+	uintptr_t end = offset + count * frame_size;
+
+	if (m_evicting && m_evict_offset >= offset && m_evict_offset < end) {
+		// evict() sees m_evicting cleared and leaves the frame alone
+		frame_allocator::get().free(m_evict_phys, 1);
+		m_evicting = false;
+	}
+
+	if (!m_swapped.count())
+		return;
+
+	page_reclaimer &reclaimer = page_reclaimer::get();
+	kutil::vector<uint64_t> dropped;
+	for (auto &n : m_swapped) {
+		uintptr_t off = (n.key & ~page_key_bit) * frame_size;
+		if (off < offset || off >= end)
+			continue;
+
+		reclaimer.free_slot(n.val & ~slot_loading);
+		dropped.append(n.key);
+	}
+
+	for (uint64_t key : dropped)
+		m_swapped.erase(key);
+}
+
+size_t
+vm_area_open::reclaim(size_t count, size_t scan)
+{
+	constexpr size_t max_scan = page_reclaimer::scan_batch;
+	if (scan > max_scan)
+		scan = max_scan;
+
+	uintptr_t offsets[max_scan];
+	uintptr_t pages[max_scan];
+	size_t found = 0;
+
+	{
+		kutil::scoped_lock lock {m_lock};
+		page_tree::iterator it {m_mapped, m_hand};
+		if (!it.valid())
+			it = page_tree::iterator {m_mapped};
+
+		for (size_t i = 0; it.valid() && i < scan; ++i, ++it) {
+			// Shared pages belong to more than one area
+			if (is_shared(it.page()))
+				continue;
+
+			offsets[found] = it.offset();
+			pages[found] = it.page();
+			++found;
+		}
+
+		m_hand = it.valid() ? it.offset() : 0;
+	}
+
+	return clock_sweep(offsets, pages, found, count, m_hand,
+		[this](uintptr_t offset) { return referenced(offset); },
+		[this](uintptr_t offset, uintptr_t phys) { return evict(offset, phys); });
+}
+
+bool
+vm_area_open::referenced(uintptr_t offset)
+{
+	bool accessed = false;
+	for (auto *space : m_spaces)
+		accessed |= space->clear_accessed(*this, offset);
+	return accessed;
+}
+
+bool
+vm_area_open::evict(uintptr_t offset, uintptr_t phys)
+{
+	{
+		kutil::scoped_lock lock {m_lock};
+
+		uintptr_t current = 0;
+		if (!page_tree::find(m_mapped, offset, current) ||
+			current != phys || is_shared(phys))
+			return false;
+
+		page_tree::remove(m_mapped, offset, 1, false);
+		m_evicting = true;
+		m_evict_offset = offset;
+		m_evict_phys = phys;
+	}
+
+	// From here on, a fault on this page takes it back via take_evicting().
+	// Clearing the mappings also shoots down other CPUs' TLB entries for
+	// the page, so nothing can still be writing to it below.
+	for (auto *space : m_spaces)
+		space->clear(*this, offset, 1);
+
+	// Pages of zero-fill areas that are still all zero need not be
+	// written out, as faulting them back in zeroes a new page anyway
+	bool zero = (m_flags && vm_flags::zero) && page_is_zero(phys);
+
+	page_reclaimer &reclaimer = page_reclaimer::get();
+	uint64_t slot = 0;
+	bool have_slot = !zero && reclaimer.allocate_slot(slot);
+	bool written = have_slot && reclaimer.write_page(slot, phys);
+
+	kutil::scoped_lock lock {m_lock};
+	if (!m_evicting) {
+		// The page was faulted back in or released while being written
+		if (have_slot)
+			reclaimer.free_slot(slot);
+		return false;
+	}
+
+	m_evicting = false;
+	if (!zero && !written) {
+		if (have_slot)
+			reclaimer.free_slot(slot);
+		page_tree::add_run(m_mapped, offset, phys, 1);
+		return false;
+	}
+
+	if (!zero)
+		m_swapped.insert(page_key(offset), slot);
+
+	frame_allocator::get().free(phys, 1);
+	return true;
+}
+
+
+kutil::map<uint64_t, uint32_t> vm_area_cow::s_refs;
+kutil::spinlock vm_area_cow::s_lock;
+
+// Shared frames are keyed by frame number, which spreads them well over
+// the map's identity hash. The high bit keeps frame 0 from looking like
+// an empty slot.
+static inline uint64_t frame_key(uintptr_t phys) { return (phys >> 12) | (1ull << 63); }
+
+vm_area_cow::vm_area_cow(size_t size, vm_flags flags) :
+	m_shared {false},
+	vm_area_open {size, flags | vm_flags::cow}
+{
+}
+
+vm_area_cow::~vm_area_cow()
+{
+	release(0, memory::page_align_up(m_size) / frame_size);
+	page_tree::clear(m_mapped, false);
+}
+
+vm_area_cow *
+vm_area_cow::clone()
+{
+	vm_area_cow *copy = new vm_area_cow {m_size, m_flags};
+
+	while (true) {
+		// Evicted pages can't be shared, so bring them back first. That's
+		// I/O, so it's done before taking the locks.
+		bool loaded = load_all();
+		kassert(loaded, "Failed to read a page back in from swap");
+
+		kutil::scoped_lock lock {m_lock};
+
+		// Pages evicted again while unlocked mean trying again
+		if (m_swapped.count())
+			continue;
+
+		kutil::scoped_lock copy_lock {copy->m_lock};
+
+		uintptr_t phys = 0;
+		if (m_evicting)
+			take_evicting(m_evict_offset, phys);
+
+		copy->m_shared = true;
+		m_shared = true;
+
+		// Share the pages a run at a time
+		uintptr_t run_off = 0;
+		uintptr_t run_phys = 0;
+		size_t run_count = 0;
+
+		for (page_tree::iterator it {m_mapped}; it.valid(); ++it) {
+			if (run_count &&
+				it.offset() == run_off + run_count * frame_size &&
+				it.page() == run_phys + run_count * frame_size) {
+				++run_count;
+				continue;
+			}
+
+			if (run_count) {
+				share_frames(run_phys, run_count);
+				page_tree::add_run(copy->m_mapped, run_off, run_phys, run_count);
+			}
+
+			run_off = it.offset();
+			run_phys = it.page();
+			run_count = 1;
+		}
+
+		if (run_count) {
+			share_frames(run_phys, run_count);
+			page_tree::add_run(copy->m_mapped, run_off, run_phys, run_count);
+		}
+
+		break;
+	}
+
+	// Spaces lock before areas, so protect the mappings after unlocking
+	size_t pages = memory::page_align_up(m_size) / frame_size;
+	for (auto *space : m_spaces)
+		space->write_protect(*this, 0, pages);
+
+	return copy;
+}
+
+bool
+vm_area_cow::is_shared(uintptr_t phys) const
+{
+	if (!m_shared)
+		return false;
+
+	kutil::scoped_lock lock {s_lock};
+	return s_refs.find(frame_key(phys)) != nullptr;
+}
+
+bool
+vm_area_cow::unshare_page(uintptr_t offset)
+{
+	{
+		kutil::scoped_lock lock {m_lock};
+
+		uintptr_t old = 0;
+		if (!page_tree::find(m_mapped, offset, old) && !take_evicting(offset, old))
+			return false;
+
+		kutil::scoped_lock refs_lock {s_lock};
+		uint32_t *refs = s_refs.find(frame_key(old));
+		if (refs) {
+			uintptr_t page = 0;
+			if (!frame_allocator::get().allocate(1, &page))
+				return false;
+
+			kutil::memcpy(
+				memory::to_virtual<void>(page),
+				memory::to_virtual<void>(old),
+				frame_size);
+
+			page_tree::remove(m_mapped, offset, 1, false);
+			page_tree::add_run(m_mapped, offset, page, 1);
+
+			if (--*refs == 1)
+				s_refs.erase(frame_key(old));
+		}
+
+		// With no refs left, every other area has already copied this
+		// page, but it may still be mapped read-only
+	}
+
+	// Every space mapping this area must stop using the shared frame, or
+	// it would read the writes of whichever area ends up owning it. They
+	// fault the private copy back in, writable.
+	for (auto *space : m_spaces)
+		space->clear(*this, offset, 1);
+
+	return true;
+}
+
+void
+vm_area_cow::release(uintptr_t offset, size_t count)
+{
+	if (!m_shared) {
+		vm_area_open::release(offset, count);
+		return;
+	}
+
+	kutil::scoped_lock lock {m_lock};
+	drop_swapped(offset, count);
+
+	frame_allocator &fa = frame_allocator::get();
+	uintptr_t end = offset + count * frame_size;
+	uintptr_t free_start = 0;
+	size_t free_count = 0;
+
+	for (page_tree::iterator it {m_mapped, offset}; it.valid() && it.offset() < end; ++it) {
+		uintptr_t phys = it.page();
+		if (!release_frame(phys))
+			continue;
+
+		if (free_count && phys == free_start + free_count * frame_size) {
+			++free_count;
+		} else {
+			if (free_count)
+				fa.free(free_start, free_count);
+			free_start = phys;
+			free_count = 1;
+		}
+	}
+
+	if (free_count)
+		fa.free(free_start, free_count);
+
+	page_tree::remove(m_mapped, offset, count, false);
+}
+
+void
+vm_area_cow::share_frames(uintptr_t phys, size_t count)
+{
+	kutil::scoped_lock lock {s_lock};
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t key = frame_key(phys + i * frame_size);
+		uint32_t *refs = s_refs.find(key);
+		if (refs)
+			++*refs;
+		else
+			s_refs.insert(key, 2);
+	}
+}
+
+bool
+vm_area_cow::release_frame(uintptr_t phys)
+{
+	kutil::scoped_lock lock {s_lock};
+	uint64_t key = frame_key(phys);
+	uint32_t *refs = s_refs.find(key);
+	if (!refs)
+		return true;
+
+	if (--*refs == 1)
+		s_refs.erase(key);
+	return false;
 }
 
 
@@ -7,6 +7,8 @@
 
 #include "j6/signals.h"
 #include "kutil/enum_bitfields.h"
+#include "kutil/map.h"
+#include "kutil/spinlock.h"
 #include "kutil/vector.h"
 
 #include "kernel_memory.h"
@@ -69,6 +71,54 @@ public:
 	/// \returns    True if there should be a page at the given offset
 	virtual bool get_page(uintptr_t offset, uintptr_t &phys) = 0;
 
+	/// Get a run of physically contiguous pages starting at the given
+	/// offset, allocating them if necessary. May return fewer pages than
+	/// requested.
+	/// \arg offset The offset into the VMA of the first page
+	/// \arg count  The maximum number of pages to get
+	/// \arg phys   [out] Receives the physical address of the first page
+	/// \returns    The number of pages in the run, or 0 if there should be
+	///             no page at the given offset
+	virtual size_t get_pages(uintptr_t offset, size_t count, uintptr_t &phys);
+
+	/// Get a run of physically contiguous pages that already exist in this
+	/// area, starting at the given offset. Never allocates.
+	/// \arg offset The offset into the VMA of the first page
+	/// \arg count  The maximum number of pages to get
+	/// \arg phys   [out] Receives the physical address of the first page
+	/// \returns    The number of pages in the run
+	virtual size_t find_pages(uintptr_t offset, size_t count, uintptr_t &phys);
+
+	/// Check if faults in this area should allocate pages ahead of a
+	/// sequential access pattern.
+	virtual bool can_fault_ahead() const { return false; }
+
+	/// Make sure the page at an offset is not evicted, reading it back in
+	/// from swap if it was. This may do I/O, so must be called with no
+	/// spinlocks held.
+	/// \arg offset The offset into the VMA of the page
+	/// \returns    False if an evicted page could not be read back in
+	virtual bool load_page(uintptr_t offset) { return true; }
+
+	/// Check if the page at an offset is evicted, or being read back in.
+	/// Such pages must be brought back with load_page() before they can
+	/// be mapped.
+	/// \arg offset The offset into the VMA of the page
+	virtual bool is_evicted(uintptr_t offset) { return false; }
+
+	/// Check if a page of this area is shared copy-on-write, and so must
+	/// be mapped read-only.
+	/// \arg phys  The physical address of the page
+	virtual bool is_shared(uintptr_t phys) const { return false; }
+
+	/// Give this area a private, writable copy of a page that is shared
+	/// copy-on-write. The page's read-only mappings are cleared in every
+	/// space the area is mapped into, and are faulted back in to the copy.
+	/// This shoots down TLBs, so must be called with no spinlocks held.
+	/// \arg offset The offset into the VMA of the page
+	/// \returns    True if the page may now be mapped writable
+	virtual bool unshare_page(uintptr_t offset) { return false; }
+
 protected:
 	virtual void on_no_handles() override;
 	bool can_resize(size_t size);
@@ -99,13 +149,16 @@ public:
 
 	virtual size_t resize(size_t size) override;
 	virtual bool get_page(uintptr_t offset, uintptr_t &phys) override;
+	virtual size_t get_pages(uintptr_t offset, size_t count, uintptr_t &phys) override;
+	virtual size_t find_pages(uintptr_t offset, size_t count, uintptr_t &phys) override;
 
 private:
 	uintptr_t m_start;
 };
 
 
-/// Area that allows open allocation
+/// Area that allows open allocation. Pages of open areas may be evicted
+/// to swap when memory runs low, and are read back in when next faulted.
 class vm_area_open :
 	public vm_area
 {
@@ -116,10 +169,135 @@ public:
 	vm_area_open(size_t size, vm_flags flags);
 	virtual ~vm_area_open();
 
+	/// Pages of an open area belong to its page tree, not to the spaces
+	/// it is mapped into, so spaces never free them on removal.
+	virtual bool remove_from(vm_space *space) override;
+
+	virtual size_t resize(size_t size) override;
 	virtual bool get_page(uintptr_t offset, uintptr_t &phys) override;
+	virtual size_t get_pages(uintptr_t offset, size_t count, uintptr_t &phys) override;
+	virtual size_t find_pages(uintptr_t offset, size_t count, uintptr_t &phys) override;
+	virtual bool can_fault_ahead() const override { return true; }
+	virtual bool load_page(uintptr_t offset) override;
+	virtual bool is_evicted(uintptr_t offset) override;
+
+	/// Take ownership of already-allocated physical pages as pages of
+	/// this area. Pages already in the area are not replaced.
+	/// \arg offset The offset into the VMA of the first page
+	/// \arg phys   The physical address of the first page
+	/// \arg count  The number of contiguous pages to add
+	/// \returns    The number of pages added
+	size_t add_pages(uintptr_t offset, uintptr_t phys, size_t count);
+
+	/// Continue this area's page aging scan, evicting pages to swap that
+	/// have not been accessed since the scan last passed them.
+	/// \arg count  The maximum number of pages to evict
+	/// \arg scan   The maximum number of pages to examine
+	/// \returns    The number of pages evicted
+	size_t reclaim(size_t count, size_t scan);
+
+protected:
+	virtual void on_no_handles() override;
+
+	/// Remove a range of pages from this area and release their frames
+	/// \arg offset The offset into the VMA of the first page
+	/// \arg count  The number of pages to remove
+	virtual void release(uintptr_t offset, size_t count);
+
+	/// Take back the page being written out by evict(), if it's the page
+	/// at this offset. Must be called with m_lock held.
+	/// \arg offset The offset into the VMA of the page
+	/// \arg phys   [out] Receives the physical address of the page
+	/// \returns    False if the page at offset is not being evicted
+	bool take_evicting(uintptr_t offset, uintptr_t &phys);
+
+	/// Forget any evicted pages in a range, freeing their swap slots.
+	/// Must be called with m_lock held.
+	/// \arg offset The offset into the VMA of the first page
+	/// \arg count  The number of pages in the range
+	void drop_swapped(uintptr_t offset, size_t count);
+
+	/// Read every evicted page back into the page tree. Must be called
+	/// with no spinlocks held.
+	/// \returns  False if an evicted page could not be read back in
+	bool load_all();
 
-private:
 	page_tree *m_mapped;
+
+	/// Swap slots of evicted pages, keyed by page index. Slots of pages
+	/// being read back in by load_page() have slot_loading set.
+	kutil::map<uint64_t, uint64_t> m_swapped;
+	static constexpr uint64_t slot_loading = 1ull << 63;
+
+	/// The page currently being written out by evict(). Faulting the page
+	/// back in or releasing it clears m_evicting.
+	bool m_evicting;
+	uintptr_t m_evict_offset;
+	uintptr_t m_evict_phys;
+
+	/// Protects m_mapped, m_swapped, and the page being evicted
+	kutil::spinlock m_lock;
+
+private:
+	/// Check and clear the accessed bit of a page in every space
+	/// \returns  True if the page was accessed in any space
+	bool referenced(uintptr_t offset);
+
+	/// Evict a page to swap
+	/// \arg offset The offset into the VMA of the page
+	/// \arg phys   The physical address the page was found at
+	/// \returns    True if the page's frame was freed
+	bool evict(uintptr_t offset, uintptr_t phys);
+
+	/// Get how many pages from an offset can be allocated fresh without
+	/// covering a page that was evicted
+	size_t unswapped_run(uintptr_t offset, size_t count);
+
+	/// Offset the page aging scan resumes from
+	uintptr_t m_hand;
+};
+
+
+/// Open area whose pages can be shared copy-on-write with clones of
+/// the area. Shared pages are mapped read-only, and a page is copied
+/// the first time an area writes to it.
+class vm_area_cow :
+	public vm_area_open
+{
+public:
+	/// Constructor.
+	/// \arg size  Initial virtual size of the memory area
+	/// \arg flags Flags for this memory area
+	vm_area_cow(size_t size, vm_flags flags);
+	virtual ~vm_area_cow();
+
+	/// Create a copy-on-write clone of this area. Every page currently in
+	/// this area becomes shared with the clone, and is write-protected in
+	/// all spaces this area is mapped into.
+	/// \returns  The new area, with no handles or mappings yet
+	vm_area_cow * clone();
+
+	virtual bool is_shared(uintptr_t phys) const override;
+	virtual bool unshare_page(uintptr_t offset) override;
+
+protected:
+	virtual void release(uintptr_t offset, size_t count) override;
+
+private:
+	/// Add a reference to each of a run of shared frames
+	static void share_frames(uintptr_t phys, size_t count);
+
+	/// Drop a reference to a shared frame
+	/// \returns  True if the frame was not shared, and so should be freed
+	static bool release_frame(uintptr_t phys);
+
+	/// Set once any of this area's pages have been shared
+	bool m_shared;
+
+	/// Reference counts of frames shared between more than one area.
+	/// Frames not in this map have a single owner.
+	static kutil::map<uint64_t, uint32_t> s_refs;
+	static kutil::spinlock s_lock;
 };
 
 
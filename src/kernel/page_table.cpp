@@ -1,15 +1,16 @@
 #include "kutil/assert.h"
 #include "kutil/memory.h"
 #include "console.h"
+#include "cpu.h"
 #include "frame_allocator.h"
+#include "interrupts.h"
 #include "kernel_memory.h"
 #include "page_table.h"
+#include "zero_pool.h"
 
 using memory::page_offset;
 using level = page_table::level;
 
-free_page_header * page_table::s_page_cache = nullptr;
-size_t page_table::s_cache_count = 0;
 constexpr size_t page_table::entry_sizes[4];
 
 
@@ -174,51 +175,159 @@ struct free_page_header { free_page_header *next; };
 page_table *
 page_table::get_table_page()
 {
-	if (!s_cache_count)
+	bool zeroed = false;
+	free_page_header *page = take_cached_page(zeroed);
+	if (!page) {
 		fill_table_page_cache();
+		page = take_cached_page(zeroed);
+	}
+
+	// Callers map pages with no way to back out, so page tables come out
+	// of the frames bulk allocations leave free for faults
+	kassert(page, "Out of frames for page tables");
 
-	free_page_header *page = s_page_cache;
-	s_page_cache = s_page_cache->next;
-	--s_cache_count;
+	if (zeroed)
+		page->next = nullptr;
+	else
+		kutil::memset(page, 0, memory::frame_size);
 
-	kutil::memset(page, 0, memory::frame_size);
 	return reinterpret_cast<page_table*>(page);
 }
 
+free_page_header *
+page_table::take_cached_page(bool &zeroed)
+{
+	interrupt_guard guard;
+	cpu_data &cpu = current_cpu();
+
+	free_page_header *page = cpu.table_zeroed;
+	if (page) {
+		cpu.table_zeroed = page->next;
+		--cpu.table_zeroed_count;
+		zeroed = true;
+		return page;
+	}
+
+	page = cpu.table_dirty;
+	if (page) {
+		cpu.table_dirty = page->next;
+		--cpu.table_dirty_count;
+		zeroed = false;
+	}
+	return page;
+}
+
 void
 page_table::free_table_page(page_table *pt)
 {
 	free_page_header *page =
 		reinterpret_cast<free_page_header*>(pt);
-	page->next = s_page_cache;
-	s_page_cache = page->next;
-	++s_cache_count;
+
+	free_page_header *excess = nullptr;
+	{
+		interrupt_guard guard;
+		cpu_data &cpu = current_cpu();
+
+		page->next = cpu.table_dirty;
+		cpu.table_dirty = page;
+		++cpu.table_dirty_count;
+
+		if (cpu.table_dirty_count + cpu.table_zeroed_count > cpu_cache_max)
+			excess = shrink_table_page_cache(cpu);
+	}
+
+	zero_pool &pool = zero_pool::get();
+	while (excess) {
+		free_page_header *next = excess->next;
+		pool.recycle(reinterpret_cast<uintptr_t>(excess) & ~page_offset, 1);
+		excess = next;
+	}
 }
 
-void
-page_table::fill_table_page_cache()
+free_page_header *
+page_table::shrink_table_page_cache(cpu_data &cpu)
 {
-	constexpr size_t min_pages = 16;
+	free_page_header *excess = nullptr;
 
-	frame_allocator &fa = frame_allocator::get();
-	while (s_cache_count < min_pages) {
-		uintptr_t phys = 0;
-		size_t n = fa.allocate(min_pages - s_cache_count, &phys);
+	for (size_t i = 0; i < cache_batch && cpu.table_dirty; ++i) {
+		free_page_header *page = cpu.table_dirty;
+		cpu.table_dirty = page->next;
+		--cpu.table_dirty_count;
+
+		page->next = excess;
+		excess = page;
+	}
 
-		free_page_header *start =
-			memory::to_virtual<free_page_header>(phys);
+	while (cpu.table_dirty_count + cpu.table_zeroed_count > cpu_cache_max) {
+		free_page_header *page = cpu.table_zeroed;
+		cpu.table_zeroed = page->next;
+		--cpu.table_zeroed_count;
 
-		for (int i = 0; i < n - 1; ++i)
-			kutil::offset_pointer(start, i * memory::frame_size)
-				->next = kutil::offset_pointer(start, (i+1) * memory::frame_size);
+		page->next = excess;
+		excess = page;
+	}
 
-		free_page_header *end =
-			kutil::offset_pointer(start, (n-1) * memory::frame_size);
+	return excess;
+}
 
-		end->next = s_page_cache;
-		s_page_cache = start;
-		s_cache_count += n;
+void
+page_table::fill_table_page_cache()
+{
+	// Prefer frames the zero pool has already cleared
+	zero_pool &pool = zero_pool::get();
+	free_page_header *zeroed = nullptr;
+	free_page_header *zeroed_end = nullptr;
+	size_t count = 0;
+
+	while (count < cache_batch) {
+		uintptr_t phys = 0;
+		size_t n = pool.take(cache_batch - count, phys);
+		if (!n)
+			break;
+
+		for (size_t i = 0; i < n; ++i) {
+			free_page_header *page =
+				memory::to_virtual<free_page_header>(phys + i * memory::frame_size);
+			page->next = zeroed;
+			zeroed = page;
+			if (!zeroed_end)
+				zeroed_end = page;
+		}
+		count += n;
 	}
+
+	if (count) {
+		interrupt_guard guard;
+		cpu_data &cpu = current_cpu();
+		zeroed_end->next = cpu.table_zeroed;
+		cpu.table_zeroed = zeroed;
+		cpu.table_zeroed_count += count;
+		return;
+	}
+
+	// The guard only protects this CPU's cache, so allocate before
+	// taking it rather than spin on the frame allocator's lock with
+	// interrupts (and TLB shootdown IPIs) held off.
+	uintptr_t phys = 0;
+	size_t n = frame_allocator::get().allocate(cache_batch, &phys);
+	if (!n)
+		return;
+
+	free_page_header *start =
+		memory::to_virtual<free_page_header>(phys);
+
+	for (size_t i = 0; i < n - 1; ++i)
+		kutil::offset_pointer(start, i * memory::frame_size)
+			->next = kutil::offset_pointer(start, (i+1) * memory::frame_size);
+
+	free_page_header *end =
+		kutil::offset_pointer(start, (n-1) * memory::frame_size);
+
+	interrupt_guard guard;
+	cpu_data &cpu = current_cpu();
+	end->next = cpu.table_dirty;
+	cpu.table_dirty = start;
+	cpu.table_dirty_count += n;
 }
 
 void
@@ -6,6 +6,7 @@
 #include "kutil/enum_bitfields.h"
 #include "kernel_memory.h"
 
+struct cpu_data;
 struct free_page_header;
 
 /// Struct to allow easy accessing of a memory page being used as a page table.
@@ -127,21 +128,28 @@ struct page_table
 		uint16_t m_index[D];
 	};
 
-	/// Allocate a page for a page table, or pull one from the cache
+	/// Pages moved at once into or out of a CPU's page cache
+	static constexpr size_t cache_batch = 16;
+
+	/// Pages a CPU's page cache may hold before some are recycled
+	static constexpr size_t cpu_cache_max = 64;
+
+	/// Get a page for a page table from the current CPU's page cache,
+	/// refilling the cache if needed.
 	/// \returns  An empty page, mapped in the linear offset area
 	static page_table * get_table_page();
 
-	/// Return a page table's page to the page cache.
+	/// Return a page table's page to the current CPU's page cache. If the
+	/// cache grows too large, a batch of its pages goes to the zero pool to
+	/// be zeroed and reused.
 	/// \arg pt  The page to be returned
 	static void free_table_page(page_table *pt);
 
-	// Ensure the page table page cache has a minimum number of pages
-	// in it.
+	/// Refill the current CPU's empty page cache with a batch of pages,
+	/// preferring zeroed frames from the zero pool. The cache is left empty
+	/// if no frames are free.
 	static void fill_table_page_cache();
 
-	static free_page_header *s_page_cache; ///< Cache of free pages to use for tables
-	static size_t s_cache_count;           ///< Number of pages in s_page_cache
-
 	/// Get an entry in the page table as a page_table pointer
 	/// \arg i     Index of the entry in this page table
 	/// \arg flags [out] If set, this will receive the entry's flags
@@ -171,6 +179,18 @@ struct page_table
 	/// Print this table to the debug console.
 	void dump(level lvl = level::pml4, bool recurse = true);
 
+private:
+	/// Take a page from the current CPU's page cache
+	/// \arg zeroed [out] Set to true if the page is already zeroed
+	/// \returns    The page, or null if the cache is empty
+	static free_page_header * take_cached_page(bool &zeroed);
+
+	/// Remove a batch of pages from a CPU's page cache. Must be called
+	/// with interrupts disabled.
+	/// \returns  A list of the removed pages
+	static free_page_header * shrink_table_page_cache(cpu_data &cpu);
+
+public:
 	uint64_t entries[memory::table_entries];
 };
 
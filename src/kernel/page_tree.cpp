@@ -1,8 +1,11 @@
 #include "kutil/assert.h"
 #include "kutil/memory.h"
 #include "frame_allocator.h"
+#include "kernel_memory.h"
 #include "page_tree.h"
 
+DEFINE_SLAB_ALLOCATOR(page_tree, 4);
+
 // Page tree levels map the following parts of a pagewise offset:
 // (Note that a level 0's entries are physical page addrs, the rest
 // map other page_tree nodes)
@@ -33,7 +36,7 @@ inline uint64_t to_base(uint64_t word) {
 }
 
 inline uint64_t to_level(uint64_t word) {
-	return (word >> 42) & 0x3f;
+	return (word >> 42) & 0x7;
 }
 
 inline uint64_t to_flags(uint64_t word) {
@@ -51,93 +54,131 @@ inline uint64_t index_for(uint64_t page_off, uint8_t level) {
 	return (page_off >> (level*bits_per_level))  & 0x3f;
 }
 
+// The number of pages a node of the given level spans
+inline uint64_t span_of(uint8_t level) {
+	return 1ull << ((level + 1) * bits_per_level);
+}
+
+
+// Accumulates contiguous runs of pages being removed from a tree, so
+// that they can be returned to the frame allocator in batches.
+struct page_tree::free_run
+{
+	uintptr_t start;
+	size_t count;
+
+	void add(uintptr_t page) {
+		if (count && page == start + count * memory::frame_size) {
+			++count;
+			return;
+		}
+		flush();
+		start = page;
+		count = 1;
+	}
+
+	void flush() {
+		if (count)
+			frame_allocator::get().free(start, count);
+		count = 0;
+	}
+};
+
 page_tree::page_tree(uint64_t base, uint8_t level) :
 	m_base {to_word(base, level)}
 {
 	kutil::memset(m_entries, 0, sizeof(m_entries));
 }
 
-bool
-page_tree::find(const page_tree *root, uint64_t offset, uintptr_t &page)
+page_tree *
+page_tree::find_level0(const page_tree *root, uint64_t page_off)
 {
-	uint64_t page_off = offset >> 12; // change to pagewise offset
 	page_tree const *node = root;
 	while (node) {
-		uint8_t level = to_level(node->m_base);
 		uint8_t index = 0;
 		if (!contains(page_off, node->m_base, index))
-			return false;
+			return nullptr;
 
-		if (!level) {
-			uintptr_t entry = node->m_entries[index].entry;
-			page = entry & ~1ull; // bit 0 marks 'present'
-			return (entry & 1);
-		}
+		if (!to_level(node->m_base))
+			return const_cast<page_tree*>(node);
 
 		node = node->m_entries[index].child;
 	}
 
-	return false;
+	return nullptr;
 }
 
-bool
-page_tree::find_or_add(page_tree * &root, uint64_t offset, uintptr_t &page)
+page_tree *
+page_tree::find_or_add_level0(page_tree * &root, uint64_t page_off)
 {
-	uint64_t page_off = offset >> 12; // change to pagewise offset
-	page_tree *level0 = nullptr;
-
 	if (!root) {
 		// There's no root yet, just make a level0 and make it
 		// the root.
-		level0 = new page_tree(page_off, 0);
-		root = level0;
-	} else {
-		// Find or insert an existing level0
-		page_tree **parent = &root;
-		page_tree *node = root;
-		uint8_t parent_level = max_level + 1;
-
-		while (node) {
-			uint8_t level = to_level(node->m_base);
-			uint8_t index = 0;
-			if (!contains(page_off, node->m_base, index)) {
-				// We found a valid parent but the slot where this node should
-				// go contains another node. Insert an intermediate parent of
-				// this node and a new level0 into the parent.
-				uint64_t other = to_base(node->m_base);
-				uint8_t lcl = parent_level;
-				while (index_for(page_off, lcl) == index_for(other, lcl))
-					--lcl;
-
-				page_tree *inter = new page_tree(page_off, lcl);
-				inter->m_entries[index_for(other, lcl)].child = node;
-				*parent = inter;
-
-				level0 = new page_tree(page_off, 0);
-				inter->m_entries[index_for(page_off, lcl)].child = level0;
-				break;
-			}
+		root = new page_tree(page_off, 0);
+		return root;
+	}
 
-			if (!level) {
-				level0 = node;
-				break;
-			}
+	// Find or insert an existing level0
+	page_tree **parent = &root;
+	page_tree *node = root;
+	uint8_t parent_level = max_level + 1;
 
-			parent = &node->m_entries[index].child;
-			node = *parent;
-		}
+	while (node) {
+		uint8_t level = to_level(node->m_base);
+		uint8_t index = 0;
+		if (!contains(page_off, node->m_base, index)) {
+			// We found a valid parent but the slot where this node should
+			// go contains another node. Insert an intermediate parent of
+			// this node and a new level0 into the parent.
+			uint64_t other = to_base(node->m_base);
+			uint8_t lcl = parent_level;
+			while (index_for(page_off, lcl) == index_for(other, lcl))
+				--lcl;
 
-		kassert( node || parent, "Both node and parent were null in find_or_add");
+			page_tree *inter = new page_tree(page_off, lcl);
+			inter->m_entries[index_for(other, lcl)].child = node;
+			*parent = inter;
 
-		if (!node) {
-			// We found a parent with an empty spot where this node should
-			// be. Insert a new level0 there.
-			level0 = new page_tree(page_off, 0);
-			*parent = level0;
+			page_tree *level0 = new page_tree(page_off, 0);
+			inter->m_entries[index_for(page_off, lcl)].child = level0;
+			return level0;
 		}
+
+		if (!level)
+			return node;
+
+		parent = &node->m_entries[index].child;
+		parent_level = level;
+		node = *parent;
 	}
 
+	// We found a parent with an empty spot where this node should
+	// be. Insert a new level0 there.
+	kassert(parent, "Both node and parent were null in find_or_add_level0");
+	*parent = new page_tree(page_off, 0);
+	return *parent;
+}
+
+bool
+page_tree::find(const page_tree *root, uint64_t offset, uintptr_t &page)
+{
+	uint64_t page_off = offset >> 12; // change to pagewise offset
+	page_tree const *level0 = find_level0(root, page_off);
+	if (!level0)
+		return false;
+
+	uintptr_t entry = level0->m_entries[index_for(page_off, 0)].entry;
+	page = entry & ~1ull; // bit 0 marks 'present'
+	return (entry & 1);
+}
+
+bool
+page_tree::find_or_add(page_tree * &root, uint64_t offset, uintptr_t &page)
+{
+	uint64_t page_off = offset >> 12; // change to pagewise offset
+	page_tree *level0 = find_or_add_level0(root, page_off);
 	kassert(level0, "Got through find_or_add without a level0");
+
 	uint8_t index = index_for(page_off, 0);
 	uint64_t &ent = level0->m_entries[index].entry;
 	if (!(ent & 1)) {
@@ -150,3 +191,191 @@ page_tree::find_or_add(page_tree * &root, uint64_t offset, uintptr_t &page)
 	page = ent & ~0xfffull;
 	return true;
 }
+
+size_t
+page_tree::find_run(const page_tree *root, uint64_t offset, size_t count, uintptr_t &page)
+{
+	uint64_t page_off = offset >> 12;
+	size_t found = 0;
+
+	while (found < count) {
+		page_tree const *level0 = find_level0(root, page_off);
+		if (!level0)
+			break;
+
+		// Scan the rest of this leaf with a single walk
+		for (unsigned i = index_for(page_off, 0); i < 64 && found < count; ++i) {
+			uintptr_t entry = level0->m_entries[i].entry;
+			uintptr_t phys = entry & ~0xfffull;
+			if (!(entry & 1))
+				return found;
+
+			if (!found)
+				page = phys;
+			else if (phys != page + found * memory::frame_size)
+				return found;
+
+			++found;
+			++page_off;
+		}
+	}
+
+	return found;
+}
+
+size_t
+page_tree::add_run(page_tree * &root, uint64_t offset, uintptr_t page, size_t count)
+{
+	uint64_t page_off = offset >> 12;
+	size_t added = 0;
+
+	while (added < count) {
+		page_tree *level0 = find_or_add_level0(root, page_off);
+		kassert(level0, "Got through add_run without a level0");
+
+		for (unsigned i = index_for(page_off, 0); i < 64 && added < count; ++i) {
+			uint64_t &ent = level0->m_entries[i].entry;
+			if (ent & 1)
+				return added;
+
+			ent = (page + added * memory::frame_size) | 1;
+			++added;
+			++page_off;
+		}
+	}
+
+	return added;
+}
+
+const page_tree *
+page_tree::seek(const page_tree *node, uint64_t page_off, uint8_t &index)
+{
+	if (!node)
+		return nullptr;
+
+	uint64_t base = to_base(node->m_base);
+	uint8_t level = to_level(node->m_base);
+	if (page_off >= base + span_of(level))
+		return nullptr;
+
+	unsigned i = page_off <= base ? 0 : index_for(page_off, level);
+	for (; i < 64; ++i) {
+		if (!level) {
+			if (node->m_entries[i].entry & 1) {
+				index = i;
+				return node;
+			}
+			continue;
+		}
+
+		const page_tree *leaf = seek(node->m_entries[i].child, page_off, index);
+		if (leaf)
+			return leaf;
+	}
+
+	return nullptr;
+}
+
+size_t
+page_tree::remove_from(page_tree * &node, uint64_t first, uint64_t last, free_run *run)
+{
+	if (!node)
+		return 0;
+
+	uint64_t base = to_base(node->m_base);
+	uint8_t level = to_level(node->m_base);
+	uint64_t end = base + span_of(level);
+	if (first >= end || last <= base)
+		return 0;
+
+	size_t removed = 0;
+	unsigned start = first <= base ? 0 : index_for(first, level);
+	unsigned stop = last >= end ? 64 : index_for(last - 1, level) + 1;
+
+	for (unsigned i = start; i < stop; ++i) {
+		if (!level) {
+			uint64_t &ent = node->m_entries[i].entry;
+			if (!(ent & 1))
+				continue;
+
+			if (run)
+				run->add(ent & ~0xfffull);
+			ent = 0;
+			++removed;
+		} else {
+			removed += remove_from(node->m_entries[i].child, first, last, run);
+		}
+	}
+
+	// Delete this node if nothing is left in it
+	for (unsigned i = 0; i < 64; ++i)
+		if (node->m_entries[i].entry)
+			return removed;
+
+	delete node;
+	node = nullptr;
+	return removed;
+}
+
+size_t
+page_tree::remove(page_tree * &root, uint64_t offset, size_t count, bool free)
+{
+	if (!count)
+		return 0;
+
+	uint64_t first = offset >> 12;
+	free_run run {0, 0};
+	size_t removed = remove_from(root, first, first + count, free ? &run : nullptr);
+	run.flush();
+	return removed;
+}
+
+void
+page_tree::clear(page_tree * &root, bool free)
+{
+	free_run run {0, 0};
+	remove_from(root, 0, ~0ull, free ? &run : nullptr);
+	run.flush();
+	kassert(!root, "page_tree::clear left a root node");
+}
+
+
+page_tree::iterator::iterator(const page_tree *root, uint64_t offset) :
+	m_root {root},
+	m_leaf {nullptr},
+	m_index {0}
+{
+	m_leaf = seek(root, offset >> 12, m_index);
+}
+
+uint64_t
+page_tree::iterator::offset() const
+{
+	if (!m_leaf) return 0;
+	return (to_base(m_leaf->m_base) + m_index) << 12;
+}
+
+uintptr_t
+page_tree::iterator::page() const
+{
+	if (!m_leaf) return 0;
+	return m_leaf->m_entries[m_index].entry & ~0xfffull;
+}
+
+page_tree::iterator &
+page_tree::iterator::operator++()
+{
+	if (!m_leaf)
+		return *this;
+
+	// Try the rest of the current leaf first
+	while (++m_index < 64) {
+		if (m_leaf->m_entries[m_index].entry & 1)
+			return *this;
+	}
+
+	uint64_t next = to_base(m_leaf->m_base) + 64;
+	m_index = 0;
+	m_leaf = seek(m_root, next, m_index);
+	return *this;
+}
@@ -2,12 +2,44 @@
 /// \file page_tree.h
 /// Definition of mapped page tracking structure and related definitions
 
+#include <stddef.h>
 #include <stdint.h>
+#include "kutil/slab_allocated.h"
 
 /// A radix tree node that tracks mapped pages
-class page_tree
+class page_tree :
+	public kutil::slab_allocated<page_tree, 4>
 {
 public:
+	/// Iterator over the present pages in a tree, in offset order.
+	class iterator
+	{
+	public:
+		/// Constructor.
+		/// \arg root    The root node of the tree to iterate
+		/// \arg offset  Offset into the VMA, in bytes, to start at
+		iterator(const page_tree *root, uint64_t offset = 0);
+
+		/// Get the offset into the VMA of the current page, in bytes
+		uint64_t offset() const;
+
+		/// Get the physical address of the current page
+		uintptr_t page() const;
+
+		/// Check if this iterator still points at a page
+		inline bool valid() const { return m_leaf != nullptr; }
+
+		iterator & operator++();
+		inline bool operator!=(const iterator &o) const {
+			return m_leaf != o.m_leaf || m_index != o.m_index;
+		}
+
+	private:
+		const page_tree *m_root;
+		const page_tree *m_leaf;
+		uint8_t m_index;
+	};
+
 	/// Get the physical address of the page at the given offset.
 	/// \arg root    The root node of the tree
 	/// \arg offset  Offset into the VMA, in bytes
@@ -23,9 +55,55 @@ public:
 	/// \returns     True if a page was found
 	static bool find_or_add(page_tree * &root, uint64_t offset, uintptr_t &page);
 
+	/// Find the run of physically contiguous pages starting at the given offset.
+	/// \arg root    The root node of the tree
+	/// \arg offset  Offset into the VMA, in bytes
+	/// \arg count   The maximum number of pages to return
+	/// \arg page    [out] Receives the physical address of the first page
+	/// \returns     The number of pages in the run, or 0 if there is no page
+	///              at the given offset
+	static size_t find_run(const page_tree *root, uint64_t offset, size_t count, uintptr_t &page);
+
+	/// Insert a run of physically contiguous pages into the tree. Insertion
+	/// stops at the first offset that already has a page.
+	/// \arg root    [inout] The root node of the tree. This pointer may be updated.
+	/// \arg offset  Offset into the VMA, in bytes
+	/// \arg page    The physical address of the first page
+	/// \arg count   The number of pages to insert
+	/// \returns     The number of pages inserted
+	static size_t add_run(page_tree * &root, uint64_t offset, uintptr_t page, size_t count);
+
+	/// Remove a range of pages from the tree. Nodes left empty are deleted.
+	/// \arg root    [inout] The root node of the tree. This pointer may be updated.
+	/// \arg offset  Offset into the VMA, in bytes
+	/// \arg count   The number of pages to remove
+	/// \arg free    If true, free the removed pages back to the frame allocator
+	/// \returns     The number of pages that were removed
+	static size_t remove(page_tree * &root, uint64_t offset, size_t count, bool free);
+
+	/// Remove all pages from the tree and delete all of its nodes.
+	/// \arg root    [inout] The root node of the tree. Set to null.
+	/// \arg free    If true, free the removed pages back to the frame allocator
+	static void clear(page_tree * &root, bool free);
+
 private:
 	page_tree(uint64_t base, uint8_t level);
 
+	struct free_run;
+
+	/// Find the level 0 node containing the given pagewise offset.
+	static page_tree * find_level0(const page_tree *root, uint64_t page_off);
+
+	/// Find or create the level 0 node containing the given pagewise offset.
+	static page_tree * find_or_add_level0(page_tree * &root, uint64_t page_off);
+
+	/// Find the first level 0 node with a present page at or after the given
+	/// pagewise offset.
+	static const page_tree * seek(const page_tree *node, uint64_t page_off, uint8_t &index);
+
+	/// Remove the pages in [first, last) pagewise from the subtree at node.
+	static size_t remove_from(page_tree * &node, uint64_t first, uint64_t last, free_run *run);
+
 	/// Stores the page offset of the start of this node's pages in bits 0:41
 	/// and the depth of tree this node represents in bits 42:44 (0-7)
 	uint64_t m_base;
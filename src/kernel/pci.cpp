@@ -99,7 +99,7 @@ pci_device::pci_device(pci_group &group, uint8_t bus, uint8_t device, uint8_t fu
 
 	uint16_t *status = command + 1;
 
-	log::info(logs::device, "Found PCIe device at %02d:%02d:%d of type %x.%x.%x id %04x:%04x",
+	log_info(logs::device, "Found PCIe device at %02d:%02d:%d of type %x.%x.%x id %04x:%04x",
 			bus, device, func, m_class, m_subclass, m_progif, m_vendor, m_device);
 
 	if (*status & 0x0010) {
@@ -108,7 +108,7 @@ pci_device::pci_device(pci_group &group, uint8_t bus, uint8_t device, uint8_t fu
 		while (next) {
 			pci_cap *cap = reinterpret_cast<pci_cap *>(kutil::offset_pointer(m_base, next));
 			next = cap->next;
-			log::debug(logs::device, "  - found PCI cap type %02x", cap->id);
+			log_debug(logs::device, "  - found PCI cap type %02x", cap->id);
 
 			if (cap->id == pci_cap::type::msi) {
 				m_msi = cap;
@@ -0,0 +1,71 @@
+#include "kernel_args.h"
+#include "kernel_memory.h"
+#include "log.h"
+#include "objects/vm_area.h"
+#include "program_image.h"
+#include "vm_space.h"
+
+using memory::frame_size;
+
+kutil::vector<program_image*> program_image::s_images;
+kutil::spinlock program_image::s_lock;
+
+program_image &
+program_image::get(const kernel::args::program &program)
+{
+	uintptr_t key = program.sections[0].phys_addr;
+
+	kutil::scoped_lock lock {s_lock};
+	for (auto *image : s_images)
+		if (image->m_key == key)
+			return *image;
+
+	program_image *image = new program_image {program};
+	s_images.append(image);
+	return *image;
+}
+
+program_image::program_image(const kernel::args::program &program) :
+	m_key {program.sections[0].phys_addr},
+	m_entrypoint {program.entrypoint}
+{
+	using kernel::args::section_flags;
+
+	for (size_t i = 0; i < program.num_sections; ++i) {
+		const auto &sect = program.sections[i];
+
+		vm_flags flags =
+			(bitfield_has(sect.type, section_flags::execute) ? vm_flags::exec : vm_flags::none) |
+			(bitfield_has(sect.type, section_flags::write) ? vm_flags::write : vm_flags::none);
+
+		uintptr_t base = memory::page_align_down(sect.virt_addr);
+		uintptr_t phys = memory::page_align_down(sect.phys_addr);
+		size_t size = memory::page_align_up(sect.virt_addr + sect.size) - base;
+
+		// The image takes ownership of the pages the bootloader loaded
+		// this section into. This template area is never mapped itself,
+		// so its pages always hold the original contents.
+		vm_area_cow *area = new vm_area_cow {size, flags};
+		area->add_pages(0, phys, size / frame_size);
+		area->handle_retain();
+
+		m_sections.append({base, area});
+	}
+
+	log_debug(logs::task, "Registered program image %016lx with %d sections",
+			m_key, m_sections.count());
+}
+
+void
+program_image::map_into(vm_space &space)
+{
+	for (auto &sect : m_sections) {
+		// Read-only sections share the template area itself, writable
+		// ones get their own copy-on-write clone of it.
+		vm_area *area = sect.area;
+		if (area->flags() && vm_flags::write)
+			area = sect.area->clone();
+
+		space.add(sect.base, area);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+/// \file program_image.h
+/// Registry of loaded program images shared between processes
+
+#include <stdint.h>
+#include "kutil/spinlock.h"
+#include "kutil/vector.h"
+
+namespace kernel {
+namespace args {
+	struct program;
+}}
+
+class vm_area_cow;
+class vm_space;
+
+/// A program image loaded by the bootloader. Every process running the
+/// same image maps the same read-only section pages, and gets
+/// copy-on-write clones of its writable sections.
+class program_image
+{
+public:
+	/// Get the image for a program, registering it if this is the first
+	/// time it has been used.
+	/// \arg program  The bootloader's description of the loaded program
+	/// \returns      The shared image for that program
+	static program_image & get(const kernel::args::program &program);
+
+	/// Map this image's sections into an address space
+	/// \arg space  The address space to map into
+	void map_into(vm_space &space);
+
+	/// Get the entrypoint address of this image
+	inline uintptr_t entrypoint() const { return m_entrypoint; }
+
+private:
+	program_image(const kernel::args::program &program);
+
+	struct section
+	{
+		uintptr_t base;
+		vm_area_cow *area;
+	};
+
+	/// Images are keyed by the physical address of their first section,
+	/// which is unique to each file the bootloader loaded.
+	uintptr_t m_key;
+	uintptr_t m_entrypoint;
+	kutil::vector<section> m_sections;
+
+	static kutil::vector<program_image*> s_images;
+	static kutil::spinlock s_lock;
+};
@@ -0,0 +1,54 @@
+#include "kutil/memory.h"
+#include "kernel_memory.h"
+#include "ram_disk.h"
+
+using memory::frame_size;
+
+ram_disk::ram_disk(const kutil::vector<void*> &pages) :
+	m_size {pages.count() * frame_size}
+{
+	m_pages.ensure_capacity(pages.count());
+	for (void *page : pages)
+		m_pages.append(reinterpret_cast<uint8_t*>(page));
+}
+
+size_t
+ram_disk::read(size_t offset, size_t length, void *buffer)
+{
+	return transfer(offset, length, reinterpret_cast<uint8_t*>(buffer), true);
+}
+
+size_t
+ram_disk::write(size_t offset, size_t length, const void *buffer)
+{
+	return transfer(offset, length,
+		reinterpret_cast<uint8_t*>(const_cast<void*>(buffer)), false);
+}
+
+size_t
+ram_disk::transfer(size_t offset, size_t length, uint8_t *buffer, bool out)
+{
+	if (offset >= m_size)
+		return 0;
+	if (offset + length > m_size)
+		length = m_size - offset;
+
+	size_t done = 0;
+	while (done < length) {
+		size_t pos = offset + done;
+		size_t in_page = pos & (frame_size - 1);
+		size_t n = frame_size - in_page;
+		if (n > length - done)
+			n = length - done;
+
+		uint8_t *page = m_pages[pos / frame_size];
+		if (out)
+			kutil::memcpy(buffer + done, page + in_page, n);
+		else
+			kutil::memcpy(page + in_page, buffer + done, n);
+
+		done += n;
+	}
+
+	return length;
+}
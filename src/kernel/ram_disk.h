@@ -0,0 +1,37 @@
+#pragma once
+/// \file ram_disk.h
+/// A block device backed by memory
+#include <stddef.h>
+#include <stdint.h>
+#include "kutil/vector.h"
+#include "block_device.h"
+
+/// A block device stored in pages of memory. Useful as a stand-in for a
+/// real disk, for example to exercise swap without one.
+class ram_disk :
+	public block_device
+{
+public:
+	/// Constructor.
+	/// \arg pages  The page-sized blocks of memory backing the device, in
+	///             order. The caller keeps ownership of the memory.
+	ram_disk(const kutil::vector<void*> &pages);
+
+	virtual size_t read(size_t offset, size_t length, void *buffer) override;
+	virtual size_t write(size_t offset, size_t length, const void *buffer) override;
+	virtual size_t size() const override { return m_size; }
+
+private:
+	/// Copy bytes to or from the device
+	/// \arg offset  The offset into the device
+	/// \arg length  The number of bytes to copy
+	/// \arg buffer  The buffer to copy to or from
+	/// \arg out     True to copy from the device into the buffer
+	/// \returns     The number of bytes copied
+	size_t transfer(size_t offset, size_t length, uint8_t *buffer, bool out);
+
+	size_t m_size;
+
+	/// Each page of the device
+	kutil::vector<uint8_t*> m_pages;
+};
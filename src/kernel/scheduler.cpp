@@ -81,10 +81,10 @@ scheduler::create_kernel_task(void (*task)(), uint8_t priority, bool constant)
 
 	th->set_state(thread::state::ready);
 
-	log::debug(logs::task, "Creating kernel task: thread %llx  pri %d", th->koid(), tcb->priority);
-	log::debug(logs::task, "    RSP0 %016lx", tcb->rsp0);
-	log::debug(logs::task, "     RSP %016lx", tcb->rsp);
-	log::debug(logs::task, "    PML4 %016lx", tcb->pml4);
+	log_debug(logs::task, "Creating kernel task: thread %llx  pri %d", th->koid(), tcb->priority);
+	log_debug(logs::task, "    RSP0 %016lx", tcb->rsp0);
+	log_debug(logs::task, "     RSP %016lx", tcb->rsp);
+	log_debug(logs::task, "    PML4 %016lx", tcb->pml4);
 }
 
 uint32_t
@@ -102,7 +102,7 @@ scheduler::start()
 
 	process *kp = &process::kernel_process();
 	thread *idle = thread::create_idle_thread(*kp, max_priority, cpu.rsp0);
-	log::debug(logs::task, "CPU%02x idle thread koid %llx", cpu.index, idle->koid());
+	log_debug(logs::task, "CPU%02x idle thread koid %llx", cpu.index, idle->koid());
 
 	auto *tcb = idle->tcb();
 	cpu.process = kp;
@@ -111,7 +111,7 @@ scheduler::start()
 
 	queue.current = tcb;
 
-	log::info(logs::sched, "CPU%02x starting scheduler", cpu.index);
+	log_info(logs::sched, "CPU%02x starting scheduler", cpu.index);
 	cpu.apic->enable_timer(isr::isrTimer, false);
 	cpu.apic->reset_timer(10);
 }
@@ -163,7 +163,7 @@ void scheduler::prune(run_queue &queue, uint64_t now)
 				delete &p;
 		} else {
 			queue.blocked.remove(remove);
-			log::debug(logs::sched, "Prune: readying unblocked thread %llx", th->koid());
+			log_debug(logs::sched, "Prune: readying unblocked thread %llx", th->koid());
 			queue.ready[remove->priority].push_back(remove);
 		}
 	}
@@ -193,7 +193,7 @@ scheduler::check_promotions(run_queue &queue, uint64_t now)
 				tcb->priority -= 1;
 				tcb->time_left = quantum(tcb->priority);
 				queue.ready[tcb->priority].push_back(tcb);
-				log::info(logs::sched, "Scheduler promoting thread %llx, priority %d",
+				log_info(logs::sched, "Scheduler promoting thread %llx, priority %d",
 						th->koid(), tcb->priority);
 			}
 		}
@@ -244,7 +244,7 @@ scheduler::steal_work(cpu_data &cpu)
 		stolen += balance_lists(my_queue.blocked, other_queue.blocked);
 
 		if (stolen)
-			log::debug(logs::sched, "CPU%02x stole %2d tasks from CPU%02x",
+			log_debug(logs::sched, "CPU%02x stole %2d tasks from CPU%02x",
 					cpu.index, stolen, i);
 	}
 }
@@ -277,7 +277,7 @@ scheduler::schedule()
 		if (priority < max_priority && !constant) {
 			// Process used its whole timeslice, demote it
 			++queue.current->priority;
-			log::debug(logs::sched, "Scheduler  demoting thread %llx, priority %d",
+			log_debug(logs::sched, "Scheduler  demoting thread %llx, priority %d",
 					th->koid(), queue.current->priority);
 		}
 		queue.current->time_left = quantum(queue.current->priority);
@@ -295,7 +295,8 @@ scheduler::schedule()
 	}
 
 	clock::get().update();
-	prune(queue, ++m_clock);
+	++m_clock;
+	prune(queue, clock::get().value());
 	if (m_clock - queue.last_promotion > promote_frequency)
 		check_promotions(queue, m_clock);
 
@@ -322,11 +323,11 @@ scheduler::schedule()
 	cpu.process = &next_thread->parent();
 	queue.current = next;
 
-	log::debug(logs::sched, "CPU%02x switching threads %llx->%llx",
+	log_debug(logs::sched, "CPU%02x switching threads %llx->%llx",
 			cpu.index, th->koid(), next_thread->koid());
-	log::debug(logs::sched, "    priority %d time left %d @ %lld.",
+	log_debug(logs::sched, "    priority %d time left %d @ %lld.",
 			next->priority, next->time_left, m_clock);
-	log::debug(logs::sched, "    PML4 %llx", next->pml4);
+	log_debug(logs::sched, "    PML4 %llx", next->pml4);
 
 	queue.lock.release(&waiter);
 	task_switch(queue.current);
@@ -83,6 +83,8 @@ private:
 	static constexpr uint64_t promote_frequency = 10;
 	static constexpr uint64_t steal_frequency = 10;
 
+	/// Move threads that have woken or exited off the blocked list
+	/// \arg now  The current clock value, in us
 	void prune(run_queue &queue, uint64_t now);
 	void check_promotions(run_queue &queue, uint64_t now);
 	void steal_work(cpu_data &cpu);
@@ -1,4 +1,5 @@
 #include "kutil/no_construct.h"
+#include "interrupts.h"
 #include "io.h"
 #include "serial.h"
 
@@ -8,13 +9,24 @@
 static kutil::no_construct<serial_port> __g_com1_storage;
 serial_port &g_com1 = __g_com1_storage.value;
 
+static constexpr uint8_t ier_tx_empty = 0x02;
+static constexpr uint8_t iir_none = 0x01;
+
 serial_port::serial_port() :
-	m_port(0)
+	m_port(0),
+	m_polling(true),
+	m_tx_irq(false),
+	m_tx_head(0),
+	m_tx_tail(0)
 {
 }
 
 serial_port::serial_port(uint16_t port) :
-	m_port(port)
+	m_port(port),
+	m_polling(true),
+	m_tx_irq(false),
+	m_tx_head(0),
+	m_tx_tail(0)
 {
 	outb(port + 1, 0x00);  // Disable all interrupts
 	outb(port + 3, 0x80);  // Enable the Divisor Latch Access Bit
@@ -36,7 +48,71 @@ serial_port::read() {
 
 void
 serial_port::write(char c) {
-	while (!write_ready());
-	outb(m_port, c);
+	if (__atomic_load_n(&m_polling, __ATOMIC_RELAXED)) {
+		while (!write_ready());
+		outb(m_port, c);
+		return;
+	}
+
+	interrupt_guard guard;
+	kutil::scoped_lock lock {m_lock};
+
+	// When the buffer is full, wait for the UART to make room
+	while (m_tx_head - m_tx_tail == tx_buffer_size) {
+		while (!write_ready());
+		fill_fifo();
+	}
+
+	m_tx_buffer[m_tx_head++ % tx_buffer_size] = c;
+	if (!m_tx_irq)
+		fill_fifo();
+}
+
+void
+serial_port::fill_fifo()
+{
+	if (write_ready()) {
+		for (size_t i = 0; i < tx_fifo_size && m_tx_tail != m_tx_head; ++i)
+			outb(m_port, m_tx_buffer[m_tx_tail++ % tx_buffer_size]);
+	}
+
+	bool pending = m_tx_tail != m_tx_head;
+	if (pending != m_tx_irq) {
+		outb(m_port + 1, pending ? ier_tx_empty : 0);
+		m_tx_irq = pending;
+	}
 }
 
+void
+serial_port::enable_interrupts()
+{
+	__atomic_store_n(&m_polling, false, __ATOMIC_RELEASE);
+}
+
+void
+serial_port::handle_interrupt()
+{
+	// Reading the IIR acknowledges a transmit-empty interrupt
+	if (inb(m_port + 2) & iir_none)
+		return;
+
+	kutil::scoped_lock lock {m_lock};
+	fill_fifo();
+}
+
+void
+serial_port::panic()
+{
+	if (!m_port)
+		return;
+
+	// Don't take the lock: its holder may be the code that failed
+	__atomic_store_n(&m_polling, true, __ATOMIC_RELAXED);
+	outb(m_port + 1, 0x00);
+	m_tx_irq = false;
+
+	while (m_tx_tail != m_tx_head) {
+		while (!write_ready());
+		outb(m_port, m_tx_buffer[m_tx_tail++ % tx_buffer_size]);
+	}
+}
@@ -1,7 +1,9 @@
 #pragma once
 /// \file serial.h
 /// Declarations related to serial ports.
+#include <stddef.h>
 #include <stdint.h>
+#include "kutil/spinlock.h"
 
 class serial_port
 {
@@ -12,14 +14,48 @@ public:
 
 	serial_port();
 
+	/// Write a character. Once interrupts are enabled, this only queues
+	/// the character, and the transmit interrupt sends it. Otherwise it
+	/// waits for the UART.
 	void write(char c);
 	char read();
 
+	/// Start sending queued output from the UART's transmit interrupt.
+	/// The interrupt must be routed to handle_interrupt() first.
+	void enable_interrupts();
+
+	/// Handle an interrupt from the UART
+	void handle_interrupt();
+
+	/// Send all queued output, and wait for the UART on every write from
+	/// now on. Called when the system is going down, and the transmit
+	/// interrupt may never come.
+	void panic();
+
 private:
+	static constexpr size_t tx_buffer_size = 4096;
+
+	/// Characters the UART's transmit FIFO can take once it's empty
+	static constexpr size_t tx_fifo_size = 16;
+
 	uint16_t m_port;
+	bool m_polling;
+	bool m_tx_irq; ///< Whether the transmit interrupt is enabled
+
+	size_t m_tx_head;
+	size_t m_tx_tail;
+	uint8_t m_tx_buffer[tx_buffer_size];
+
+	/// Protects the transmit buffer. Always taken with interrupts disabled,
+	/// as it is also taken by the interrupt handler.
+	kutil::spinlock m_lock;
 
 	bool read_ready();
 	bool write_ready();
+
+	/// Move queued characters into the transmit FIFO if it's empty, and
+	/// enable the transmit interrupt if any are left. Call with m_lock held.
+	void fill_fifo();
 };
 
 extern serial_port &g_com1;
@@ -0,0 +1,207 @@
+#include "j6/signals.h"
+#include "kutil/assert.h"
+#include "block_device.h"
+#include "frame_allocator.h"
+#include "kernel_memory.h"
+#include "log.h"
+#include "objects/system.h"
+#include "objects/thread.h"
+#include "objects/vm_area.h"
+#include "ram_disk.h"
+#include "swap.h"
+#include "swap_device.h"
+
+using memory::frame_size;
+
+static page_reclaimer g_page_reclaimer;
+
+page_reclaimer::page_reclaimer() :
+	m_hand {0},
+	m_scanning {nullptr},
+	m_scanning_released {false}
+{
+}
+
+page_reclaimer &
+page_reclaimer::get()
+{
+	return g_page_reclaimer;
+}
+
+void
+page_reclaimer::add_device(block_device *device)
+{
+	swap_device *swap = new swap_device {device};
+	if (!swap->slots()) {
+		delete swap;
+		return;
+	}
+
+	m_devices.append(swap);
+	log_info(logs::memory, "Added swap device %d with %d pages",
+			m_devices.count() - 1, swap->slots());
+}
+
+void
+page_reclaimer::add_ram_device(size_t size)
+{
+	frame_allocator &fa = frame_allocator::get();
+	size_t count = memory::page_count(size);
+
+	kutil::vector<void*> pages {count};
+	while (pages.count() < count) {
+		uintptr_t phys = 0;
+		size_t n = fa.allocate(count - pages.count(), &phys);
+		if (!n)
+			break;
+		for (size_t i = 0; i < n; ++i)
+			pages.append(memory::to_virtual<void>(phys + i * frame_size));
+	}
+
+	// The RAM disk lives as long as the kernel, so its frames are never freed
+	add_device(new ram_disk {pages});
+}
+
+void
+page_reclaimer::track(vm_area_open *area)
+{
+	kutil::scoped_lock lock {m_lock};
+	m_areas.append(area);
+}
+
+bool
+page_reclaimer::untrack(vm_area_open *area)
+{
+	kutil::scoped_lock lock {m_lock};
+	for (size_t i = 0; i < m_areas.count(); ++i) {
+		if (m_areas[i] != area)
+			continue;
+
+		m_areas.remove_swap_at(i);
+		if (m_hand > i)
+			--m_hand;
+		break;
+	}
+
+	if (m_scanning == area) {
+		m_scanning_released = true;
+		return false;
+	}
+	return true;
+}
+
+size_t
+page_reclaimer::reclaim(size_t count)
+{
+	if (!has_swap())
+		return 0;
+
+	// Two full rounds of the areas lets every page that was only
+	// given a second chance on the first round be evicted
+	size_t rounds = 0;
+	{
+		kutil::scoped_lock lock {m_lock};
+		rounds = 2 * m_areas.count();
+	}
+
+	size_t evicted = 0;
+	while (evicted < count && rounds--) {
+		vm_area_open *area = nullptr;
+		{
+			kutil::scoped_lock lock {m_lock};
+			if (!m_areas.count())
+				break;
+
+			if (m_hand >= m_areas.count())
+				m_hand = 0;
+
+			area = m_areas[m_hand++];
+			m_scanning = area;
+		}
+
+		// Evicting pages means I/O, so the lock can't be held here
+		evicted += area->reclaim(count - evicted, scan_batch);
+
+		bool released = false;
+		{
+			kutil::scoped_lock lock {m_lock};
+			released = m_scanning_released;
+			m_scanning = nullptr;
+			m_scanning_released = false;
+		}
+
+		if (released)
+			delete area;
+	}
+
+	if (evicted)
+		log_debug(logs::memory, "Reclaimed %d pages to swap", evicted);
+	return evicted;
+}
+
+bool
+page_reclaimer::allocate_slot(uint64_t &slot)
+{
+	for (size_t i = 0; i < m_devices.count(); ++i) {
+		uint32_t index = 0;
+		if (m_devices[i]->allocate(index)) {
+			slot = (static_cast<uint64_t>(i) << device_shift) | index;
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+page_reclaimer::free_slot(uint64_t slot)
+{
+	m_devices[slot >> device_shift]->free(slot & 0xffffffff);
+}
+
+bool
+page_reclaimer::write_page(uint64_t slot, uintptr_t phys)
+{
+	return m_devices[slot >> device_shift]->write(slot & 0xffffffff,
+			memory::to_virtual<void>(phys));
+}
+
+bool
+page_reclaimer::read_page(uint64_t slot, uintptr_t phys)
+{
+	return m_devices[slot >> device_shift]->read(slot & 0xffffffff,
+			memory::to_virtual<void>(phys));
+}
+
+
+static void
+low_memory()
+{
+	system::get().assert_signal(j6_signal_system_low_memory);
+}
+
+void
+reclaimer_task()
+{
+	page_reclaimer &reclaimer = page_reclaimer::get();
+	frame_allocator &fa = frame_allocator::get();
+
+	log_info(logs::task, "Starting kernel page reclaimer task");
+	fa.set_low_handler(page_reclaimer::low_watermark, low_memory);
+
+	thread &self = thread::current();
+	system &sys = system::get();
+
+	while (true) {
+		bool progress = true;
+		while (progress && fa.free_count() < page_reclaimer::high_watermark)
+			progress = reclaimer.reclaim(page_reclaimer::scan_batch) > 0;
+
+		// If nothing could be evicted, wait for the next allocation below
+		// the watermark rather than rescanning immediately
+		sys.deassert_signal(j6_signal_system_low_memory);
+		if (!progress || fa.free_count() >= page_reclaimer::low_watermark) {
+			sys.add_blocked_thread(&self);
+			self.wait_on_signals(&sys, j6_signal_system_low_memory);
+		}
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+/// \file swap.h
+/// The page reclaimer, which evicts pages to swap space
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kutil/spinlock.h"
+#include "kutil/vector.h"
+
+class block_device;
+class swap_device;
+class vm_area_open;
+
+/// Evicts the least recently used pages of open areas to swap when free
+/// memory runs low. Areas are scanned round-robin, and pages within each
+/// area in clock order: a page accessed since the last pass over it gets
+/// a second chance, and the rest are evicted.
+class page_reclaimer
+{
+public:
+	/// Free frame count below which the reclaimer task is woken
+	static constexpr size_t low_watermark = 512;
+
+	/// Free frame count the reclaimer task evicts up to
+	static constexpr size_t high_watermark = 2048;
+
+	/// Free frame count kept back for page faults: bulk allocations, like
+	/// committing a range of an area, stop short of it
+	static constexpr size_t min_watermark = 128;
+
+	/// Number of pages examined from an area at a time
+	static constexpr size_t scan_batch = 32;
+
+	page_reclaimer();
+
+	/// Get the global page reclaimer
+	static page_reclaimer & get();
+
+	/// Add a block device as swap space
+	/// \arg device  The block device, which must be writable
+	void add_device(block_device *device);
+
+	/// Add a RAM disk as swap space, as a stand-in for a swap partition
+	/// \arg size  The size of the RAM disk in bytes
+	void add_ram_device(size_t size);
+
+	/// Check if there is any swap space to evict pages to
+	inline bool has_swap() const { return m_devices.count() > 0; }
+
+	/// Add an area to the set of areas whose pages may be evicted
+	void track(vm_area_open *area);
+
+	/// Remove an area from the set of areas whose pages may be evicted
+	/// \returns  False if the reclaimer is in the middle of scanning the
+	///           area, in which case it deletes the area once it's done
+	bool untrack(vm_area_open *area);
+
+	/// Evict cold pages to swap. Only the reclaimer task calls this. It
+	/// does I/O, so must be called with no spinlocks held.
+	/// \arg count  The number of pages to try to evict
+	/// \returns    The number of pages evicted
+	size_t reclaim(size_t count);
+
+	/// Reserve a swap slot, on any device.
+	/// \arg slot  [out] Receives the slot id
+	/// \returns   False if all swap space is in use
+	bool allocate_slot(uint64_t &slot);
+
+	/// Return a swap slot to its device
+	void free_slot(uint64_t slot);
+
+	/// Write a page out to a swap slot
+	/// \returns  True if the page was written
+	bool write_page(uint64_t slot, uintptr_t phys);
+
+	/// Read a page in from a swap slot
+	/// \returns  True if the page was read
+	bool read_page(uint64_t slot, uintptr_t phys);
+
+private:
+	/// Slot ids hold the device index above the slot index
+	static constexpr unsigned device_shift = 32;
+
+	kutil::vector<swap_device*> m_devices;
+	kutil::vector<vm_area_open*> m_areas;
+
+	/// Index in m_areas of the next area to scan
+	size_t m_hand;
+
+	/// The area being scanned. The lock isn't held during a scan, so an
+	/// area released meanwhile is left for reclaim() to delete.
+	vm_area_open *m_scanning;
+	bool m_scanning_released;
+
+	/// Lock for m_areas and m_scanning
+	kutil::spinlock m_lock;
+};
+
+/// Sweep the page aging clock over a batch of pages scanned from an area.
+/// A page referenced since the sweep last passed it gets a second chance,
+/// and the rest are evicted until enough have been.
+/// \arg offsets    Offsets into the area of the scanned pages, in order
+/// \arg pages      Physical addresses of the scanned pages
+/// \arg found      The number of pages scanned
+/// \arg count      The maximum number of pages to evict
+/// \arg hand       [out] If the sweep stops before the end of the batch,
+///                 receives the offset the next sweep resumes from
+/// \arg referenced Called with an offset, checks and clears whether the
+///                 page was accessed
+/// \arg evict      Called with an offset and physical address, returns
+///                 true if the page was evicted
+/// \returns        The number of pages evicted
+template <typename Referenced, typename Evict>
+size_t
+clock_sweep(const uintptr_t *offsets, const uintptr_t *pages, size_t found,
+		size_t count, uintptr_t &hand, Referenced referenced, Evict evict)
+{
+	size_t evicted = 0;
+	for (size_t i = 0; i < found; ++i) {
+		if (evicted == count) {
+			hand = offsets[i];
+			break;
+		}
+
+		if (referenced(offsets[i]))
+			continue;
+
+		if (evict(offsets[i], pages[i]))
+			++evicted;
+	}
+	return evicted;
+}
+
+/// Kernel task that keeps free memory above the low watermark by
+/// evicting pages to swap
+void reclaimer_task();
@@ -0,0 +1,74 @@
+#include "kutil/assert.h"
+#include "block_device.h"
+#include "kernel_memory.h"
+#include "swap_device.h"
+
+using memory::frame_size;
+
+swap_device::swap_device(block_device *device) :
+	m_device {device},
+	m_slots {device->size() / frame_size},
+	m_free {m_slots},
+	m_hint {0}
+{
+	size_t words = (m_slots + 63) / 64;
+	m_used.set_size(words);
+	for (size_t i = 0; i < words; ++i)
+		m_used[i] = 0;
+
+	// Mark the slots past the end of the device in the last word as used
+	if (m_slots % 64)
+		m_used[words - 1] = ~0ull << (m_slots % 64);
+}
+
+bool
+swap_device::allocate(uint32_t &slot)
+{
+	kutil::scoped_lock lock {m_lock};
+	if (!m_free)
+		return false;
+
+	size_t words = m_used.count();
+	for (size_t i = 0; i < words; ++i) {
+		size_t w = (m_hint + i) % words;
+		uint64_t bits = m_used[w];
+		if (bits == ~0ull)
+			continue;
+
+		unsigned bit = __builtin_ctzll(~bits);
+		m_used[w] = bits | (1ull << bit);
+		m_hint = w;
+		--m_free;
+
+		slot = w * 64 + bit;
+		return true;
+	}
+
+	return false;
+}
+
+void
+swap_device::free(uint32_t slot)
+{
+	kutil::scoped_lock lock {m_lock};
+	kassert(slot < m_slots, "Freeing a swap slot past the end of the device");
+
+	uint64_t bit = 1ull << (slot % 64);
+	kassert(m_used[slot / 64] & bit, "Freeing an unused swap slot");
+	m_used[slot / 64] &= ~bit;
+	++m_free;
+}
+
+bool
+swap_device::write(uint32_t slot, const void *page)
+{
+	size_t n = m_device->write(slot * frame_size, frame_size, page);
+	return n == frame_size;
+}
+
+bool
+swap_device::read(uint32_t slot, void *page)
+{
+	size_t n = m_device->read(slot * frame_size, frame_size, page);
+	return n == frame_size;
+}
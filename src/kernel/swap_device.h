@@ -0,0 +1,60 @@
+#pragma once
+/// \file swap_device.h
+/// A block device divided into page-sized slots, to hold evicted pages
+
+#include <stddef.h>
+#include <stdint.h>
+#include "kutil/spinlock.h"
+#include "kutil/vector.h"
+
+class block_device;
+
+/// A block device used to hold pages evicted from memory, divided
+/// into page-sized slots
+class swap_device
+{
+public:
+	/// Constructor.
+	/// \arg device  The block device backing this swap space
+	swap_device(block_device *device);
+
+	/// Get the total number of slots on this device
+	inline size_t slots() const { return m_slots; }
+
+	/// Get the number of unused slots on this device
+	inline size_t free_slots() const { return m_free; }
+
+	/// Reserve an unused slot.
+	/// \arg slot  [out] Receives the index of the slot
+	/// \returns   False if no slots are free
+	bool allocate(uint32_t &slot);
+
+	/// Return a slot to the unused pool.
+	/// \arg slot  The index of the slot
+	void free(uint32_t slot);
+
+	/// Write a page out to a slot.
+	/// \arg slot  The index of the slot
+	/// \arg page  The page to write
+	/// \returns   True if the whole page was written
+	bool write(uint32_t slot, const void *page);
+
+	/// Read a page in from a slot.
+	/// \arg slot  The index of the slot
+	/// \arg page  The page to fill
+	/// \returns   True if the whole page was read
+	bool read(uint32_t slot, void *page);
+
+private:
+	block_device *m_device;
+	size_t m_slots;
+	size_t m_free;
+
+	/// Word of m_used to start searching for free slots
+	size_t m_hint;
+
+	/// Bitmap of slots in use
+	kutil::vector<uint64_t> m_used;
+
+	kutil::spinlock m_lock;
+};
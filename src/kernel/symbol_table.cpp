@@ -24,7 +24,7 @@ symbol_table::symbol_table(const void *data, size_t size)
 	if (!s_instance)
 		s_instance = this;
 
-	log::info(logs::boot, "Loaded %d symbol table entries at %llx", m_entries, m_data);
+	log_info(logs::boot, "Loaded %d symbol table entries at %llx", m_entries, m_data);
 }
 
 symbol_table::~symbol_table()
@@ -45,7 +45,7 @@ syscall_initialize()
 #define SYSCALL(id, name, result, ...) \
 	syscall_registry[id] = reinterpret_cast<uintptr_t>(syscalls::name); \
 	syscall_names[id] = #name; \
-	log::debug(logs::syscall, "Enabling syscall 0x%02x as " #name , id);
+	log_debug(logs::syscall, "Enabling syscall 0x%02x as " #name , id);
 #include "j6/tables/syscalls.inc"
 #undef SYSCALL
 }
@@ -29,8 +29,9 @@ object_wait(j6_handle_t handle, j6_signal_t mask, j6_signal_t *sigs)
 	if (!obj)
 		return j6_err_invalid_arg;
 
+	// Waiting on no signals polls the current ones
 	j6_signal_t current = obj->signals();
-	if ((current & mask) != 0) {
+	if (!mask || (current & mask) != 0) {
 		*sigs = current;
 		return j6_status_ok;
 	}
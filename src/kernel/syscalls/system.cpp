@@ -20,7 +20,7 @@ system_log(const char *message)
 		return j6_err_invalid_arg;
 
 	thread &th = thread::current();
-	log::info(logs::syscall, "Message[%llx]: %s", th.koid(), message);
+	log_info(logs::syscall, "Message[%llx]: %s", th.koid(), message);
 	return j6_status_ok;
 }
 
@@ -28,7 +28,7 @@ j6_status_t
 system_noop()
 {
 	thread &th = thread::current();
-	log::debug(logs::syscall, "Thread %llx called noop syscall.", th.koid());
+	log_debug(logs::syscall, "Thread %llx called noop syscall.", th.koid());
 	return j6_status_ok;
 }
 
@@ -38,12 +38,57 @@ system_get_log(j6_handle_t sys, void *buffer, size_t *size)
 	if (!size || (*size && !buffer))
 		return j6_err_invalid_arg;
 
+	system &s = system::get();
+	thread &th = thread::current();
+
+	uint8_t *out = reinterpret_cast<uint8_t*>(buffer);
 	size_t orig_size = *size;
-	*size = g_logger.get_entry(buffer, *size);
-	if (!g_logger.has_log())
-		system::get().deassert_signal(j6_signal_system_has_log);
 
-	return (*size > orig_size) ? j6_err_insufficient : j6_status_ok;
+	while (true) {
+		// Copy as many whole entries as fit
+		size_t used = 0;
+		size_t needed = 0;
+		while (true) {
+			size_t n = g_logger.get_entry(out + used, orig_size - used);
+			if (!n) break;
+			if (n > orig_size - used) {
+				needed = n;
+				break;
+			}
+			used += n;
+		}
+
+		if (!g_logger.has_log())
+			s.deassert_signal(j6_signal_system_has_log);
+
+		if (used) {
+			*size = used;
+			return j6_status_ok;
+		} else if (needed) {
+			*size = needed;
+			return j6_err_insufficient;
+		}
+
+		// The log is empty, so block until it isn't. Check again after
+		// joining the blocked list, so an entry that arrived since the
+		// check above isn't missed.
+		s.add_blocked_thread(&th);
+		if (g_logger.has_log()) {
+			s.remove_blocked_thread(&th);
+			continue;
+		}
+		th.wait_on_signals(&s, j6_signal_system_has_log);
+	}
+}
+
+j6_status_t
+system_log_sites(j6_handle_t sys, const char *file, unsigned line, unsigned enabled)
+{
+	// TODO: check capabilities on sys handle
+	if (!g_logger.set_sites_enabled(file, line, enabled != 0))
+		return j6_err_invalid_arg;
+
+	return j6_status_ok;
 }
 
 j6_status_t
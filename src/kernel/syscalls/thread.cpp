@@ -1,6 +1,7 @@
 #include "j6/errors.h"
 #include "j6/types.h"
 
+#include "futex.h"
 #include "log.h"
 #include "objects/process.h"
 #include "objects/thread.h"
@@ -19,7 +20,7 @@ thread_create(void *rip, j6_handle_t *handle)
 	child->clear_state(thread::state::loading);
 	child->set_state(thread::state::ready);
 
-	log::debug(logs::task, "Thread %llx spawned new thread %llx, handle %d",
+	log_debug(logs::task, "Thread %llx spawned new thread %llx, handle %d",
 		parent.koid(), child->koid(), *handle);
 
 	return j6_status_ok;
@@ -29,10 +30,10 @@ j6_status_t
 thread_exit(int32_t status)
 {
 	thread &th = thread::current();
-	log::debug(logs::task, "Thread %llx exiting with code %d", th.koid(), status);
+	log_debug(logs::task, "Thread %llx exiting with code %d", th.koid(), status);
 	th.exit(status);
 
-	log::error(logs::task, "returned to exit syscall");
+	log_error(logs::task, "returned to exit syscall");
 	return j6_err_unexpected;
 }
 
@@ -48,10 +49,26 @@ j6_status_t
 thread_sleep(uint64_t til)
 {
 	thread &th = thread::current();
-	log::debug(logs::task, "Thread %llx sleeping until %llu", th.koid(), til);
+	log_debug(logs::task, "Thread %llx sleeping until %llu", th.koid(), til);
 
 	th.wait_on_time(til);
 	return j6_status_ok;
 }
 
+j6_status_t
+futex_wait(const uint32_t *addr, uint32_t expected)
+{
+	return futex_table::get().wait(addr, expected);
+}
+
+j6_status_t
+futex_wake(const uint32_t *addr, size_t count, size_t *woken)
+{
+	size_t n = 0;
+	j6_status_t status = futex_table::get().wake(addr, count, n);
+	if (woken)
+		*woken = n;
+	return status;
+}
+
 } // namespace syscalls
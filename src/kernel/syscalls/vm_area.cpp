@@ -14,7 +14,7 @@ j6_status_t
 vma_create(j6_handle_t *handle, size_t size, uint32_t flags)
 {
 	vm_flags f = vm_flags::user_mask & flags;
-	construct_handle<vm_area_open>(handle, size, f);
+	construct_handle<vm_area_cow>(handle, size, f);
 	return j6_status_ok;
 }
 
@@ -22,8 +22,14 @@ j6_status_t
 vma_create_map(j6_handle_t *handle, size_t size, uintptr_t base, uint32_t flags)
 {
 	vm_flags f = vm_flags::user_mask & flags;
-	vm_area *a = construct_handle<vm_area_open>(handle, size, f);
-	process::current().space().add(base, a);
+	vm_area *a = construct_handle<vm_area_cow>(handle, size, f);
+	if (!process::current().space().add(base, a)) {
+		// Closing the only handle destroys the area
+		process::current().remove_handle(*handle);
+		*handle = j6_handle_invalid;
+		return j6_err_invalid_arg;
+	}
+
 	return j6_status_ok;
 }
 
@@ -36,7 +42,9 @@ vma_map(j6_handle_t handle, j6_handle_t proc, uintptr_t base)
 	process *p = get_handle<process>(proc);
 	if (!p) return j6_err_invalid_arg;
 
-	p->space().add(base, a);
+	if (!p->space().add(base, a))
+		return j6_err_invalid_arg;
+
 	return j6_status_ok;
 }
 
@@ -66,6 +74,44 @@ vma_resize(j6_handle_t handle, size_t *size)
 	return j6_status_ok;
 }
 
+j6_status_t
+vma_commit(j6_handle_t handle, uintptr_t offset, size_t length)
+{
+	vm_area *a = get_handle<vm_area>(handle);
+	if (!a) return j6_err_invalid_arg;
+
+	if (offset >= a->size() || length > a->size() - offset)
+		return j6_err_invalid_arg;
+
+	uintptr_t start = memory::page_align_down(offset);
+	uintptr_t end = memory::page_align_up(offset + length);
+
+	vm_space &space = process::current().space();
+	uintptr_t base = 0;
+	if (!space.find_vma(*a, base))
+		return j6_err_invalid_arg;
+
+	if (!space.commit(*a, start, (end - start) / memory::frame_size))
+		return j6_err_insufficient;
+
+	return j6_status_ok;
+}
+
+j6_status_t
+vma_clone(j6_handle_t handle, j6_handle_t *clone)
+{
+	if (!clone)
+		return j6_err_invalid_arg;
+
+	vm_area *a = get_handle<vm_area>(handle);
+	if (!a || !(a->flags() && vm_flags::cow))
+		return j6_err_invalid_arg;
+
+	vm_area_cow *c = static_cast<vm_area_cow*>(a)->clone();
+	*clone = process::current().add_handle(c);
+	return j6_status_ok;
+}
+
 
 
 } // namespace syscalls
@@ -1,5 +1,7 @@
 %include "tasking.inc"
 
+extern g_fpu_xsave
+
 global task_switch
 task_switch:
 	push rbp
@@ -12,6 +14,22 @@ task_switch:
 	push r14
 	push r15
 
+	; Save the previous task's FPU state. The kernel doesn't use the FPU
+	; or SSE registers, so they still hold the task's user state.
+	mov rcx, [gs:CPU_DATA.tcb]
+	mov rcx, [rcx + TCB.fpu]       ; rcx: current task's FPU save area
+	test rcx, rcx
+	jz .fpu_saved
+	mov eax, 0xffffffff            ; xsave every enabled component
+	mov edx, 0xffffffff
+	cmp byte [rel g_fpu_xsave], 0
+	je .fxsave
+	xsave64 [rcx]
+	jmp .fpu_saved
+.fxsave:
+	fxsave64 [rcx]
+.fpu_saved:
+
 	; Update previous task's TCB
 	mov rax, [gs:CPU_DATA.tcb]     ; rax: current task TCB
 	mov [rax + TCB.rsp], rsp
@@ -23,6 +41,21 @@ task_switch:
 	; Install next task's TCB
 	mov [gs:CPU_DATA.tcb], rdi     ; rdi: next TCB (function param)
 	mov rsp, [rdi + TCB.rsp]       ; next task's stack pointer
+
+	; Restore the next task's FPU state
+	mov rcx, [rdi + TCB.fpu]       ; rcx: next task's FPU save area
+	test rcx, rcx
+	jz .fpu_restored
+	mov eax, 0xffffffff
+	mov edx, 0xffffffff
+	cmp byte [rel g_fpu_xsave], 0
+	je .fxrstor
+	xrstor64 [rcx]
+	jmp .fpu_restored
+.fxrstor:
+	fxrstor64 [rcx]
+.fpu_restored:
+
 	mov rax, 0x00003fffffffffff
 	and rax, [rdi + TCB.pml4]      ; rax: next task's pml4 (phys portion of address)
 
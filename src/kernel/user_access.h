@@ -0,0 +1,19 @@
+#pragma once
+/// \file user_access.h
+/// Reading user memory where a page fault can't be handled
+
+#include <stdint.h>
+
+extern "C" {
+	/// Read a word of user memory without faulting it in. For use with
+	/// spinlocks held, where the fault handler must not run.
+	/// \arg addr  The user address to read
+	/// \arg out   [out] Receives the value read
+	/// \returns   False if the page was not present or not readable
+	bool read_user_u32(const uint32_t *addr, uint32_t *out);
+
+	/// The instruction in read_user_u32 that may fault, and where to
+	/// resume if it does. Used by the page fault handler.
+	void read_user_u32_load();
+	void read_user_u32_fixup();
+}
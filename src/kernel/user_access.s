@@ -0,0 +1,18 @@
+; bool read_user_u32(const uint32_t *addr, uint32_t *out)
+;
+; The load from addr is the only instruction that may fault. The page fault
+; handler checks for a fault there, and resumes at the fixup instead of
+; trying to map the page in.
+global read_user_u32
+global read_user_u32_load
+global read_user_u32_fixup
+read_user_u32:
+read_user_u32_load:
+	mov eax, [rdi]
+	mov [rsi], eax
+	mov eax, 1
+	ret
+
+read_user_u32_fixup:
+	xor eax, eax
+	ret
@@ -1,15 +1,54 @@
+#include "cpu.h"
 #include "frame_allocator.h"
 #include "kernel_memory.h"
 #include "log.h"
 #include "objects/process.h"
 #include "objects/thread.h"
 #include "objects/vm_area.h"
+#include "swap.h"
 #include "vm_space.h"
 
 // The initial memory for the array of areas for the kernel space
 constexpr size_t num_kernel_areas = 8;
 static uint64_t kernel_areas[num_kernel_areas * 2];
 
+// Size of the aligned window of already-present pages mapped around
+// a faulting page
+constexpr size_t fault_around_pages = 16;
+
+// Number of pages allocated ahead of a sequential access pattern
+constexpr size_t fault_ahead_pages = 16;
+
+// Number of pages commit() maps at a time, dropping the space lock
+// between batches
+constexpr size_t commit_batch_pages = 64;
+
+static page_table::flag
+page_flags(const vm_area &vma, bool kernel)
+{
+	return
+		page_table::flag::present |
+		(kernel ? page_table::flag::none : page_table::flag::user) |
+		((vma.flags() && vm_flags::write) ? page_table::flag::write : page_table::flag::none) |
+		((vma.flags() && vm_flags::write_combine) ? page_table::flag::wc : page_table::flag::none);
+}
+
+// Drop write access from the flags for pages that are currently shared
+// copy-on-write
+static inline page_table::flag
+cow_flags(const vm_area &vma, uintptr_t phys, page_table::flag flags)
+{
+	if ((vma.flags() && vm_flags::cow) && vma.is_shared(phys))
+		return flags & ~page_table::flag::write;
+	return flags;
+}
+
+static inline void
+invalidate_page(uintptr_t addr)
+{
+	__asm__ __volatile__ ( "invlpg (%0)" :: "r" (addr) : "memory" );
+}
+
 int
 vm_space::area::compare(const vm_space::area &o) const
 {
@@ -29,11 +68,17 @@ vm_space::area::operator==(const vm_space::area &o) const
 vm_space::vm_space(page_table *p) :
 	m_kernel {true},
 	m_pml4 {p},
-	m_areas {reinterpret_cast<vm_space::area*>(kernel_areas), 0, num_kernel_areas}
+	m_fault_start {0},
+	m_fault_end {0},
+	m_areas {reinterpret_cast<vm_space::area*>(kernel_areas), 0, num_kernel_areas},
+	m_last_hit {0}
 {}
 
 vm_space::vm_space() :
-	m_kernel {false}
+	m_kernel {false},
+	m_fault_start {0},
+	m_fault_end {0},
+	m_last_hit {0}
 {
 	m_pml4 = page_table::get_table_page();
 	page_table *kpml4 = kernel_space().m_pml4;
@@ -69,93 +114,165 @@ vm_space::kernel_space()
 bool
 vm_space::add(uintptr_t base, vm_area *area)
 {
-	//TODO: check for collisions
+	kutil::scoped_lock lock {m_lock};
+	if (collides(base, area->size()) || !area->add_to(this))
+		return false;
+
 	m_areas.sorted_insert({base, area});
-	area->add_to(this);
 	area->handle_retain();
 	return true;
 }
 
 bool
-vm_space::remove(vm_area *area)
+vm_space::collides(uintptr_t base, size_t size) const
 {
+	uintptr_t end = base + size;
+	uintptr_t space_end = is_kernel() ?
+		uint64_t(-1) : 0x7fffffffffff;
+	if (end < base || end > space_end)
+		return true;
+
 	for (auto &a : m_areas) {
-		if (a.area == area) {
-			bool free = area->remove_from(this);
-			clear(*area, 0, memory::page_count(area->size()), free);
-			m_areas.remove(a);
-			area->handle_release();
+		if (a.base >= end)
+			break;
+		if (a.base + a.area->size() > base)
 			return true;
-		}
 	}
 	return false;
 }
 
 bool
-vm_space::can_resize(const vm_area &vma, size_t size) const
+vm_space::remove(vm_area *area)
 {
 	uintptr_t base = 0;
-	unsigned n = m_areas.count();
-	for (unsigned i = 0; i < n - 1; ++i) {
-		const area &prev = m_areas[i - 1];
-		if (prev.area != &vma)
-			continue;
+	if (!find_vma(*area, base))
+		return false;
+
+	// clear() shoots down TLBs, so it can't be done under m_lock
+	bool free = area->remove_from(this);
+	clear(*area, 0, memory::page_count(area->size()), free);
 
-		base = prev.base;
-		const area &next = m_areas[i];
-		if (prev.base + size > next.base)
+	{
+		kutil::scoped_lock lock {m_lock};
+		if (!find_vma(*area, base))
 			return false;
+		m_areas.remove({base, area});
 	}
 
+	area->handle_release();
+	return true;
+}
+
+bool
+vm_space::can_resize(const vm_area &vma, size_t size) const
+{
+	uintptr_t base = 0;
+	unsigned index = 0;
+	if (!find_vma(vma, base, &index))
+		return false;
+
 	uintptr_t end = base + size;
+
+	// Areas are sorted by base, so only the following area can collide
+	unsigned i = index + 1;
+	if (i < m_areas.count() && end > m_areas[i].base)
+		return false;
+
 	uintptr_t space_end = is_kernel() ?
 		uint64_t(-1) : 0x7fffffffffff;
 
 	return end <= space_end;
 }
 
+int
+vm_space::find_index(uintptr_t addr) const
+{
+	unsigned n = m_areas.count();
+
+	// m_last_hit is only a hint, and other threads may update it while
+	// this one is looking, so only read it once
+	unsigned hint = __atomic_load_n(&m_last_hit, __ATOMIC_RELAXED);
+	if (hint < n) {
+		const area &a = m_areas[hint];
+		if (addr >= a.base && addr < a.base + a.area->size())
+			return hint;
+	}
+
+	// Find the last area starting at or below addr
+	unsigned lo = 0;
+	unsigned hi = n;
+	while (lo < hi) {
+		unsigned mid = lo + (hi - lo) / 2;
+		if (m_areas[mid].base <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (!lo)
+		return -1;
+
+	const area &a = m_areas[lo - 1];
+	if (addr >= a.base + a.area->size())
+		return -1;
+
+	unsigned found = lo - 1;
+	__atomic_store_n(&m_last_hit, found, __ATOMIC_RELAXED);
+	return found;
+}
+
 vm_area *
 vm_space::get(uintptr_t addr, uintptr_t *base)
 {
-	for (auto &a : m_areas) {
-		uintptr_t end = a.base + a.area->size();
-		if (addr >= a.base && addr < end) {
-			if (base) *base = a.base;
-			return a.area;
-		}
-	}
-	return nullptr;
+	int i = find_index(addr);
+	if (i < 0)
+		return nullptr;
+
+	const area &a = m_areas[i];
+	if (base) *base = a.base;
+	return a.area;
 }
 
 bool
-vm_space::find_vma(const vm_area &vma, uintptr_t &base) const
+vm_space::find_vma(const vm_area &vma, uintptr_t &base, unsigned *index) const
 {
-	for (auto &a : m_areas) {
+	unsigned n = m_areas.count();
+	unsigned hint = __atomic_load_n(&m_last_hit, __ATOMIC_RELAXED);
+	if (hint < n && m_areas[hint].area == &vma) {
+		base = m_areas[hint].base;
+		if (index) *index = hint;
+		return true;
+	}
+
+	for (unsigned i = 0; i < n; ++i) {
+		const area &a = m_areas[i];
 		if (a.area != &vma) continue;
 		base = a.base;
+		if (index) *index = i;
+		__atomic_store_n(&m_last_hit, i, __ATOMIC_RELAXED);
 		return true;
 	}
 	return false;
 }
 
 void
-vm_space::copy_from(const vm_space &source, const vm_area &vma)
+vm_space::clone_from(vm_space &source)
 {
-	uintptr_t to = 0;
-	uintptr_t from = 0;
-	if (!find_vma(vma, from) || !source.find_vma(vma, from))
-		return;
+	kassert(!is_kernel() && !source.is_kernel(), "Cannot clone the kernel space");
 
-	size_t count = memory::page_count(vma.size());
-	page_table::iterator dit {to, m_pml4};
-	page_table::iterator sit {from, source.m_pml4};
+	for (auto &a : source.m_areas) {
+		vm_area *area = a.area;
+		if (area->flags() && vm_flags::cow)
+			area = static_cast<vm_area_cow*>(area)->clone();
+		else if (!(area->flags() && vm_flags::mmio))
+			continue;
 
-	while (count--) {
-		uint64_t &e = dit.entry(page_table::level::pt);
-		if (e & page_table::flag::present) {
-			// TODO: handle clobbering mapping
-		}
-		e = sit.entry(page_table::level::pt);
+		// Areas every process gets, like the time page, are already here
+		uintptr_t base = 0;
+		if (find_vma(*area, base))
+			continue;
+
+		add(a.base, area);
 	}
 }
 
@@ -170,18 +287,15 @@ vm_space::page_in(const vm_area &vma, uintptr_t offset, uintptr_t phys, size_t c
 		return;
 
 	uintptr_t virt = base + offset;
-	page_table::flag flags =
-		page_table::flag::present |
-		(m_kernel ? page_table::flag::none : page_table::flag::user) |
-		((vma.flags() && vm_flags::write) ? page_table::flag::write : page_table::flag::none) |
-		((vma.flags() && vm_flags::write_combine) ? page_table::flag::wc : page_table::flag::none);
+	page_table::flag flags = page_flags(vma, m_kernel);
 
 	page_table::iterator it {virt, m_pml4};
 
 	for (size_t i = 0; i < count; ++i) {
 		uint64_t &entry = it.entry(page_table::level::pt);
-		entry = (phys + i * frame_size) | flags;
-		log::debug(logs::paging, "Setting entry for %016llx: %016llx [%04llx]",
+		uintptr_t page = phys + i * frame_size;
+		entry = page | cow_flags(vma, page, flags);
+		log_debug(logs::paging, "Setting entry for %016llx: %016llx [%04llx]",
 				it.vaddress(), (phys + i * frame_size), flags);
 		++it;
 	}
@@ -189,42 +303,211 @@ vm_space::page_in(const vm_area &vma, uintptr_t offset, uintptr_t phys, size_t c
 
 void
 vm_space::clear(const vm_area &vma, uintptr_t offset, size_t count, bool free)
+{
+	using memory::frame_size;
+
+	// Frames can't be freed while another CPU may still reach them through
+	// a stale TLB entry, so they're collected a batch of runs at a time, and
+	// freed after a shootdown.
+	constexpr size_t max_runs = 16;
+	struct run { uintptr_t start; size_t count; } runs[max_runs];
+
+	frame_allocator &fa = frame_allocator::get();
+
+	while (count) {
+		size_t run_count = 0;
+		bool cleared = false;
+
+		{
+			kutil::scoped_lock lock {m_lock};
+
+			uintptr_t base = 0;
+			if (!find_vma(vma, base))
+				return;
+
+			bool flush = active();
+			page_table::iterator it {base + offset, m_pml4};
+
+			for (; count; --count, ++it, offset += frame_size) {
+				uint64_t &e = it.entry(page_table::level::pt);
+				if (!(e & page_table::flag::present)) {
+					e = 0;
+					continue;
+				}
+
+				if (free) {
+					uintptr_t phys = e & ~0xfffull;
+					run *last = run_count ? &runs[run_count - 1] : nullptr;
+					if (last && phys == last->start + last->count * frame_size)
+						++last->count;
+					else if (run_count < max_runs)
+						runs[run_count++] = {phys, 1};
+					else
+						break;
+				}
+
+				if (flush)
+					invalidate_page(it.vaddress());
+
+				e = 0;
+				cleared = true;
+			}
+		}
+
+		if (cleared)
+			tlb_shootdown();
+
+		for (size_t i = 0; i < run_count; ++i)
+			fa.free(runs[i].start, runs[i].count);
+	}
+}
+
+size_t
+vm_space::map_missing(vm_area &vma, uintptr_t base, uintptr_t offset, size_t count, bool allocate)
 {
 	using memory::frame_size;
 	kutil::scoped_lock lock {m_lock};
 
+	page_table::flag flags = page_flags(vma, m_kernel);
+	page_table::iterator it {base + offset, m_pml4};
+
+	size_t mapped = 0;
+	size_t i = 0;
+	while (i < count) {
+		if (it.entry(page_table::level::pt) & page_table::flag::present) {
+			++it; ++i; ++mapped;
+			continue;
+		}
+
+		uintptr_t phys = 0;
+		uintptr_t off = offset + i * frame_size;
+		size_t n = allocate ?
+			vma.get_pages(off, count - i, phys) :
+			vma.find_pages(off, count - i, phys);
+
+		if (!n) {
+			// The area couldn't give a page it must have
+			if (allocate)
+				break;
+
+			++it; ++i;
+			continue;
+		}
+
+		for (size_t j = 0; j < n; ++j, ++i, ++it) {
+			uint64_t &entry = it.entry(page_table::level::pt);
+			if (!(entry & page_table::flag::present)) {
+				uintptr_t page = phys + j * frame_size;
+				entry = page | cow_flags(vma, page, flags);
+			}
+			++mapped;
+		}
+	}
+
+	return mapped;
+}
+
+bool
+vm_space::commit(vm_area &vma, uintptr_t offset, size_t count)
+{
+	using memory::frame_size;
+
 	uintptr_t base = 0;
 	if (!find_vma(vma, base))
-		return;
+		return false;
+
+	size_t pages = memory::page_align_up(vma.size()) / frame_size;
+	size_t first = offset / frame_size;
+	if (first >= pages)
+		return true;
 
-	uintptr_t addr = base + offset;
-	uintptr_t free_start = 0;
-	size_t free_count = 0;
+	if (count > pages - first)
+		count = pages - first;
 
 	frame_allocator &fa = frame_allocator::get();
-	page_table::iterator it {addr, m_pml4};
-
-	while (count--) {
-		uint64_t &e = it.entry(page_table::level::pt);
-		uintptr_t phys = e & ~0xfffull;
-
-		if (e & page_table::flag::present) {
-			if (free_count && phys == free_start + (free_count * frame_size)) {
-				++free_count;
-			} else {
-				if (free && free_count)
-					fa.free(free_start, free_count);
-				free_start = phys;
-				free_count = 1;
-			}
+	uintptr_t off = first * frame_size;
+
+	while (count) {
+		size_t n = count < commit_batch_pages ? count : commit_batch_pages;
+
+		// Leave the last free frames to page faults instead of running
+		// the frame allocator dry
+		if (fa.free_count() < page_reclaimer::min_watermark + n)
+			return false;
+
+		// map_missing() can't allocate evicted pages, and reading them
+		// back in is I/O, so it's done before taking any locks
+		for (size_t i = 0; i < n; ++i)
+			if (!vma.load_page(off + i * frame_size))
+				return false;
+
+		size_t mapped = map_missing(vma, base, off, n, true);
+		if (mapped < n) {
+			// A page evicted again before it could be mapped is read
+			// back in on another pass
+			if (vma.is_evicted(off + mapped * frame_size))
+				continue;
+			return false;
 		}
 
-		e = 0;
-		++it;
+		off += n * frame_size;
+		count -= n;
+	}
+
+	return true;
+}
+
+void
+vm_space::write_protect(const vm_area &vma, uintptr_t offset, size_t count)
+{
+	using memory::frame_size;
+
+	{
+		kutil::scoped_lock lock {m_lock};
+
+		uintptr_t base = 0;
+		if (!find_vma(vma, base))
+			return;
+
+		bool flush = active();
+		page_table::iterator it {base + offset, m_pml4};
+
+		while (count--) {
+			uint64_t &e = it.entry(page_table::level::pt);
+			if ((e & page_table::flag::present) && (e & page_table::flag::write)) {
+				e &= ~static_cast<uint64_t>(page_table::flag::write);
+				if (flush)
+					invalidate_page(it.vaddress());
+			}
+			++it;
+		}
 	}
 
-	if (free && free_count)
-		fa.free(free_start, free_count);
+	// Other CPUs running this space may still have writable entries
+	// cached, and would write straight into the shared frames
+	tlb_shootdown();
+}
+
+bool
+vm_space::clear_accessed(const vm_area &vma, uintptr_t offset)
+{
+	kutil::scoped_lock lock {m_lock};
+
+	uintptr_t base = 0;
+	if (!find_vma(vma, base))
+		return false;
+
+	page_table::iterator it {base + offset, m_pml4};
+	uint64_t &e = it.entry(page_table::level::pt);
+
+	constexpr uint64_t accessed = static_cast<uint64_t>(page_table::flag::accessed);
+	if (!(e & page_table::flag::present) || !(e & accessed))
+		return false;
+
+	e &= ~accessed;
+	if (active())
+		invalidate_page(it.vaddress());
+	return true;
 }
 
 uintptr_t
@@ -263,25 +546,77 @@ vm_space::initialize_tcb(TCB &tcb)
 bool
 vm_space::handle_fault(uintptr_t addr, fault_type fault)
 {
-	// TODO: Handle more fult types
-	if (fault && fault_type::present)
-		return false;
-
 	uintptr_t base = 0;
 	vm_area *area = get(addr, &base);
 	if (!area)
 		return false;
 
-	uintptr_t offset = (addr & ~0xfffull) - base;
-	uintptr_t phys_page = 0;
-	if (!area->get_page(offset, phys_page))
+	using memory::frame_size;
+	uintptr_t page = memory::page_align_down(addr);
+	uintptr_t offset = page - base;
+
+	// TODO: Handle more fult types
+	if (fault && fault_type::present) {
+		// The only present fault handled is a write to a page that is
+		// shared copy-on-write.
+		if (!(fault && fault_type::write) || !(area->flags() && vm_flags::write))
+			return false;
+
+		// The write is retried, and faults in the private copy
+		if (area->unshare_page(offset))
+			return true;
+
+		// The page was evicted under this fault, so fault it back in
+		return area->is_evicted(offset);
+	}
+
+	// Reading an evicted page back in is I/O, so it's done before taking
+	// any locks
+	if (!area->load_page(offset))
 		return false;
 
-	void *mem = memory::to_virtual<void>(phys_page);
-	if (area->flags() && vm_flags::zero)
-		kutil::memset(mem, 0, memory::frame_size);
+	size_t index = offset / frame_size;
+	size_t pages = memory::page_align_up(area->size()) / frame_size;
+
+	// A fault landing just past the pages mapped by the previous fault
+	// means sequential access, so allocate ahead in that direction.
+	size_t ahead = 1;
+	size_t behind = 0;
+	if (area->can_fault_ahead()) {
+		constexpr size_t window = fault_ahead_pages * frame_size;
+		if (page >= m_fault_end && page < m_fault_end + window) {
+			ahead = pages - index;
+			if (ahead > fault_ahead_pages)
+				ahead = fault_ahead_pages;
+		} else if (page < m_fault_start && page + window >= m_fault_start) {
+			behind = index < fault_ahead_pages - 1 ? index : fault_ahead_pages - 1;
+		}
+	}
+
+	// Look up or allocate the pages under the space lock, so the reclaimer
+	// can't evict them before they're mapped
+	size_t n = map_missing(*area, base, offset, ahead, true);
+	if (!n) {
+		// An evicted page that's being read in by another thread, or that
+		// was evicted again before it could be mapped, is picked up by
+		// faulting again
+		return area->is_evicted(offset);
+	}
+
+	uintptr_t start = offset - behind * frame_size;
+	if (behind)
+		map_missing(*area, base, start, behind, true);
+
+	m_fault_start = base + start;
+	m_fault_end = page + n * frame_size;
+
+	// Map in any neighbouring pages the area already has
+	size_t around = index & ~(fault_around_pages - 1);
+	size_t around_count = pages - around;
+	if (around_count > fault_around_pages)
+		around_count = fault_around_pages;
+	map_missing(*area, base, around * frame_size, around_count, false);
 
-	page_in(*area, offset, phys_page, 1);
 	return true;
 }
 
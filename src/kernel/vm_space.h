@@ -28,7 +28,8 @@ public:
 	/// Add a virtual memorty area to this address space
 	/// \arg base  The starting address of the area
 	/// \arg area  The area to add
-	/// \returns   True if the add succeeded
+	/// \returns   True if the add succeeded, false if the area would
+	///            overlap another or fall outside of this space
 	bool add(uintptr_t base, vm_area *area);
 
 	/// Remove a virtual memory area from this address space
@@ -55,16 +56,52 @@ public:
 	/// \arg count  The number of contiugous physical pages to map
 	void page_in(const vm_area &area, uintptr_t offset, uintptr_t phys, size_t count);
 
-	/// Clear mappings from the given region
+	/// Clear mappings from the given region, and shoot down the TLBs of
+	/// other CPUs. Must be called with no spinlocks held.
 	/// \arg area   The VMA these mappings applies to
 	/// \arg offset Offset of the starting virutal address from the VMA base
 	/// \arg count  The number of pages worth of mappings to clear
 	/// \arg free   If true, free the pages back to the system
 	void clear(const vm_area &vma, uintptr_t start, size_t count, bool free = false);
 
+	/// Allocate and map any missing pages in a range of the given area.
+	/// Pages are mapped in batches, and committing stops early rather than
+	/// exhaust free memory.
+	/// \arg vma    The VMA to commit pages for
+	/// \arg offset Offset of the start of the range from the VMA base
+	/// \arg count  The number of pages in the range
+	/// \returns    True if every page in the range is now mapped
+	bool commit(vm_area &vma, uintptr_t offset, size_t count);
+
+	/// Clear the accessed bit of a page's mapping, for page aging
+	/// \arg vma    The VMA the mapping applies to
+	/// \arg offset Offset of the page from the VMA base
+	/// \returns    True if the page had been accessed since the last call
+	bool clear_accessed(const vm_area &vma, uintptr_t offset);
+
+	/// Remove write access from the present mappings in a region, and shoot
+	/// down the TLBs of other CPUs. Must be called with no spinlocks held.
+	/// \arg vma    The VMA these mappings applies to
+	/// \arg offset Offset of the starting virutal address from the VMA base
+	/// \arg count  The number of pages worth of mappings to protect
+	void write_protect(const vm_area &vma, uintptr_t offset, size_t count);
+
+	/// Populate this space with the areas of another space. Copy-on-write
+	/// areas are cloned and mmio areas are shared; other areas, like
+	/// thread stacks, are not carried over.
+	/// \arg source The space to clone
+	void clone_from(vm_space &source);
+
 	/// Look up the address of a given VMA's offset
 	uintptr_t lookup(const vm_area &vma, uintptr_t offset);
 
+	/// Find a given VMA in this address space
+	/// \arg vma   The VMA to find
+	/// \arg base  [out] Receives the base address of the VMA
+	/// \arg index [out] If not null, receives the index of the VMA in m_areas
+	/// \returns   True if the VMA is mapped in this space
+	bool find_vma(const vm_area &vma, uintptr_t &base, unsigned *index = nullptr) const;
+
 	/// Check if this space is the current active space
 	bool active() const;
 
@@ -109,26 +146,57 @@ private:
 	friend class vm_area;
 	friend class vm_mapper_multi;
 
-	/// Find a given VMA in this address space
-	bool find_vma(const vm_area &vma, uintptr_t &base) const;
+	/// Find the area containing the given address
+	/// \arg addr  The address to check
+	/// \returns   The index of the area in m_areas, or -1 if not found
+	int find_index(uintptr_t addr) const;
 
 	/// Check if a VMA can be resized
 	bool can_resize(const vm_area &vma, size_t size) const;
 
-	/// Copy a range of mappings from the given address space 
-	void copy_from(const vm_space &source, const vm_area &vma);
+	/// Map pages of an area into any non-present entries of a range.
+	/// \arg vma      The VMA being mapped
+	/// \arg base     The base address of the VMA in this space
+	/// \arg offset   Offset of the start of the range from the VMA base
+	/// \arg count    The number of pages in the range
+	/// \arg allocate If false, only map pages the area already has.
+	///               If true, stop at the first page that can't be had.
+	/// \returns      The number of pages in the range that are now mapped
+	size_t map_missing(vm_area &vma, uintptr_t base, uintptr_t offset, size_t count, bool allocate);
 
 	bool m_kernel;
 	page_table *m_pml4;
 
+	/// Range of addresses mapped by the last fault, used to detect
+	/// sequential access
+	uintptr_t m_fault_start;
+	uintptr_t m_fault_end;
+
+	/// Check if a range of addresses overlaps any area in this space, or
+	/// falls outside of it. m_lock must be held.
+	/// \arg base  The starting address of the range
+	/// \arg size  The size of the range in bytes
+	/// \returns   True if the range can't be used for a new area
+	bool collides(uintptr_t base, size_t size) const;
+
 	struct area {
 		uintptr_t base;
 		vm_area *area;
 		int compare(const struct area &o) const;
 		bool operator==(const struct area &o) const;
 	};
+
+	/// The areas mapped into this space, sorted by base address. Only
+	/// add() and remove() change it, with m_lock held. The lookups on the
+	/// fault path, find_index(), get() and find_vma(), read it without
+	/// m_lock so faults don't contend with each other.
 	kutil::vector<area> m_areas;
 
+	/// Index into m_areas of the last area found, checked first on
+	/// every lookup since faults tend to hit the same area repeatedly.
+	/// Only a hint: it's read and written without m_lock.
+	mutable unsigned m_last_hit;
+
 	kutil::spinlock m_lock;
 };
 
@@ -0,0 +1,179 @@
+#include "j6/signals.h"
+#include "kutil/memory.h"
+#include "frame_allocator.h"
+#include "interrupts.h"
+#include "kernel_memory.h"
+#include "log.h"
+#include "objects/thread.h"
+#include "swap.h"
+#include "zero_pool.h"
+
+using memory::frame_size;
+
+static zero_pool g_zero_pool;
+
+static inline uintptr_t
+to_phys(void *p)
+{
+	return reinterpret_cast<uintptr_t>(p) & ~memory::page_offset;
+}
+
+zero_pool::zero_pool() :
+	m_zeroed {nullptr},
+	m_dirty {nullptr},
+	m_zeroed_count {0},
+	m_dirty_count {0},
+	m_running {false}
+{
+}
+
+zero_pool &
+zero_pool::get()
+{
+	return g_zero_pool;
+}
+
+size_t
+zero_pool::take(size_t count, uintptr_t &phys)
+{
+	run *whole = nullptr;
+	size_t n = 0;
+	size_t left = 0;
+
+	{
+		interrupt_guard guard;
+		kutil::scoped_lock lock {m_lock};
+
+		run *r = m_zeroed;
+		if (!r)
+			return 0;
+
+		if (r->count <= count) {
+			// Take the whole run, header and all
+			m_zeroed = r->next;
+			n = r->count;
+			phys = to_phys(r);
+			whole = r;
+		} else {
+			// Take frames from the end of the run, leaving its header
+			n = count;
+			r->count -= n;
+			phys = to_phys(r) + r->count * frame_size;
+		}
+
+		m_zeroed_count -= n;
+		left = m_zeroed_count;
+	}
+
+	if (whole) {
+		whole->next = nullptr;
+		whole->count = 0;
+	}
+
+	if (left < target_frames / 2)
+		wake();
+
+	return n;
+}
+
+void
+zero_pool::recycle(uintptr_t phys, size_t count)
+{
+	{
+		interrupt_guard guard;
+		kutil::scoped_lock lock {m_lock};
+
+		if (m_zeroed_count + m_dirty_count < max_frames) {
+			run *r = memory::to_virtual<run>(phys);
+			r->next = m_dirty;
+			r->count = count;
+			m_dirty = r;
+			m_dirty_count += count;
+			count = 0;
+		}
+	}
+
+	if (count)
+		frame_allocator::get().free(phys, count);
+	else
+		wake();
+}
+
+bool
+zero_pool::zero_one()
+{
+	run *r = nullptr;
+	{
+		interrupt_guard guard;
+		kutil::scoped_lock lock {m_lock};
+
+		r = m_dirty;
+		if (r) {
+			m_dirty = r->next;
+			m_dirty_count -= r->count;
+		} else if (m_zeroed_count >= target_frames) {
+			return false;
+		}
+	}
+
+	frame_allocator &fa = frame_allocator::get();
+	size_t n = 0;
+	if (r) {
+		n = r->count;
+	} else {
+		// Don't hold on to frames the reclaimer is trying to free up
+		if (fa.free_count() < page_reclaimer::high_watermark + fill_batch)
+			return false;
+
+		uintptr_t phys = 0;
+		n = fa.allocate(fill_batch, &phys);
+		if (!n)
+			return false;
+		r = memory::to_virtual<run>(phys);
+	}
+
+	kutil::zero_nontemporal(r, n * frame_size);
+	r->count = n;
+
+	{
+		interrupt_guard guard;
+		kutil::scoped_lock lock {m_lock};
+
+		if (m_zeroed_count < max_frames) {
+			r->next = m_zeroed;
+			m_zeroed = r;
+			m_zeroed_count += n;
+			return true;
+		}
+	}
+
+	fa.free(to_phys(r), n);
+	return true;
+}
+
+void
+zero_pool::wake()
+{
+	if (m_running)
+		m_event.assert_signal(work_signal);
+}
+
+void
+zero_pool::task()
+{
+	log_info(logs::task, "Starting kernel page zeroing task");
+
+	zero_pool &pool = get();
+	pool.m_running = true;
+
+	thread &self = thread::current();
+	event &ev = pool.m_event;
+
+	while (true) {
+		ev.deassert_signal(work_signal);
+		while (pool.zero_one());
+
+		ev.add_blocked_thread(&self);
+		self.wait_on_signals(&ev, work_signal);
+	}
+}
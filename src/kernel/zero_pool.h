@@ -0,0 +1,87 @@
+#pragma once
+/// \file zero_pool.h
+/// A pool of free frames that are known to be zeroed
+
+#include <stddef.h>
+#include <stdint.h>
+#include "j6/signals.h"
+#include "kutil/spinlock.h"
+#include "objects/event.h"
+
+/// A pool of free frames known to be zeroed, so zero-fill allocations
+/// don't need to clear memory themselves. A kernel task refills the pool
+/// while CPUs are otherwise idle, zeroing frames with non-temporal stores
+/// to keep from flushing useful data out of the caches.
+class zero_pool
+{
+public:
+	/// Zeroed frames the task tries to keep in the pool
+	static constexpr size_t target_frames = 512;
+
+	/// Zeroed frames the pool may hold. Frames recycled past this are
+	/// returned to the frame allocator instead.
+	static constexpr size_t max_frames = 1024;
+
+	/// Frames the task takes from the frame allocator at once
+	static constexpr size_t fill_batch = 16;
+
+	zero_pool();
+
+	/// Get the global zeroed frame pool
+	static zero_pool & get();
+
+	/// Take zeroed frames from the pool. Only frames from one run are
+	/// returned, so the number may be less than requested, but they will
+	/// be contiguous.
+	/// \arg count  The maximum number of frames to take
+	/// \arg phys   [out] Receives the physical address of the first frame
+	/// \returns    The number of frames taken, or 0 if the pool is empty
+	size_t take(size_t count, uintptr_t &phys);
+
+	/// Give the pool a run of free frames that still need to be zeroed.
+	/// \arg phys   The physical address of the first frame
+	/// \arg count  The number of contiguous frames
+	void recycle(uintptr_t phys, size_t count);
+
+	/// Get the number of zeroed frames in the pool
+	inline size_t count() const { return m_zeroed_count; }
+
+	/// Kernel task that zeroes recycled frames, and tops up the pool from
+	/// the frame allocator while memory isn't low
+	static void task();
+
+private:
+	/// A run of contiguous frames, stored in its first frame
+	struct run
+	{
+		run *next;
+		size_t count;
+	};
+
+	/// Zero one run of recycled frames, or one batch of new frames if
+	/// there are none to recycle.
+	/// \returns  False if there was no work to do
+	bool zero_one();
+
+	/// Wake the task if it's running
+	void wake();
+
+	/// Signal on m_event that there is work for the task
+	static constexpr j6_signal_t work_signal = j7_signal_event00;
+
+	run *m_zeroed;
+	run *m_dirty;
+	size_t m_zeroed_count;
+	size_t m_dirty_count;
+
+	/// Set once the task is running and can be signalled
+	bool m_running;
+
+	/// Private to the pool, so waking the task is not part of the
+	/// system object's ABI
+	event m_event;
+
+	/// Taken with interrupts disabled, as recycling happens from
+	/// per-CPU caches
+	kutil::spinlock m_lock;
+};
@@ -91,7 +91,7 @@ cpu_id::get(uint32_t leaf, uint32_t sub) const
 bool
 cpu_id::has_feature(feature feat)
 {
-	return (m_features & (1 << static_cast<uint64_t>(feat))) != 0;
+	return (m_features & (1ull << static_cast<uint64_t>(feat))) != 0;
 }
 
 uint8_t
@@ -3,9 +3,10 @@
 /// Kernel logging facility.
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#include "kutil/bip_buffer.h"
+#include "kutil/constexpr_hash.h"
 #include "kutil/spinlock.h"
 
 namespace kutil {
@@ -16,6 +17,33 @@ enum class level : uint8_t {
 	none, debug, info, warn, error, fatal, max
 };
 
+/// A call site of one of the log_* macros. Every site that is compiled in
+/// has one of these in the log_sites section, so sites can be listed and
+/// turned on or off at runtime.
+struct site
+{
+	const char *fmt;
+	const char *file;
+	uint32_t line;
+	area_t area;
+	level severity;
+	bool enabled;
+};
+
+/// Get the lowest level compiled in for an area. Building with
+/// LOG_STATIC_LEVELS defined compiles out log_* calls below each area's
+/// default level from log_areas.inc, rather than filtering them at runtime.
+/// The kernel's define is in modules.yaml, commented out by default.
+constexpr level static_level(area_t area)
+{
+#ifdef LOG_STATIC_LEVELS
+#define LOG(name, lvl) if (area == #name ## _h) return level::lvl;
+#include "j6/tables/log_areas.inc"
+#undef LOG
+#endif
+	return level::debug;
+}
+
 class logger
 {
 public:
@@ -25,15 +53,26 @@ public:
 	/// Callback type for log flushing
 	typedef void (*flush_cb)();
 
+	/// Callback type for getting the index of the current CPU
+	typedef unsigned (*cpu_cb)();
+
+	/// Maximum number of ring buffers the log is split into
+	static constexpr unsigned max_rings = 16;
+
 	/// Default constructor. Creates a logger without a backing store.
 	/// \arg output  Immediate-mode logging output function
 	logger(immediate_cb output = nullptr);
 
-	/// Constructor. Logs are written to the given buffer.
-	/// \arg buffer  Buffer to which logs are written
+	/// Constructor. Logs are written to the given buffer, which is split
+	/// into one ring per CPU so that CPUs logging at once don't contend.
+	/// Writers reserve space in a ring with an atomic compare-and-swap,
+	/// so CPUs past the number of rings, or interrupts nesting inside
+	/// another log call, can safely share a ring.
+	/// \arg buffer  Buffer to which logs are written, which must be zeroed
 	/// \arg size    Size of `buffer`, in bytes
 	/// \arg output  Immediate-mode logging output function
-	logger(uint8_t *buffer, size_t size, immediate_cb output = nullptr);
+	/// \arg rings   Number of rings to split the buffer into
+	logger(uint8_t *buffer, size_t size, immediate_cb output = nullptr, unsigned rings = 1);
 
 	/// Register a log area for future use.
 	/// \arg area      The key for the new area
@@ -47,6 +86,29 @@ public:
 	/// Register a flush callback
 	inline void set_flush(flush_cb cb) { m_flush = cb; }
 
+	/// Register the callback that picks the ring to write to
+	inline void set_cpu(cpu_cb cb) { m_cpu = cb; }
+
+	/// Set binary mode. In binary mode, messages are stored as their
+	/// format string pointer and raw arguments, and only formatted when
+	/// read with get_entry(). Format strings must outlive the log, which
+	/// holds for string literals. Messages with floating point or %n
+	/// conversions are still formatted when logged.
+	inline void set_binary(bool binary) { m_binary = binary; }
+
+	/// Register the table of log sites, so they can be toggled at runtime
+	/// \arg begin  The first site
+	/// \arg end    One past the last site
+	inline void set_sites(site *begin, site *end) { m_sites = begin; m_sites_end = end; }
+
+	/// Turn log sites on or off.
+	/// \arg file     Suffix of the source file path of the sites to change,
+	///               or null for all files
+	/// \arg line     Line of the site to change, or 0 for all lines
+	/// \arg enabled  Whether the matching sites should log
+	/// \returns      The number of sites that matched
+	size_t set_sites_enabled(const char *file, unsigned line, bool enabled);
+
 	/// Get the default logger.
 	inline logger & get() { return *s_log; }
 
@@ -81,7 +143,8 @@ public:
 		char message[0];
 	};
 
-	/// Get the next log entry from the buffer
+	/// Get the next log entry from the buffer. Entries from all rings are
+	/// returned in sequence order.
 	/// \arg buffer  The buffer to copy the log message into
 	/// \arg size    Size of the passed-in buffer, in bytes
 	/// \returns     The size of the log entry (if larger than the
@@ -89,7 +152,10 @@ public:
 	size_t get_entry(void *buffer, size_t size);
 
 	/// Get whether there is currently data in the log buffer
-	inline bool has_log() const { return m_buffer.size(); }
+	bool has_log() const;
+
+	/// Get the number of messages dropped because their ring was full
+	inline uint64_t dropped() const { return m_dropped; }
 
 private:
 	friend void debug(area_t area, const char *fmt, ...);
@@ -100,6 +166,32 @@ private:
 
 	void output(level severity, area_t area, const char *fmt, va_list args);
 
+	/// The header of a record in a ring, followed by the entry
+	struct record;
+
+	/// A ring of log records, written by any number of CPUs and read by
+	/// one reader at a time. `head` and `tail` count bytes ever reserved
+	/// and consumed, and are taken modulo `size` for buffer offsets.
+	struct alignas(64) ring
+	{
+		uint8_t *buffer;
+		size_t size;
+		uint64_t head;
+		uint64_t tail;
+
+		/// Reserve, fill, and commit a record
+		/// \arg binary  True if the entry's message is in binary form
+		/// \returns     False if the ring didn't have room
+		bool write(uint64_t sequence, const entry *ent, bool binary);
+
+		/// Get the oldest committed record, skipping padding
+		/// \returns  The record, or null if the oldest isn't committed
+		record * peek();
+
+		/// Consume the oldest record
+		void consume(record *rec);
+	};
+
 	void set_level(area_t area, level l);
 	level get_level(area_t area);
 
@@ -108,10 +200,19 @@ private:
 	const char *m_names[num_areas];
 	immediate_cb m_immediate;
 	flush_cb m_flush;
+	cpu_cb m_cpu;
+	bool m_binary;
+
+	site *m_sites;
+	site *m_sites_end;
 
-	uint8_t m_sequence;
+	uint64_t m_sequence;
+	uint64_t m_dropped;
 
-	kutil::bip_buffer m_buffer;
+	ring m_rings[max_rings];
+	unsigned m_ring_count;
+
+	/// Serializes readers, and immediate-mode output
 	kutil::spinlock m_lock;
 
 	static logger *s_log;
@@ -127,9 +228,28 @@ void fatal(area_t area, const char *fmt, ...);
 } // namespace log
 
 namespace logs {
-#define LOG(name, lvl) extern const log::area_t name;
+#define LOG(name, lvl) constexpr log::area_t name = #name ## _h;
 #include "j6/tables/log_areas.inc"
 #undef LOG
 } // namespace logs
 
 } // namespace kutil
+
+/// Log a message from a registered call site. The area must be a constant,
+/// so calls below the area's static_level() compile to nothing.
+#define KUTIL_LOG_SITE(lvl, area, fmt, ...) \
+	do { \
+		if constexpr (::kutil::log::static_level(area) <= ::kutil::log::level::lvl) { \
+			[[gnu::section("log_sites"), gnu::used]] alignas(8) \
+			static ::kutil::log::site __log_site = { \
+				fmt, __FILE__, __LINE__, area, ::kutil::log::level::lvl, true}; \
+			if (__log_site.enabled) \
+				::kutil::log::lvl(area, fmt, ##__VA_ARGS__); \
+		} \
+	} while (0)
+
+#define log_debug(area, fmt, ...) KUTIL_LOG_SITE(debug, area, fmt, ##__VA_ARGS__)
+#define log_info(area, fmt, ...)  KUTIL_LOG_SITE(info,  area, fmt, ##__VA_ARGS__)
+#define log_warn(area, fmt, ...)  KUTIL_LOG_SITE(warn,  area, fmt, ##__VA_ARGS__)
+#define log_error(area, fmt, ...) KUTIL_LOG_SITE(error, area, fmt, ##__VA_ARGS__)
+#define log_fatal(area, fmt, ...) KUTIL_LOG_SITE(fatal, area, fmt, ##__VA_ARGS__)
@@ -165,6 +165,7 @@ protected:
 
 		for (size_t i = 0; i < count; ++i) {
 			node &n = old[i];
+			if (!n.hash()) continue;
 			insert_node(n.hash(), std::move(n.key), std::move(n.val));
 			n.~node();
 		}
@@ -34,6 +34,21 @@ void * memset(void *p, uint8_t v, size_t n);
 /// \returns A pointer to the destination memory
 void * memcpy(void *dest, const void *src, size_t n);
 
+/// Copy an area of memory to another, which may overlap it
+/// \dest    The memory to copy to
+/// \src     The memory to copy from
+/// \n       The number of bytes to copy
+/// \returns A pointer to the destination memory
+void * memmove(void *dest, const void *src, size_t n);
+
+/// Zero memory with non-temporal stores, which bypass the caches. Use this
+/// for clearing whole pages that won't be touched again soon, so the clear
+/// doesn't evict more useful data.
+/// \arg p   The beginning of the memory area to clear
+/// \arg n   The size in bytes of the memory area
+/// \returns A pointer to the cleared memory
+void * zero_nontemporal(void *p, size_t n);
+
 /// Read a value of type T from a location in memory
 /// \arg p   The location in memory to read
 /// \returns The value at the given location cast to T
@@ -4,6 +4,7 @@
 
 #include "kernel_memory.h"
 #include "kutil/memory.h"
+#include "kutil/spinlock.h"
 #include "kutil/vector.h"
 
 namespace kutil {
@@ -15,17 +16,27 @@ public:
 	void * operator new(size_t size)
 	{
 		kassert(size == sizeof(T), "Slab allocator got wrong size allocation");
-		if (s_free.count() == 0)
-			allocate_chunk();
 
-		T *item = s_free.pop();
+		T *item = nullptr;
+		{
+			scoped_lock lock {s_lock};
+			if (s_free.count() == 0)
+				allocate_chunk();
+			item = s_free.pop();
+		}
+
 		kutil::memset(item, 0, sizeof(T));
 		return item;
 	}
 
-	void operator delete(void *p) { s_free.append(reinterpret_cast<T*>(p)); }
+	void operator delete(void *p)
+	{
+		scoped_lock lock {s_lock};
+		s_free.append(reinterpret_cast<T*>(p));
+	}
 
 private:
+	/// Refill the free list. Must be called with s_lock held.
 	static void allocate_chunk()
 	{
 		size_t size = N * ::memory::frame_size;
@@ -34,14 +45,18 @@ private:
 		void *memory = kalloc(size);
 		T *current = reinterpret_cast<T *>(memory); 
 		T *end = offset_pointer(current, size);
-		while (current < end)
+		while (current + 1 <= end)
 			s_free.append(current++);
 	}
 
+	/// Free list, shared by every CPU. Callers of new and delete may run
+	/// concurrently, so it is only touched with s_lock held.
 	static vector<T*> s_free;
+	static spinlock s_lock;
 };
 
 #define DEFINE_SLAB_ALLOCATOR(type, N) \
-	template<> ::kutil::vector<type*> kutil::slab_allocated<type, N>::s_free {};
+	template<> ::kutil::vector<type*> kutil::slab_allocated<type, N>::s_free {}; \
+	template<> ::kutil::spinlock kutil::slab_allocated<type, N>::s_lock {};
 
 } // namespace kutil
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "kutil/assert.h"
 #include "kutil/constexpr_hash.h"
 #include "kutil/logger.h"
@@ -7,7 +8,6 @@
 namespace kutil {
 namespace logs {
 #define LOG(name, lvl) \
-	const log::area_t name = #name ## _h; \
 	const char * name ## _name = #name;
 #include "j6/tables/log_areas.inc"
 #undef LOG
@@ -21,27 +21,216 @@ using kutil::memcpy;
 logger *logger::s_log = nullptr;
 const char *logger::s_level_names[] = {"", "debug", "info", "warn", "error", "fatal"};
 
+static constexpr uint8_t record_committed = 1;
+static constexpr uint8_t record_padding = 2;
+
+struct logger::record
+{
+	/// Size of the record in the ring, including this header
+	uint32_t bytes;
+
+	/// Zero until the record is committed. Readers zero records as
+	/// they consume them, so stale data never looks committed.
+	uint8_t state;
+
+	/// True if the entry's message is a binary_message
+	uint8_t binary;
+	uint8_t reserved[2];
+
+	// Padding records end here
+	uint64_t sequence;
+	entry ent;
+};
+
+static constexpr size_t record_header = sizeof(uint64_t);
+static inline size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+/// The message of an entry logged in binary mode: the format string, then
+/// `count` raw 64-bit arguments, then copies of any string arguments. Every
+/// integer or pointer argument takes a full 64-bit slot in a va_list, so
+/// they can be captured without knowing their exact types.
+struct binary_message
+{
+	static constexpr unsigned max_args = 12;
+
+	const char *fmt;
+	uint16_t strings; ///< Bitmask of args that are offsets into the strings
+	uint8_t count;    ///< Number of args
+	uint8_t reserved[5];
+	uint64_t args[max_args];
+
+	/// Size of the message when stored, not counting strings
+	inline size_t stored_size() const { return 16 + count * sizeof(uint64_t); }
+};
+
+/// Capture the arguments for a format string.
+/// \arg fmt      The printf-like format string
+/// \arg args     The arguments
+/// \arg msg      [out] The binary message to fill
+/// \arg strings  Buffer for copies of string arguments
+/// \arg size     [inout] Size of `strings`, set to the amount used
+/// \returns      False if the message can't be deferred
+static bool
+capture_args(const char *fmt, va_list args, binary_message &msg, char *strings, size_t &size)
+{
+	size_t used = 0;
+	msg.fmt = fmt;
+	msg.strings = 0;
+	msg.count = 0;
+
+	auto take = [&]() -> bool {
+		if (msg.count == binary_message::max_args)
+			return false;
+		msg.args[msg.count++] = va_arg(args, uint64_t);
+		return true;
+	};
+
+	const char *p = fmt;
+	while (*p) {
+		if (*p++ != '%')
+			continue;
+
+		while (*p == '0' || *p == '-' || *p == '+' || *p == ' ' || *p == '#') ++p;
+
+		if (*p == '*') {
+			if (!take()) return false;
+			++p;
+		} else {
+			while (*p >= '0' && *p <= '9') ++p;
+		}
+
+		if (*p == '.') {
+			++p;
+			if (*p == '*') {
+				if (!take()) return false;
+				++p;
+			} else {
+				while (*p >= '0' && *p <= '9') ++p;
+			}
+		}
+
+		while (*p == 'l' || *p == 'h' || *p == 't' || *p == 'j' || *p == 'z' || *p == 'L') ++p;
+
+		switch (*p) {
+		case 'd': case 'i': case 'u': case 'x': case 'X':
+		case 'o': case 'b': case 'c': case 'p':
+			if (!take()) return false;
+			break;
+
+		case 's': {
+			if (msg.count == binary_message::max_args)
+				return false;
+
+			const char *s = va_arg(args, const char *);
+			if (!s) s = "(null)";
+			size_t len = 0;
+			while (s[len]) ++len;
+			if (used + len + 1 > size)
+				return false;
+
+			memcpy(strings + used, s, len + 1);
+			msg.strings |= 1 << msg.count;
+			msg.args[msg.count++] = used;
+			used += len + 1;
+			break;
+		}
+
+		case '\0':
+			--p;
+			break;
+
+		case '%':
+			break;
+
+		case 'f': case 'F': case 'e': case 'E':
+		case 'g': case 'G': case 'a': case 'A':
+		case 'n':
+			// Floating point values are passed in different registers,
+			// and %n writes through its argument
+			return false;
+
+		default:
+			break;
+		}
+		++p;
+	}
+
+	size = used;
+	return true;
+}
+
+/// Format a binary message into text
+/// \arg message  The binary message, which may be unaligned
+/// \arg bytes    Size of the binary message and its strings
+/// \arg out      The buffer to format into
+/// \arg size     The size of `out`
+/// \returns      The length of the text, not counting the terminator
+static size_t
+format_binary(const void *message, size_t bytes, char *out, size_t size)
+{
+	binary_message msg;
+	memcpy(&msg, message, 16);
+	if (msg.stored_size() > bytes || msg.count > binary_message::max_args)
+		return 0;
+
+	memcpy(msg.args, reinterpret_cast<const uint8_t*>(message) + 16, msg.count * sizeof(uint64_t));
+	const char *strings = reinterpret_cast<const char*>(message) + msg.stored_size();
+
+	uint64_t a[binary_message::max_args] = {0};
+	for (unsigned i = 0; i < msg.count; ++i) {
+		if (msg.strings & (1 << i))
+			a[i] = reinterpret_cast<uintptr_t>(strings + msg.args[i]);
+		else
+			a[i] = msg.args[i];
+	}
+
+	// Pass every slot; the format string only reads the ones it uses
+	int n = snprintf(out, size, msg.fmt,
+			a[0], a[1], a[2], a[3], a[4], a[5],
+			a[6], a[7], a[8], a[9], a[10], a[11]);
+	return n < 0 ? 0 : (size_t(n) < size ? n : size - 1);
+}
+
 logger::logger(logger::immediate_cb output) :
-	m_buffer(nullptr, 0),
 	m_immediate(output),
 	m_flush(nullptr),
-	m_sequence(0)
+	m_cpu(nullptr),
+	m_binary(false),
+	m_sites(nullptr),
+	m_sites_end(nullptr),
+	m_sequence(0),
+	m_dropped(0),
+	m_ring_count(1)
 {
 	memset(&m_levels, 0, sizeof(m_levels));
 	memset(&m_names, 0, sizeof(m_names));
+	memset(&m_rings, 0, sizeof(m_rings));
 	s_log = this;
 }
 
-logger::logger(uint8_t *buffer, size_t size, logger::immediate_cb output) :
-	m_buffer(buffer, size),
+logger::logger(uint8_t *buffer, size_t size, logger::immediate_cb output, unsigned rings) :
 	m_immediate(output),
 	m_flush(nullptr),
-	m_sequence(0)
+	m_cpu(nullptr),
+	m_binary(false),
+	m_sites(nullptr),
+	m_sites_end(nullptr),
+	m_sequence(0),
+	m_dropped(0),
+	m_ring_count(rings)
 {
 	memset(&m_levels, 0, sizeof(m_levels));
 	memset(&m_names, 0, sizeof(m_names));
+	memset(&m_rings, 0, sizeof(m_rings));
 	s_log = this;
 
+	kassert(rings && rings <= max_rings, "Invalid number of log rings");
+	size_t ring_size = (size / rings) & ~size_t(7);
+	for (unsigned i = 0; i < rings; ++i) {
+		m_rings[i].buffer = buffer + i * ring_size;
+		m_rings[i].size = ring_size;
+	}
+
 #define LOG(name, lvl) \
 	register_area(logs::name, logs::name ## _name, log::level::lvl);
 #include "j6/tables/log_areas.inc"
@@ -78,42 +267,159 @@ logger::register_area(area_t area, const char *name, level verbosity)
 	set_level(area, verbosity);
 }
 
+/// Check if one string ends with another
+static bool
+ends_with(const char *s, const char *suffix)
+{
+	size_t len = 0, suffix_len = 0;
+	while (s[len]) ++len;
+	while (suffix[suffix_len]) ++suffix_len;
+	if (suffix_len > len)
+		return false;
+
+	s += len - suffix_len;
+	for (size_t i = 0; i < suffix_len; ++i)
+		if (s[i] != suffix[i]) return false;
+	return true;
+}
+
+size_t
+logger::set_sites_enabled(const char *file, unsigned line, bool enabled)
+{
+	size_t count = 0;
+	for (site *s = m_sites; s < m_sites_end; ++s) {
+		if (line && s->line != line)
+			continue;
+
+		if (file && !ends_with(s->file, file))
+			continue;
+
+		__atomic_store_n(&s->enabled, enabled, __ATOMIC_RELAXED);
+		++count;
+	}
+
+	return count;
+}
+
+bool
+logger::ring::write(uint64_t sequence, const entry *ent, bool binary)
+{
+	size_t total = align8(offsetof(record, ent) + ent->bytes);
+	if (!size || total > size)
+		return false;
+
+	// Reserve space for the record, and padding to the end of the buffer
+	// if it won't fit before the end
+	uint64_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	size_t pad = 0;
+	do {
+		uint64_t consumed = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+		size_t offset = pos % size;
+		pad = (offset + total > size) ? size - offset : 0;
+		if (pos + pad + total - consumed > size)
+			return false;
+	} while (!__atomic_compare_exchange_n(&head, &pos, pos + pad + total,
+				true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	if (pad) {
+		record *p = reinterpret_cast<record*>(buffer + pos % size);
+		p->bytes = pad;
+		__atomic_store_n(&p->state, record_padding, __ATOMIC_RELEASE);
+		pos += pad;
+	}
+
+	record *r = reinterpret_cast<record*>(buffer + pos % size);
+	r->bytes = total;
+	r->binary = binary;
+	r->sequence = sequence;
+	memcpy(&r->ent, ent, ent->bytes);
+	__atomic_store_n(&r->state, record_committed, __ATOMIC_RELEASE);
+	return true;
+}
+
+logger::record *
+logger::ring::peek()
+{
+	while (tail != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+		record *r = reinterpret_cast<record*>(buffer + tail % size);
+		uint8_t state = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+		if (state == record_padding) {
+			consume(r);
+			continue;
+		}
+		return state == record_committed ? r : nullptr;
+	}
+	return nullptr;
+}
+
+void
+logger::ring::consume(record *rec)
+{
+	size_t n = rec->bytes;
+	memset(rec, 0, rec->state == record_padding ? record_header : n);
+	__atomic_store_n(&tail, tail + n, __ATOMIC_RELEASE);
+}
+
 void
 logger::output(level severity, area_t area, const char *fmt, va_list args)
 {
+	uint64_t sequence = __atomic_fetch_add(&m_sequence, 1, __ATOMIC_RELAXED);
+
 	uint8_t buffer[256];
 	entry *header = reinterpret_cast<entry *>(buffer);
-	header->bytes = sizeof(entry);
 	header->area = area;
 	header->severity = severity;
-	header->sequence = m_sequence++;
+	header->sequence = sequence;
 
-	header->bytes +=
-		vsnprintf(header->message, sizeof(buffer) - sizeof(entry), fmt, args);
+	constexpr size_t max_message = sizeof(buffer) - sizeof(entry) - 1;
 
-	kutil::scoped_lock lock {m_lock};
+	bool binary = false;
+	if (m_binary && !m_immediate) {
+		// Capture from a copy, so args is untouched if this falls back
+		va_list copy;
+		va_copy(copy, args);
+
+		binary_message msg;
+		char strings[max_message];
+		size_t strings_len = sizeof(strings);
+		if (capture_args(fmt, copy, msg, strings, strings_len)) {
+			size_t stored = msg.stored_size();
+			if (stored + strings_len <= max_message) {
+				memcpy(header->message, &msg, stored);
+				memcpy(header->message + stored, strings, strings_len);
+				header->bytes = sizeof(entry) + stored + strings_len;
+				binary = true;
+			}
+		}
+		va_end(copy);
+	}
+
+	if (!binary) {
+		size_t len = vsnprintf(header->message, max_message + 1, fmt, args);
+		if (len > max_message) len = max_message;
+		header->bytes = sizeof(entry) + len;
+	}
 
 	if (m_immediate) {
+		kutil::scoped_lock lock {m_lock};
 		buffer[header->bytes] = 0;
 		m_immediate(area, severity, header->message);
 		return;
 	}
 
-	uint8_t *out;
-	size_t n = m_buffer.reserve(header->bytes, reinterpret_cast<void**>(&out));
-	if (n < sizeof(entry)) {
-		m_buffer.commit(0); // Cannot even write the header, abort
+	unsigned index = m_cpu ? m_cpu() % m_ring_count : 0;
+	if (!m_rings[index].write(sequence, header, binary)) {
+		__atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
 		return;
 	}
 
-	if (n < header->bytes)
-		header->bytes = n;
-
-	memcpy(out, buffer, n);
-	m_buffer.commit(n);
-
-	if (m_flush)
+	// Only one CPU runs the flush callback at a time. One that finds it
+	// already running skips it, since that call will wake the reader.
+	static bool flushing = false;
+	if (m_flush && !__atomic_exchange_n(&flushing, true, __ATOMIC_ACQUIRE)) {
 		m_flush();
+		__atomic_store_n(&flushing, false, __ATOMIC_RELEASE);
+	}
 }
 
 size_t
@@ -121,22 +427,55 @@ logger::get_entry(void *buffer, size_t size)
 {
 	kutil::scoped_lock lock {m_lock};
 
-	void *out;
-	size_t out_size = m_buffer.get_block(&out);
-	if (out_size == 0 || out == 0)
-		return 0;
+	// Merge the rings by taking the oldest of their oldest records
+	ring *from = nullptr;
+	record *oldest = nullptr;
+	for (unsigned i = 0; i < m_ring_count; ++i) {
+		record *r = m_rings[i].peek();
+		if (r && (!oldest || r->sequence < oldest->sequence)) {
+			from = &m_rings[i];
+			oldest = r;
+		}
+	}
 
-	kassert(out_size >= sizeof(entry), "Couldn't read a full entry");
-	if (out_size < sizeof(entry))
+	if (!oldest)
 		return 0;
 
-	entry *ent = reinterpret_cast<entry *>(out);
-	if (size >= ent->bytes) {
-		memcpy(buffer, out, ent->bytes);
-		m_buffer.consume(ent->bytes);
+	const entry *ent = &oldest->ent;
+	size_t bytes = ent->bytes;
+
+	// Binary messages are formatted here, so the reader pays for it
+	uint8_t text[256];
+	if (oldest->binary) {
+		entry *formatted = reinterpret_cast<entry *>(text);
+		*formatted = *ent;
+
+		size_t len = format_binary(ent->message, bytes - sizeof(entry),
+				formatted->message, sizeof(text) - sizeof(entry));
+		formatted->bytes = sizeof(entry) + len;
+
+		ent = formatted;
+		bytes = formatted->bytes;
+	}
+
+	if (size >= bytes) {
+		memcpy(buffer, ent, bytes);
+		from->consume(oldest);
 	}
 
-	return ent->bytes;
+	return bytes;
+}
+
+bool
+logger::has_log() const
+{
+	for (unsigned i = 0; i < m_ring_count; ++i) {
+		const ring &r = m_rings[i];
+		if (__atomic_load_n(&r.tail, __ATOMIC_RELAXED) !=
+			__atomic_load_n(&r.head, __ATOMIC_RELAXED))
+			return true;
+	}
+	return false;
 }
 
 #define LOG_LEVEL_FUNCTION(name) \
@@ -6,11 +6,182 @@ namespace std {
 
 namespace kutil {
 
+namespace {
+
+// Word types that may alias anything and sit at any alignment, so the
+// small paths can load and store through arbitrary byte pointers
+typedef uint64_t __attribute__ ((__may_alias__, __aligned__(1))) u64u;
+typedef uint32_t __attribute__ ((__may_alias__, __aligned__(1))) u32u;
+typedef uint16_t __attribute__ ((__may_alias__, __aligned__(1))) u16u;
+
+/// Size at or above which `rep movsb` / `rep stosb` beat the unrolled
+/// loops, on CPUs with enhanced rep movsb/stosb (ERMS)
+constexpr size_t rep_threshold = 512;
+
+enum class erms_state : uint8_t { unknown, absent, present };
+erms_state g_erms = erms_state::unknown;
+
+inline void
+cpuid(uint32_t leaf, uint32_t sub, uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+{
+	__asm__ __volatile__ ( "cpuid"
+		: "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+		: "a"(leaf), "c"(sub) );
+}
+
+/// Check for ERMS, CPUID.(EAX=07H,ECX=0):EBX bit 9. Checked the first
+/// time a large operation happens; racing callers all store the same value.
+bool
+has_erms()
+{
+	if (__builtin_expect(g_erms == erms_state::unknown, 0)) {
+		uint32_t a, b, c, d;
+		cpuid(0, 0, a, b, c, d);
+
+		bool erms = false;
+		if (a >= 7) {
+			cpuid(7, 0, a, b, c, d);
+			erms = (b >> 9) & 1;
+		}
+		g_erms = erms ? erms_state::present : erms_state::absent;
+	}
+	return g_erms == erms_state::present;
+}
+
+/// Copy up to 32 bytes. All loads happen before any stores, so this is
+/// safe for overlapping areas.
+inline void
+copy_small(uint8_t *d, const uint8_t *s, size_t n)
+{
+	if (n >= 16) {
+		uint64_t a = *reinterpret_cast<const u64u*>(s);
+		uint64_t b = *reinterpret_cast<const u64u*>(s + 8);
+		uint64_t c = *reinterpret_cast<const u64u*>(s + n - 16);
+		uint64_t e = *reinterpret_cast<const u64u*>(s + n - 8);
+		*reinterpret_cast<u64u*>(d) = a;
+		*reinterpret_cast<u64u*>(d + 8) = b;
+		*reinterpret_cast<u64u*>(d + n - 16) = c;
+		*reinterpret_cast<u64u*>(d + n - 8) = e;
+	} else if (n >= 8) {
+		uint64_t a = *reinterpret_cast<const u64u*>(s);
+		uint64_t b = *reinterpret_cast<const u64u*>(s + n - 8);
+		*reinterpret_cast<u64u*>(d) = a;
+		*reinterpret_cast<u64u*>(d + n - 8) = b;
+	} else if (n >= 4) {
+		uint32_t a = *reinterpret_cast<const u32u*>(s);
+		uint32_t b = *reinterpret_cast<const u32u*>(s + n - 4);
+		*reinterpret_cast<u32u*>(d) = a;
+		*reinterpret_cast<u32u*>(d + n - 4) = b;
+	} else if (n >= 2) {
+		uint16_t a = *reinterpret_cast<const u16u*>(s);
+		uint16_t b = *reinterpret_cast<const u16u*>(s + n - 2);
+		*reinterpret_cast<u16u*>(d) = a;
+		*reinterpret_cast<u16u*>(d + n - 2) = b;
+	} else if (n) {
+		*d = *s;
+	}
+}
+
+/// Copy 32 bytes, loading them all before storing any
+inline void
+copy_32(uint8_t *d, const uint8_t *s)
+{
+	uint64_t a = *reinterpret_cast<const u64u*>(s);
+	uint64_t b = *reinterpret_cast<const u64u*>(s + 8);
+	uint64_t c = *reinterpret_cast<const u64u*>(s + 16);
+	uint64_t e = *reinterpret_cast<const u64u*>(s + 24);
+	*reinterpret_cast<u64u*>(d) = a;
+	*reinterpret_cast<u64u*>(d + 8) = b;
+	*reinterpret_cast<u64u*>(d + 16) = c;
+	*reinterpret_cast<u64u*>(d + 24) = e;
+}
+
+/// Copy more than 32 bytes front to back. Safe for overlapping areas as
+/// long as d is below s.
+void
+copy_forward(uint8_t *d, const uint8_t *s, size_t n)
+{
+	if (n >= rep_threshold && has_erms()) {
+		__asm__ __volatile__ ( "rep movsb"
+			: "+D"(d), "+S"(s), "+c"(n) :: "memory" );
+		return;
+	}
+
+	// The last 32 bytes are loaded up front, as the loop may overwrite
+	// them when the areas overlap, and then stored over the loop's tail
+	uint8_t tail[32];
+	copy_32(tail, s + n - 32);
+
+	uint8_t *end = d + n - 32;
+	for (; d < end; d += 32, s += 32)
+		copy_32(d, s);
+
+	copy_32(end, tail);
+}
+
+/// Copy more than 32 bytes back to front, for overlapping areas where d
+/// is above s.
+void
+copy_backward(uint8_t *d, const uint8_t *s, size_t n)
+{
+	uint8_t head[32];
+	copy_32(head, s);
+
+	while (n > 32) {
+		n -= 32;
+		copy_32(d + n, s + n);
+	}
+
+	copy_32(d, head);
+}
+
+} // namespace
+
 void *
 memset(void *s, uint8_t v, size_t n)
 {
 	uint8_t *p = reinterpret_cast<uint8_t *>(s);
-	for (size_t i = 0; i < n; ++i) p[i] = v;
+	uint64_t w = 0x0101010101010101ull * v;
+
+	if (n >= rep_threshold && has_erms()) {
+		__asm__ __volatile__ ( "rep stosb"
+			: "+D"(p), "+c"(n) : "a"(v) : "memory" );
+		return s;
+	}
+
+	if (n >= 32) {
+		// Fill the last 32 bytes first, then the loop can stop at any
+		// point past them without handling a remainder
+		uint8_t *end = p + n - 32;
+		*reinterpret_cast<u64u*>(end) = w;
+		*reinterpret_cast<u64u*>(end + 8) = w;
+		*reinterpret_cast<u64u*>(end + 16) = w;
+		*reinterpret_cast<u64u*>(end + 24) = w;
+
+		for (; p < end; p += 32) {
+			*reinterpret_cast<u64u*>(p) = w;
+			*reinterpret_cast<u64u*>(p + 8) = w;
+			*reinterpret_cast<u64u*>(p + 16) = w;
+			*reinterpret_cast<u64u*>(p + 24) = w;
+		}
+	} else if (n >= 16) {
+		*reinterpret_cast<u64u*>(p) = w;
+		*reinterpret_cast<u64u*>(p + 8) = w;
+		*reinterpret_cast<u64u*>(p + n - 16) = w;
+		*reinterpret_cast<u64u*>(p + n - 8) = w;
+	} else if (n >= 8) {
+		*reinterpret_cast<u64u*>(p) = w;
+		*reinterpret_cast<u64u*>(p + n - 8) = w;
+	} else if (n >= 4) {
+		*reinterpret_cast<u32u*>(p) = w;
+		*reinterpret_cast<u32u*>(p + n - 4) = w;
+	} else if (n >= 2) {
+		*reinterpret_cast<u16u*>(p) = w;
+		*reinterpret_cast<u16u*>(p + n - 2) = w;
+	} else if (n) {
+		*p = v;
+	}
+
 	return s;
 }
 
@@ -19,10 +190,65 @@ memcpy(void *dest, const void *src, size_t n)
 {
 	const uint8_t *s = reinterpret_cast<const uint8_t *>(src);
 	uint8_t *d = reinterpret_cast<uint8_t *>(dest);
-	for (size_t i = 0; i < n; ++i) d[i] = s[i];
+
+	if (n <= 32)
+		copy_small(d, s, n);
+	else
+		copy_forward(d, s, n);
+
+	return d;
+}
+
+void *
+memmove(void *dest, const void *src, size_t n)
+{
+	const uint8_t *s = reinterpret_cast<const uint8_t *>(src);
+	uint8_t *d = reinterpret_cast<uint8_t *>(dest);
+
+	if (n <= 32)
+		copy_small(d, s, n);
+	else if (d <= s || d >= s + n)
+		copy_forward(d, s, n);
+	else
+		copy_backward(d, s, n);
+
 	return d;
 }
 
+void *
+zero_nontemporal(void *p, size_t n)
+{
+	uint8_t *b = reinterpret_cast<uint8_t *>(p);
+
+	// Clear any unaligned head and tail with normal stores
+	size_t head = -reinterpret_cast<uintptr_t>(b) & 31;
+	if (head > n) head = n;
+	memset(b, 0, head);
+	b += head;
+	n -= head;
+
+	size_t tail = n & 31;
+	memset(b + n - tail, 0, tail);
+
+	uint64_t *q = reinterpret_cast<uint64_t*>(b);
+	uint64_t *end = q + (n - tail) / sizeof(uint64_t);
+	const uint64_t zero = 0;
+
+	for (; q < end; q += 4) {
+		__asm__ __volatile__ (
+			"movnti %1, 0(%0);"
+			"movnti %1, 8(%0);"
+			"movnti %1, 16(%0);"
+			"movnti %1, 24(%0);"
+			:: "r" (q), "r" (zero) : "memory" );
+	}
+
+	// Non-temporal stores are weakly ordered, so make sure they're done
+	// before the memory is handed to anyone else
+	__asm__ __volatile__ ( "sfence" ::: "memory" );
+	return p;
+}
+
 uint8_t
 checksum(const void *p, size_t len, size_t off)
 {
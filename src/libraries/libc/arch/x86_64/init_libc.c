@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <j6/init.h>
 #include <j6/types.h>
+#include "j6libc/string_dispatch.h"
+#include "string_simd.h"
 
 static size_t __initc = 0;
 static struct j6_init_value *__initv = 0;
@@ -19,9 +21,58 @@ _get_init(size_t *initc, struct j6_init_value **initv)
 		*initv = __initv;
 }
 
+static void
+cpuid(uint32_t leaf, uint32_t sub, uint32_t regs[4])
+{
+	__asm__ ( "cpuid"
+		: "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+		: "a"(leaf), "c"(sub) );
+}
+
+/* Point the string routines at the best versions this CPU supports, like
+   ifunc resolvers would. These bits match cpu/features.inc. */
+static void
+_init_dispatch()
+{
+	uint32_t regs[4];
+	cpuid(0, 0, regs);
+	uint32_t max_leaf = regs[0];
+
+	cpuid(1, 0, regs);
+	int sse2 = (regs[3] >> 26) & 1;
+	int osxsave = (regs[2] >> 27) & 1;
+	int avx = (regs[2] >> 28) & 1;
+
+	int avx2 = 0;
+	if (max_leaf >= 7 && avx && osxsave) {
+		// The kernel must also have enabled saving the AVX state in XCR0
+		uint32_t xcr0_lo, xcr0_hi;
+		__asm__ ( "xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0) );
+
+		cpuid(7, 0, regs);
+		avx2 = ((regs[1] >> 5) & 1) && (xcr0_lo & 0x6) == 0x6;
+	}
+
+	if (avx2) {
+		_PDCLIB_memcpy_impl = _PDCLIB_memcpy_avx2;
+		_PDCLIB_memchr_impl = _PDCLIB_memchr_avx2;
+		_PDCLIB_memcmp_impl = _PDCLIB_memcmp_avx2;
+		_PDCLIB_strchr_impl = _PDCLIB_strchr_avx2;
+		_PDCLIB_strlen_impl = _PDCLIB_strlen_avx2;
+	} else if (sse2) {
+		_PDCLIB_memcpy_impl = _PDCLIB_memcpy_sse2;
+		_PDCLIB_memchr_impl = _PDCLIB_memchr_sse2;
+		_PDCLIB_memcmp_impl = _PDCLIB_memcmp_sse2;
+		_PDCLIB_strchr_impl = _PDCLIB_strchr_sse2;
+		_PDCLIB_strlen_impl = _PDCLIB_strlen_sse2;
+	}
+}
+
 void
 _init_libc(uint64_t *rsp)
 {
+	_init_dispatch();
+
 	uint64_t argc = *rsp++;
 	rsp += argc;
 
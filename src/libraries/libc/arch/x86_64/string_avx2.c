@@ -0,0 +1,169 @@
+/* AVX2 versions of string routines
+
+   As with the SSE2 versions, these use function target attributes, and are
+   only selected once _init_libc() has checked that both the CPU and the
+   kernel support AVX2. The compiler adds a vzeroupper before each one returns.
+
+   strlen and strchr read in aligned 32-byte blocks, which may read past
+   the end of the string but never across a page boundary.
+*/
+
+#include <stdint.h>
+#include <immintrin.h>
+#include "string_simd.h"
+
+#define AVX2 __attribute__ ((__target__("avx2")))
+
+typedef uint64_t __attribute__ ((__may_alias__, __aligned__(1))) u64u;
+typedef uint32_t __attribute__ ((__may_alias__, __aligned__(1))) u32u;
+
+/* Copy fewer than 32 bytes with overlapping moves */
+AVX2 static inline void
+copy_small( unsigned char * d, const unsigned char * s, size_t n )
+{
+	if (n >= 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + n - 16));
+		_mm_storeu_si128((__m128i *)d, a);
+		_mm_storeu_si128((__m128i *)(d + n - 16), b);
+	} else if (n >= 8) {
+		uint64_t a = *(const u64u *)s;
+		uint64_t b = *(const u64u *)(s + n - 8);
+		*(u64u *)d = a;
+		*(u64u *)(d + n - 8) = b;
+	} else if (n >= 4) {
+		uint32_t a = *(const u32u *)s;
+		uint32_t b = *(const u32u *)(s + n - 4);
+		*(u32u *)d = a;
+		*(u32u *)(d + n - 4) = b;
+	} else {
+		for (size_t i = 0; i < n; ++i)
+			d[i] = s[i];
+	}
+}
+
+AVX2 void *
+_PDCLIB_memcpy_avx2( void * s1, const void * s2, size_t n )
+{
+	unsigned char * d = s1;
+	const unsigned char * s = s2;
+
+	if (n < 32) {
+		copy_small(d, s, n);
+		return s1;
+	}
+
+	/* Load the last block first, it's stored over the loop's tail */
+	__m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+	unsigned char * end = d + n - 32;
+
+	while (d + 128 <= end) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + 0));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+		__m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+		_mm256_storeu_si256((__m256i *)(d + 0), a);
+		_mm256_storeu_si256((__m256i *)(d + 32), b);
+		_mm256_storeu_si256((__m256i *)(d + 64), c);
+		_mm256_storeu_si256((__m256i *)(d + 96), e);
+		d += 128;
+		s += 128;
+	}
+
+	for (; d < end; d += 32, s += 32)
+		_mm256_storeu_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+
+	_mm256_storeu_si256((__m256i *)end, tail);
+	return s1;
+}
+
+AVX2 void *
+_PDCLIB_memchr_avx2( const void * s, int c, size_t n )
+{
+	const unsigned char * p = s;
+	__m256i needle = _mm256_set1_epi8((char)c);
+
+	for (; n >= 32; n -= 32, p += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *)p);
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+		if (mask)
+			return (void *)(p + __builtin_ctz(mask));
+	}
+
+	for (; n; --n, ++p) {
+		if (*p == (unsigned char)c)
+			return (void *)p;
+	}
+	return NULL;
+}
+
+AVX2 int
+_PDCLIB_memcmp_avx2( const void * s1, const void * s2, size_t n )
+{
+	const unsigned char * p1 = s1;
+	const unsigned char * p2 = s2;
+
+	for (; n >= 32; n -= 32, p1 += 32, p2 += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)p1);
+		__m256i b = _mm256_loadu_si256((const __m256i *)p2);
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+		if (mask) {
+			unsigned i = __builtin_ctz(mask);
+			return p1[i] - p2[i];
+		}
+	}
+
+	for (; n; --n, ++p1, ++p2) {
+		if (*p1 != *p2)
+			return *p1 - *p2;
+	}
+	return 0;
+}
+
+AVX2 char *
+_PDCLIB_strchr_avx2( const char * s, int c )
+{
+	const char * p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+	unsigned skip = s - p;
+
+	__m256i zero = _mm256_setzero_si256();
+	__m256i needle = _mm256_set1_epi8((char)c);
+
+	/* Ignore matches in the first block from before the string starts */
+	__m256i block = _mm256_load_si256((const __m256i *)p);
+	unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(
+		_mm256_cmpeq_epi8(block, zero), _mm256_cmpeq_epi8(block, needle)));
+	mask &= 0xffffffffu << skip;
+
+	while (!mask) {
+		p += 32;
+		block = _mm256_load_si256((const __m256i *)p);
+		mask = _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(block, zero), _mm256_cmpeq_epi8(block, needle)));
+	}
+
+	/* The first match is either c or the terminator, which is also a
+	   match if c is 0 */
+	p += __builtin_ctz(mask);
+	return *p == (char)c ? (char *)p : NULL;
+}
+
+AVX2 size_t
+_PDCLIB_strlen_avx2( const char * s )
+{
+	const char * p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+	unsigned skip = s - p;
+
+	__m256i zero = _mm256_setzero_si256();
+	unsigned mask = _mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+	mask &= 0xffffffffu << skip;
+
+	while (!mask) {
+		p += 32;
+		mask = _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), zero));
+	}
+
+	return p + __builtin_ctz(mask) - s;
+}
@@ -0,0 +1,24 @@
+#pragma once
+/* SSE2 and AVX2 versions of string routines, selected by _init_libc() */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void * _PDCLIB_memcpy_sse2( void * s1, const void * s2, size_t n );
+void * _PDCLIB_memchr_sse2( const void * s, int c, size_t n );
+int _PDCLIB_memcmp_sse2( const void * s1, const void * s2, size_t n );
+char * _PDCLIB_strchr_sse2( const char * s, int c );
+size_t _PDCLIB_strlen_sse2( const char * s );
+
+void * _PDCLIB_memcpy_avx2( void * s1, const void * s2, size_t n );
+void * _PDCLIB_memchr_avx2( const void * s, int c, size_t n );
+int _PDCLIB_memcmp_avx2( const void * s1, const void * s2, size_t n );
+char * _PDCLIB_strchr_avx2( const char * s, int c );
+size_t _PDCLIB_strlen_avx2( const char * s );
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,164 @@
+/* SSE2 versions of string routines
+
+   The library is built with -mno-sse, so these use function target
+   attributes to enable SSE2 only where it's wanted. They're only selected
+   once _init_libc() has checked the CPU supports them.
+
+   strlen and strchr read in aligned 16-byte blocks, which may read past
+   the end of the string but never across a page boundary.
+*/
+
+#include <stdint.h>
+#include <emmintrin.h>
+#include "string_simd.h"
+
+#define SSE2 __attribute__ ((__target__("sse2")))
+
+typedef uint64_t __attribute__ ((__may_alias__, __aligned__(1))) u64u;
+typedef uint32_t __attribute__ ((__may_alias__, __aligned__(1))) u32u;
+
+/* Copy fewer than 16 bytes with overlapping word moves */
+static inline void
+copy_small( unsigned char * d, const unsigned char * s, size_t n )
+{
+	if (n >= 8) {
+		uint64_t a = *(const u64u *)s;
+		uint64_t b = *(const u64u *)(s + n - 8);
+		*(u64u *)d = a;
+		*(u64u *)(d + n - 8) = b;
+	} else if (n >= 4) {
+		uint32_t a = *(const u32u *)s;
+		uint32_t b = *(const u32u *)(s + n - 4);
+		*(u32u *)d = a;
+		*(u32u *)(d + n - 4) = b;
+	} else {
+		for (size_t i = 0; i < n; ++i)
+			d[i] = s[i];
+	}
+}
+
+SSE2 void *
+_PDCLIB_memcpy_sse2( void * s1, const void * s2, size_t n )
+{
+	unsigned char * d = s1;
+	const unsigned char * s = s2;
+
+	if (n < 16) {
+		copy_small(d, s, n);
+		return s1;
+	}
+
+	/* Load the last block first, it's stored over the loop's tail */
+	__m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+	unsigned char * end = d + n - 16;
+
+	while (d + 64 <= end) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + 0));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+		_mm_storeu_si128((__m128i *)(d + 0), a);
+		_mm_storeu_si128((__m128i *)(d + 16), b);
+		_mm_storeu_si128((__m128i *)(d + 32), c);
+		_mm_storeu_si128((__m128i *)(d + 48), e);
+		d += 64;
+		s += 64;
+	}
+
+	for (; d < end; d += 16, s += 16)
+		_mm_storeu_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+
+	_mm_storeu_si128((__m128i *)end, tail);
+	return s1;
+}
+
+SSE2 void *
+_PDCLIB_memchr_sse2( const void * s, int c, size_t n )
+{
+	const unsigned char * p = s;
+	__m128i needle = _mm_set1_epi8((char)c);
+
+	for (; n >= 16; n -= 16, p += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+		if (mask)
+			return (void *)(p + __builtin_ctz(mask));
+	}
+
+	for (; n; --n, ++p) {
+		if (*p == (unsigned char)c)
+			return (void *)p;
+	}
+	return NULL;
+}
+
+SSE2 int
+_PDCLIB_memcmp_sse2( const void * s1, const void * s2, size_t n )
+{
+	const unsigned char * p1 = s1;
+	const unsigned char * p2 = s2;
+
+	for (; n >= 16; n -= 16, p1 += 16, p2 += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p1);
+		__m128i b = _mm_loadu_si128((const __m128i *)p2);
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xffff;
+		if (mask) {
+			unsigned i = __builtin_ctz(mask);
+			return p1[i] - p2[i];
+		}
+	}
+
+	for (; n; --n, ++p1, ++p2) {
+		if (*p1 != *p2)
+			return *p1 - *p2;
+	}
+	return 0;
+}
+
+SSE2 char *
+_PDCLIB_strchr_sse2( const char * s, int c )
+{
+	const char * p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+	unsigned skip = s - p;
+
+	__m128i zero = _mm_setzero_si128();
+	__m128i needle = _mm_set1_epi8((char)c);
+
+	/* Ignore matches in the first block from before the string starts */
+	__m128i block = _mm_load_si128((const __m128i *)p);
+	unsigned mask = _mm_movemask_epi8(_mm_or_si128(
+		_mm_cmpeq_epi8(block, zero), _mm_cmpeq_epi8(block, needle)));
+	mask &= 0xffffu << skip;
+
+	while (!mask) {
+		p += 16;
+		block = _mm_load_si128((const __m128i *)p);
+		mask = _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(block, zero), _mm_cmpeq_epi8(block, needle)));
+	}
+
+	/* The first match is either c or the terminator, which is also a
+	   match if c is 0 */
+	p += __builtin_ctz(mask);
+	return *p == (char)c ? (char *)p : NULL;
+}
+
+SSE2 size_t
+_PDCLIB_strlen_sse2( const char * s )
+{
+	const char * p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+	unsigned skip = s - p;
+
+	__m128i zero = _mm_setzero_si128();
+	unsigned mask = _mm_movemask_epi8(
+		_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+	mask &= 0xffffu << skip;
+
+	while (!mask) {
+		p += 16;
+		mask = _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), zero));
+	}
+
+	return p + __builtin_ctz(mask) - s;
+}
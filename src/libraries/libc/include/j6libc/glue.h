@@ -28,6 +28,21 @@ _Noreturn void _PDCLIB_Exit( int status );
 */
 void * _PDCLIB_allocpages( int n );
 
+/* Map size bytes of new zero-filled memory at an address of the library's
+   choosing. Returns (void *)-1 on failure.
+*/
+void * _PDCLIB_mmap( size_t size );
+
+/* Unmap a mapping returned by _PDCLIB_mmap(), or the tail end of one.
+   Returns zero on success, -1 otherwise.
+*/
+int _PDCLIB_munmap( void * addr, size_t size );
+
+/* Return the calling thread's cached free memory to malloc's central free
+   lists, and free the cache itself. Called as the thread exits.
+*/
+void _PDCLIB_tcache_flush( void );
+
 
 /* stdio.h */
 
@@ -0,0 +1,28 @@
+#pragma once
+/* Dispatch of string routines to CPU-specific implementations <string_dispatch.h>
+
+   The public functions call through these pointers, which start out pointing
+   at the portable versions and are replaced at startup by _init_libc() with
+   the best versions the CPU supports.
+*/
+
+#include "j6libc/cpp.h"
+#include "j6libc/int.h"
+#include "j6libc/size_t.h"
+
+CPP_CHECK_BEGIN
+
+extern void * (*_PDCLIB_memcpy_impl)( void * restrict, const void * restrict, size_t );
+extern void * (*_PDCLIB_memchr_impl)( const void *, int, size_t );
+extern int (*_PDCLIB_memcmp_impl)( const void *, const void *, size_t );
+extern char * (*_PDCLIB_strchr_impl)( const char *, int );
+extern size_t (*_PDCLIB_strlen_impl)( const char * );
+
+/* Portable versions */
+void * _PDCLIB_memcpy_generic( void * restrict s1, const void * restrict s2, size_t n );
+void * _PDCLIB_memchr_generic( const void * s, int c, size_t n );
+int _PDCLIB_memcmp_generic( const void * s1, const void * s2, size_t n );
+char * _PDCLIB_strchr_generic( const char * s, int c );
+size_t _PDCLIB_strlen_generic( const char * s );
+
+CPP_CHECK_END
@@ -0,0 +1,21 @@
+#pragma once
+/* Threads <threads.h>
+
+   This file is part of the Public Domain C Library (PDCLib).
+   Permission is granted to use, modify, and / or redistribute at will.
+*/
+
+#include "j6libc/cpp.h"
+
+CPP_CHECK_BEGIN
+
+/* TODO: The rest of C11 threads. Threads are created with
+   j6_thread_create() for now. */
+
+/* Terminate the calling thread, returning res as its result. Threads
+   should exit through this rather than j6_thread_exit(), so the library
+   can release their resources.
+*/
+void thrd_exit( int res );
+
+CPP_CHECK_END
@@ -4,13 +4,19 @@
    Permission is granted to use, modify, and / or redistribute at will.
 */
 
-/* This is an example implementation of _PDCLIB_allocpages() fit for use with
-   POSIX kernels.
+/* Grows or shrinks the heap VMA through sbrk(), which malloc also uses for
+   its contiguous heap.
 */
 
+#include <stdint.h>
 #include "j6libc/glue.h"
 
+void *sbrk(intptr_t);
+
 void * _PDCLIB_allocpages( int const n )
 {
-	return 0;
+	void *prev = sbrk((intptr_t)n * _PDCLIB_PAGESIZE);
+	if (prev == (void*)-1)
+		return 0;
+	return prev;
 }
@@ -0,0 +1,124 @@
+/* _PDCLIB_mmap( size_t ) / _PDCLIB_munmap( void *, size_t )
+
+   Anonymous memory mappings for malloc's large allocations. Each mapping is
+   its own VMA, so freeing it returns its pages to the kernel right away
+   instead of leaving a hole in the sbrk heap.
+*/
+
+#include <stdint.h>
+#include <j6/errors.h>
+#include <j6/flags.h>
+#include <j6/syscalls.h>
+#include <j6/types.h>
+#include "j6libc/glue.h"
+
+extern j6_handle_t __handle_self;
+
+/* Mappings are placed in [__map_base, __map_end), well above the sbrk
+   heap and below the thread stacks. */
+static const uintptr_t __map_base = 0x10000000000;
+static const uintptr_t __map_end  = 0x400000000000;
+
+#define MAX_MAPPINGS 256
+
+struct mapping
+{
+	uintptr_t base;
+	size_t size;
+	j6_handle_t handle;
+};
+
+/* Live mappings, sorted by base address */
+static struct mapping __maps[MAX_MAPPINGS];
+static unsigned __map_count = 0;
+
+static size_t
+page_align(size_t size)
+{
+	return (size + _PDCLIB_PAGESIZE - 1) & ~(size_t)(_PDCLIB_PAGESIZE - 1);
+}
+
+void * _PDCLIB_mmap( size_t size )
+{
+	if (!size || __map_count == MAX_MAPPINGS)
+		return (void*)-1;
+
+	size = page_align(size);
+
+	/* First fit: find the first gap between mappings big enough */
+	uintptr_t base = __map_base;
+	unsigned i = 0;
+	for (; i < __map_count; ++i) {
+		if (__maps[i].base - base >= size)
+			break;
+		base = __maps[i].base + page_align(__maps[i].size);
+	}
+
+	if (base + size > __map_end)
+		return (void*)-1;
+
+	j6_handle_t handle = j6_handle_invalid;
+	uint32_t flags = j6_vm_flag_write | j6_vm_flag_zero;
+	if (j6_vma_create_map(&handle, size, base, flags) != j6_status_ok)
+		return (void*)-1;
+
+	for (unsigned j = __map_count; j > i; --j)
+		__maps[j] = __maps[j - 1];
+	__maps[i].base = base;
+	__maps[i].size = size;
+	__maps[i].handle = handle;
+	++__map_count;
+
+	return (void*)base;
+}
+
+int _PDCLIB_munmap( void * addr, size_t size )
+{
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t end = start + page_align(size);
+	if (!size || end < start)
+		return -1;
+
+	/* Find the mappings overlapping [start, end) */
+	unsigned first = 0;
+	while (first < __map_count && __maps[first].base + __maps[first].size <= start)
+		++first;
+
+	unsigned last = first;
+	while (last < __map_count && __maps[last].base < end)
+		++last;
+
+	if (first == last)
+		return -1;
+
+	/* Check the whole range before changing anything, so a failure doesn't
+	   leave it partly unmapped. Mappings can only lose their tails, so the
+	   range must run to the end of every mapping it touches. */
+	struct mapping *tail = &__maps[last - 1];
+	if (end < tail->base + tail->size)
+		return -1;
+
+	struct mapping *head = &__maps[first];
+	if (start > head->base) {
+		/* Trim the tail of the first mapping by shrinking its VMA */
+		size_t new_size = start - head->base;
+		if (j6_vma_resize(head->handle, &new_size) != j6_status_ok ||
+			new_size != start - head->base)
+			return -1;
+
+		head->size = new_size;
+		++first;
+	}
+
+	for (unsigned i = first; i < last; ++i) {
+		j6_vma_unmap(__maps[i].handle, __handle_self);
+		j6_object_close(__maps[i].handle);
+	}
+
+	unsigned removed = last - first;
+	__map_count -= removed;
+	for (unsigned i = first; i < __map_count; ++i)
+		__maps[i] = __maps[i + removed];
+
+	return 0;
+}
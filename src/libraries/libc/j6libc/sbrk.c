@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <j6/errors.h>
+#include <j6/flags.h>
 #include <j6/syscalls.h>
 //void *sbrk(intptr_t) __attribute__ ((weak));
 
@@ -13,13 +14,15 @@ static const void *error_val = (void*)-1;
 void *sbrk(intptr_t i)
 {
 	if (i == 0)
-		return (void*)__core_base;
+		return (void*)(__core_base + __core_size);
 
 	if (__core_size == 0) {
 		if (i < 0)
 			return (void*)-1;
 
-		j6_status_t result = j6_vma_create_map(&__core_handle, i, __core_base, 1);
+		// malloc assumes memory from sbrk is already cleared
+		uint32_t flags = j6_vm_flag_write | j6_vm_flag_zero;
+		j6_status_t result = j6_vma_create_map(&__core_handle, i, __core_base, flags);
 		if (result != j6_status_ok)
 			return (void*)-1;
 
@@ -27,9 +30,12 @@ void *sbrk(intptr_t i)
 		return (void*)__core_base;
 	}
 
+	if (i < 0 && -i > __core_size)
+		return (void*)-1;
+
 	size_t new_size = __core_size + i;
 	j6_status_t result = j6_vma_resize(__core_handle, &new_size);
-	if (result != j6_status_ok)
+	if (result != j6_status_ok || new_size != __core_size + i)
 		return (void*)-1;
 
 	uintptr_t prev = __core_base + __core_size;
@@ -528,6 +528,18 @@ MAX_RELEASE_CHECK_RATE   default: 4095 unless not HAVE_MMAP
 #define DLMALLOC_EXPORT extern
 #endif
 
+#ifdef __JSIX__
+/* The heap grows with sbrk() in one VMA, and large allocations get their
+   own VMAs, which are released as soon as they're freed. The public malloc
+   functions are in tcache.c, which calls these dl-prefixed ones under a
+   lock for anything its thread caches don't handle. */
+#include "j6libc/glue.h"
+#define USE_DL_PREFIX
+#define MMAP(s)          _PDCLIB_mmap(s)
+#define DIRECT_MMAP(s)   _PDCLIB_mmap(s)
+#define MUNMAP(a, s)     _PDCLIB_munmap((a), (s))
+#endif
+
 #ifndef WIN32
 #ifdef _WIN32
 #define WIN32 1
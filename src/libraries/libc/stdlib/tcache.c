@@ -0,0 +1,434 @@
+/* malloc( size_t ), calloc( size_t, size_t ), realloc( void *, size_t ),
+   free( void * )
+
+   Thread-caching front end for the heap. Small allocations are served from
+   size-classed free lists cached per thread, which need no locking. Those
+   lists are refilled from, and overflow back into, central free lists with
+   a lock per size class. Objects in the central lists are carved out of
+   spans of one arena VMA. Anything larger than the biggest size class goes
+   to dlmalloc (malloc.c) under a single heap lock.
+
+   There's no TLS yet, so thread caches are found through a table indexed
+   by the calling thread's stack slot. Each thread's stack region is
+   aligned to its size, so the slot is just a shift of the stack pointer.
+   The caches themselves are allocated from the arena like any other small
+   object, away from the stacks, so a stack overflow can't run into them.
+   A thread should exit through thrd_exit(), which flushes its cache back
+   to the central lists; a cache left behind by a thread that didn't is
+   picked up by the next thread to use that stack slot.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <j6/errors.h>
+#include <j6/flags.h>
+#include <j6/init.h>
+#include <j6/syscalls.h>
+#include <j6/types.h>
+
+void * dlmalloc( size_t );
+void * dlcalloc( size_t, size_t );
+void * dlrealloc( void *, size_t );
+void dlfree( void * );
+
+/* Spans are carved from this region, between the sbrk heap and the
+   mappings of _PDCLIB_mmap() */
+static const uintptr_t __arena_base = 0x1000000000;
+static const size_t __arena_max = 0x1000000000;
+
+/* Amount to grow the arena VMA by at once */
+static const size_t __arena_grow = 0x100000;
+
+#define SPAN_SIZE   0x10000
+#define SPAN_HEADER 64
+
+#define NUM_CLASSES 16
+#define MAX_SMALL   512
+
+/* Stack slots covered by the thread cache table. Threads in slots past
+   this go straight to the central lists. */
+#define MAX_THREADS 1024
+
+static const uint16_t __class_size[NUM_CLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512 };
+
+/* Size class for each (size + 15) / 16 */
+static const uint8_t __class_index[MAX_SMALL / 16 + 1] = {
+	0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+	12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15 };
+
+struct span
+{
+	uint32_t size_class;
+};
+
+struct free_list
+{
+	void *head;
+	size_t count;
+};
+
+struct central_list
+{
+	int lock;
+	struct free_list list;
+};
+
+struct thread_cache
+{
+	struct free_list bins[NUM_CLASSES];
+};
+
+static struct central_list __central[NUM_CLASSES];
+
+static struct thread_cache *__caches[MAX_THREADS];
+
+static int __arena_lock = 0;
+static j6_handle_t __arena_handle = j6_handle_invalid;
+static size_t __arena_size = 0;
+static size_t __arena_used = 0;
+
+static int __heap_lock = 0;
+
+static inline void
+lock( int *l )
+{
+	while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(l, __ATOMIC_RELAXED))
+			__asm__ __volatile__ ( "pause" );
+	}
+}
+
+static inline void
+unlock( int *l )
+{
+	__atomic_store_n(l, 0, __ATOMIC_RELEASE);
+}
+
+static inline int
+is_small( void *p )
+{
+	size_t arena_size = __atomic_load_n(&__arena_size, __ATOMIC_RELAXED);
+	return (uintptr_t)p - __arena_base < arena_size;
+}
+
+static inline unsigned
+object_class( void *p )
+{
+	uintptr_t span = (uintptr_t)p & ~(uintptr_t)(SPAN_SIZE - 1);
+	return ((struct span *)span)->size_class;
+}
+
+/* Number of objects moved between a thread cache and the central list at
+   once: about a page worth, within limits */
+static inline size_t
+batch_count( unsigned cls )
+{
+	size_t n = 4096 / __class_size[cls];
+	return n < 4 ? 4 : n > 32 ? 32 : n;
+}
+
+/* Get a new span from the arena. Called with the class's central lock
+   held. */
+static struct span *
+new_span()
+{
+	lock(&__arena_lock);
+
+	if (__arena_used + SPAN_SIZE > __arena_size) {
+		size_t size = __arena_size + __arena_grow;
+		if (size > __arena_max) {
+			unlock(&__arena_lock);
+			return NULL;
+		}
+
+		j6_status_t result;
+		if (__arena_handle == j6_handle_invalid) {
+			uint32_t flags = j6_vm_flag_write | j6_vm_flag_zero;
+			result = j6_vma_create_map(&__arena_handle, size, __arena_base, flags);
+		} else {
+			result = j6_vma_resize(__arena_handle, &size);
+			if (size != __arena_size + __arena_grow)
+				result = j6_err_insufficient;
+		}
+
+		if (result != j6_status_ok) {
+			unlock(&__arena_lock);
+			return NULL;
+		}
+
+		__atomic_store_n(&__arena_size, size, __ATOMIC_RELAXED);
+	}
+
+	struct span *span = (struct span *)(__arena_base + __arena_used);
+	__arena_used += SPAN_SIZE;
+
+	unlock(&__arena_lock);
+	return span;
+}
+
+/* Make sure a central list has objects, carving a new span into it if
+   it's empty. Called with the list's lock held. Returns 0 if no memory
+   could be found. */
+static int
+fill_central( struct central_list *central, unsigned cls )
+{
+	if (central->list.head)
+		return 1;
+
+	struct span *span = new_span();
+	if (!span)
+		return 0;
+
+	/* Carve the whole span into the central list */
+	span->size_class = cls;
+	size_t size = __class_size[cls];
+	char *p = (char *)span + SPAN_HEADER;
+	char *end = (char *)span + SPAN_SIZE - size;
+	size_t count = 0;
+	void *head = NULL;
+	for (; p <= end; p += size, ++count) {
+		*(void **)p = head;
+		head = p;
+	}
+
+	central->list.head = head;
+	central->list.count = count;
+	return 1;
+}
+
+/* Take one object straight from a central list, for threads without a
+   cache. Returns NULL if no memory could be found. */
+static void *
+central_alloc( unsigned cls )
+{
+	struct central_list *central = &__central[cls];
+	lock(&central->lock);
+
+	void *p = NULL;
+	if (fill_central(central, cls)) {
+		p = central->list.head;
+		central->list.head = *(void **)p;
+		--central->list.count;
+	}
+
+	unlock(&central->lock);
+	return p;
+}
+
+/* Return a list of objects straight to a central list */
+static void
+central_free( void *first, void *last, size_t count, unsigned cls )
+{
+	struct central_list *central = &__central[cls];
+	lock(&central->lock);
+	*(void **)last = central->list.head;
+	central->list.head = first;
+	central->list.count += count;
+	unlock(&central->lock);
+}
+
+/* Size class the thread caches themselves are allocated from */
+static inline unsigned
+cache_class()
+{
+	return __class_index[(sizeof(struct thread_cache) + 15) / 16];
+}
+
+/* Index of the calling thread's stack slot, or MAX_THREADS if it's not in
+   one the cache table covers */
+static inline size_t
+current_slot()
+{
+	uintptr_t sp = (uintptr_t)__builtin_frame_address(0);
+	if (sp >= j6_thread_stacks_top)
+		return MAX_THREADS;
+
+	size_t slot = (j6_thread_stacks_top - 1 - sp) / j6_thread_stack_size;
+	return slot < MAX_THREADS ? slot : MAX_THREADS;
+}
+
+/* Find the calling thread's cache, creating it if this thread doesn't have
+   one yet. Returns NULL if the thread can't have a cache. */
+static struct thread_cache *
+current_cache()
+{
+	size_t slot = current_slot();
+	if (slot == MAX_THREADS)
+		return NULL;
+
+	/* Only this thread uses its slot, so no lock is needed */
+	struct thread_cache *cache = __caches[slot];
+	if (!cache) {
+		cache = (struct thread_cache *)central_alloc(cache_class());
+		if (cache) {
+			memset(cache, 0, sizeof(*cache));
+			__caches[slot] = cache;
+		}
+	}
+	return cache;
+}
+
+/* Move a batch of objects from the central list into a thread's bin.
+   Returns 0 if no memory could be found. */
+static int
+refill( struct free_list *bin, unsigned cls )
+{
+	struct central_list *central = &__central[cls];
+	lock(&central->lock);
+
+	if (!fill_central(central, cls)) {
+		unlock(&central->lock);
+		return 0;
+	}
+
+	size_t want = batch_count(cls);
+	void *first = central->list.head;
+	void *last = first;
+	size_t n = 1;
+	while (n < want && *(void **)last) {
+		last = *(void **)last;
+		++n;
+	}
+
+	central->list.head = *(void **)last;
+	central->list.count -= n;
+	unlock(&central->lock);
+
+	*(void **)last = bin->head;
+	bin->head = first;
+	bin->count += n;
+	return 1;
+}
+
+/* Move a batch of objects from a thread's bin back to the central list */
+static void
+release( struct free_list *bin, unsigned cls )
+{
+	size_t n = batch_count(cls);
+	void *first = bin->head;
+	void *last = first;
+	for (size_t i = 1; i < n; ++i)
+		last = *(void **)last;
+
+	bin->head = *(void **)last;
+	bin->count -= n;
+
+	central_free(first, last, n, cls);
+}
+
+void _PDCLIB_tcache_flush( void )
+{
+	size_t slot = current_slot();
+	if (slot == MAX_THREADS || !__caches[slot])
+		return;
+
+	struct thread_cache *cache = __caches[slot];
+	for (unsigned cls = 0; cls < NUM_CLASSES; ++cls) {
+		struct free_list *bin = &cache->bins[cls];
+		if (!bin->head)
+			continue;
+
+		void *last = bin->head;
+		while (*(void **)last)
+			last = *(void **)last;
+		central_free(bin->head, last, bin->count, cls);
+	}
+
+	__caches[slot] = NULL;
+	central_free(cache, cache, 1, cache_class());
+}
+
+void * malloc( size_t size )
+{
+	if (size <= MAX_SMALL) {
+		unsigned cls = __class_index[(size + 15) / 16];
+		struct thread_cache *cache = current_cache();
+		if (!cache)
+			return central_alloc(cls);
+
+		struct free_list *bin = &cache->bins[cls];
+		if (!bin->head && !refill(bin, cls))
+			return NULL;
+
+		void *p = bin->head;
+		bin->head = *(void **)p;
+		--bin->count;
+		return p;
+	}
+
+	lock(&__heap_lock);
+	void *p = dlmalloc(size);
+	unlock(&__heap_lock);
+	return p;
+}
+
+void free( void * ptr )
+{
+	if (!ptr)
+		return;
+
+	if (is_small(ptr)) {
+		unsigned cls = object_class(ptr);
+		struct thread_cache *cache = current_cache();
+		if (!cache) {
+			central_free(ptr, ptr, 1, cls);
+			return;
+		}
+
+		struct free_list *bin = &cache->bins[cls];
+		*(void **)ptr = bin->head;
+		bin->head = ptr;
+		if (++bin->count > 2 * batch_count(cls))
+			release(bin, cls);
+		return;
+	}
+
+	lock(&__heap_lock);
+	dlfree(ptr);
+	unlock(&__heap_lock);
+}
+
+void * calloc( size_t nmemb, size_t size )
+{
+	size_t total;
+	if (__builtin_mul_overflow(nmemb, size, &total))
+		return NULL;
+
+	if (total <= MAX_SMALL) {
+		void *p = malloc(total);
+		if (p)
+			memset(p, 0, total);
+		return p;
+	}
+
+	lock(&__heap_lock);
+	void *p = dlcalloc(nmemb, size);
+	unlock(&__heap_lock);
+	return p;
+}
+
+void * realloc( void * ptr, size_t size )
+{
+	if (!ptr)
+		return malloc(size);
+
+	if (!is_small(ptr)) {
+		lock(&__heap_lock);
+		void *p = dlrealloc(ptr, size);
+		unlock(&__heap_lock);
+		return p;
+	}
+
+	size_t old_size = __class_size[object_class(ptr)];
+	if (size <= old_size && size > old_size / 2)
+		return ptr;
+
+	void *p = malloc(size);
+	if (p) {
+		memcpy(p, ptr, size < old_size ? size : old_size);
+		free(ptr);
+	}
+	return p;
+}
@@ -5,8 +5,9 @@
 */
 
 #include <string.h>
+#include "j6libc/string_dispatch.h"
 
-void * memchr( const void * s, int c, size_t n )
+void * _PDCLIB_memchr_generic( const void * s, int c, size_t n )
 {
     const unsigned char * p = (const unsigned char *) s;
     while ( n-- )
@@ -19,3 +20,10 @@ void * memchr( const void * s, int c, size_t n )
     }
     return NULL;
 }
+
+void * (*_PDCLIB_memchr_impl)( const void *, int, size_t ) = _PDCLIB_memchr_generic;
+
+void * memchr( const void * s, int c, size_t n )
+{
+    return _PDCLIB_memchr_impl( s, c, n );
+}
@@ -5,8 +5,9 @@
 */
 
 #include <string.h>
+#include "j6libc/string_dispatch.h"
 
-int memcmp( const void * s1, const void * s2, size_t n )
+int _PDCLIB_memcmp_generic( const void * s1, const void * s2, size_t n )
 {
     const unsigned char * p1 = (const unsigned char *) s1;
     const unsigned char * p2 = (const unsigned char *) s2;
@@ -21,3 +22,10 @@ int memcmp( const void * s1, const void * s2, size_t n )
     }
     return 0;
 }
+
+int (*_PDCLIB_memcmp_impl)( const void *, const void *, size_t ) = _PDCLIB_memcmp_generic;
+
+int memcmp( const void * s1, const void * s2, size_t n )
+{
+    return _PDCLIB_memcmp_impl( s1, s2, n );
+}
@@ -5,8 +5,9 @@
 */
 
 #include <string.h>
+#include "j6libc/string_dispatch.h"
 
-void * memcpy( void * restrict s1, const void * restrict s2, size_t n )
+void * _PDCLIB_memcpy_generic( void * restrict s1, const void * restrict s2, size_t n )
 {
     char * dest = (char *) s1;
     const char * src = (const char *) s2;
@@ -31,3 +32,10 @@ void * memcpy( void * restrict s1, const void * restrict s2, size_t n )
 
     return s1;
 }
+
+void * (*_PDCLIB_memcpy_impl)( void * restrict, const void * restrict, size_t ) = _PDCLIB_memcpy_generic;
+
+void * memcpy( void * restrict s1, const void * restrict s2, size_t n )
+{
+    return _PDCLIB_memcpy_impl( s1, s2, n );
+}
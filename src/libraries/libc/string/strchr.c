@@ -5,8 +5,9 @@
 */
 
 #include <string.h>
+#include "j6libc/string_dispatch.h"
 
-char * strchr( const char * s, int c )
+char * _PDCLIB_strchr_generic( const char * s, int c )
 {
     do
     {
@@ -17,3 +18,10 @@ char * strchr( const char * s, int c )
     } while ( *s++ );
     return NULL;
 }
+
+char * (*_PDCLIB_strchr_impl)( const char *, int ) = _PDCLIB_strchr_generic;
+
+char * strchr( const char * s, int c )
+{
+    return _PDCLIB_strchr_impl( s, c );
+}
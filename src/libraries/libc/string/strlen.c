@@ -5,8 +5,9 @@
 */
 
 #include <string.h>
+#include "j6libc/string_dispatch.h"
 
-size_t strlen( const char * s )
+size_t _PDCLIB_strlen_generic( const char * s )
 {
     size_t rc = 0;
     while ( s[rc] )
@@ -15,3 +16,10 @@ size_t strlen( const char * s )
     }
     return rc;
 }
+
+size_t (*_PDCLIB_strlen_impl)( const char * ) = _PDCLIB_strlen_generic;
+
+size_t strlen( const char * s )
+{
+    return _PDCLIB_strlen_impl( s );
+}
@@ -0,0 +1,17 @@
+/* thrd_exit( int )
+
+   This file is part of the Public Domain C Library (PDCLib).
+   Permission is granted to use, modify, and / or redistribute at will.
+*/
+
+#include <stdint.h>
+#include <threads.h>
+#include <j6/syscalls.h>
+#include "j6libc/glue.h"
+
+void thrd_exit( int res )
+{
+    _PDCLIB_tcache_flush();
+    j6_thread_exit( (int32_t)res );
+    for ( ;; );
+}
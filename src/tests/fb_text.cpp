@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "font.h"
+#include "screen.h"
+#include "catch.hpp"
+
+static const unsigned test_width = 640;
+static const unsigned test_height = 480;
+static const unsigned test_scanline = 704;
+
+/// Draw text one pixel at a time, the way the fb driver used to
+static void
+draw_text_pixels(screen &scr, const font &fnt, const char *text, size_t len,
+		screen::pixel_t fg, screen::pixel_t bg, unsigned x, unsigned y, unsigned spacing)
+{
+	for (size_t i = 0; i < len; ++i) {
+		uint8_t glyph = text[i];
+		for (unsigned dy = 0; dy < fnt.height(); ++dy)
+			for (unsigned dx = 0; dx < fnt.width(); ++dx)
+				scr.draw_pixel(x + i * spacing + dx, y + dy,
+						fnt.pixel(glyph, dx, dy) ? fg : bg);
+	}
+}
+
+TEST_CASE( "fb cached glyphs match the font bitmap", "[fb]" )
+{
+	std::vector<uint32_t> fb1(test_scanline * test_height);
+	std::vector<uint32_t> fb2(test_scanline * test_height);
+	screen scr1(fb1.data(), test_width, test_height, test_scanline, screen::pixel_order::bgr8);
+	screen scr2(fb2.data(), test_width, test_height, test_scanline, screen::pixel_order::rgb8);
+
+	font fnt;
+	REQUIRE( fnt.valid() );
+
+	const unsigned spacing = fnt.width() + 2;
+	char text[64];
+	for (unsigned i = 0; i < sizeof(text); ++i)
+		text[i] = 0x20 + i;
+
+	// Alternate colors so more than one cache entry gets used and evicted
+	for (unsigned row = 0; row < 8; ++row) {
+		screen::pixel_t fg = 0xb0b0b0 + row;
+		screen::pixel_t bg = 0x314f80 + row % 6;
+		unsigned y = row * (fnt.height() + 2);
+
+		scr1.fill(bg);
+		scr2.fill(bg);
+		fnt.draw_text(scr1, text, sizeof(text), fg, bg, 2, y, spacing);
+		draw_text_pixels(scr2, fnt, text, sizeof(text), fg, bg, 2, y, spacing);
+		fnt.draw_glyph(scr1, 'x', fg, bg, 2, y + fnt.height());
+		draw_text_pixels(scr2, fnt, "x", 1, fg, bg, 2, y + fnt.height(), spacing);
+
+		scr1.update();
+		scr2.update();
+		CAPTURE( row );
+		CHECK( fb1 == fb2 );
+	}
+}
+
+TEST_CASE( "fb screen updates only dirty spans", "[fb]" )
+{
+	std::vector<uint32_t> fb(test_scanline * test_height);
+	screen scr(fb.data(), test_width, test_height, test_scanline, screen::pixel_order::bgr8);
+
+	scr.fill(0);
+	scr.update();
+	CHECK( fb[0] == 0 );
+
+	scr.draw_pixel(10, 20, 1);
+	scr.draw_pixel(11, 21, 2);
+	scr.mark_dirty(10, 20, 1, 1);
+	scr.update();
+
+	CHECK( fb[20 * test_scanline + 10] == 1 );
+	CHECK( fb[21 * test_scanline + 11] == 0 );
+}
+
+TEST_CASE( "fb screen presents changed pixels at the frame rate", "[fb]" )
+{
+	std::vector<uint32_t> fb(test_scanline * test_height);
+	screen scr(fb.data(), test_width, test_height, test_scanline, screen::pixel_order::bgr8);
+	scr.set_frame_interval(1000);
+
+	scr.fill(0);
+	CHECK( scr.present(1000) );
+	CHECK( scr.next_frame() == 2000 );
+
+	// Too early: nothing is written until the next frame is due
+	scr.draw_pixel(5, 5, 7);
+	scr.mark_dirty(0, 5, test_width, 1);
+	CHECK( !scr.present(1500) );
+	CHECK( fb[5 * test_scanline + 5] == 0 );
+
+	// Pixels that didn't change aren't rewritten, even if marked dirty
+	fb[5 * test_scanline + 100] = 0xdead;
+	CHECK( scr.present(2000) );
+	CHECK( fb[5 * test_scanline + 5] == 7 );
+	CHECK( fb[5 * test_scanline + 100] == 0xdead );
+}
+
+// Benchmark rendering a full screen of text, hidden by default; run with
+// `tests [benchmark]`.
+
+TEST_CASE( "fb text rendering benchmark", "[.][benchmark]" )
+{
+	const unsigned width = 1920, height = 1080;
+	std::vector<uint32_t> fb(width * height);
+	screen scr(fb.data(), width, height, width, screen::pixel_order::bgr8);
+	font fnt;
+
+	const unsigned xstride = fnt.width() + 2;
+	const unsigned ystride = fnt.height() + 2;
+	const unsigned cols = (width - 2) / xstride;
+	const unsigned rows = (height - 2) / ystride;
+
+	std::vector<char> line(cols);
+	for (unsigned i = 0; i < cols; ++i)
+		line[i] = 0x21 + (i % 94);
+
+	screen::pixel_t fg = scr.color(0xb0, 0xb0, 0xb0);
+	screen::pixel_t bg = scr.color(49, 79, 128);
+
+	using clock = std::chrono::steady_clock;
+	const unsigned iterations = 20;
+
+	auto time_ms = [&](auto fn) {
+		auto start = clock::now();
+		for (unsigned i = 0; i < iterations; ++i)
+			fn();
+		std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+		return elapsed.count() / iterations;
+	};
+
+	double pixels = time_ms([&]{
+		for (unsigned y = 0; y < rows; ++y)
+			draw_text_pixels(scr, fnt, line.data(), cols, fg, bg, 2, 2 + y * ystride, xstride);
+	});
+
+	double cached = time_ms([&]{
+		for (unsigned y = 0; y < rows; ++y)
+			fnt.draw_text(scr, line.data(), cols, fg, bg, 2, 2 + y * ystride, xstride);
+	});
+
+	std::printf("%ux%u text (%ux%u chars): per-pixel %.2f ms, cached glyphs %.2f ms\n",
+			width, height, cols, rows, pixels, cached);
+}
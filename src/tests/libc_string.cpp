@@ -0,0 +1,273 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "string_simd.h"
+#include "catch.hpp"
+
+// The portable libc versions these replace, as they were before the
+// SIMD versions existed. The libc sources themselves can't be linked in
+// alongside the host libc.
+
+static void *
+generic_memcpy(void *s1, const void *s2, size_t n)
+{
+	char *dest = (char *)s1;
+	const char *src = (const char *)s2;
+
+	if (((uintptr_t)src & 7) == ((uintptr_t)dest & 7)) {
+		while (((uintptr_t)src & 7) && n--)
+			*dest++ = *src++;
+
+		const uint64_t *srcq = (const uint64_t*)src;
+		uint64_t *destq = (uint64_t*)dest;
+		while (n >= 8) {
+			*destq++ = *srcq++;
+			n -= 8;
+		}
+
+		src = (const char*)srcq;
+		dest = (char*)destq;
+	}
+
+	while (n--)
+		*dest++ = *src++;
+	return s1;
+}
+
+static void *
+generic_memchr(const void *s, int c, size_t n)
+{
+	const volatile unsigned char *p = (const unsigned char *)s;
+	for (; n--; ++p)
+		if (*p == (unsigned char)c) return (void *)p;
+	return nullptr;
+}
+
+static int
+generic_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const volatile unsigned char *p1 = (const unsigned char *)s1;
+	const volatile unsigned char *p2 = (const unsigned char *)s2;
+	for (; n--; ++p1, ++p2)
+		if (*p1 != *p2) return *p1 - *p2;
+	return 0;
+}
+
+static char *
+generic_strchr(const char *s, int c)
+{
+	const volatile char *p = s;
+	do {
+		if (*p == (char)c) return (char *)p;
+	} while (*p++);
+	return nullptr;
+}
+
+static size_t
+generic_strlen(const char *s)
+{
+	const volatile char *p = s;
+	size_t rc = 0;
+	while (p[rc]) ++rc;
+	return rc;
+}
+
+struct string_impl
+{
+	const char *name;
+	void * (*memcpy)(void *, const void *, size_t);
+	void * (*memchr)(const void *, int, size_t);
+	int (*memcmp)(const void *, const void *, size_t);
+	char * (*strchr)(const char *, int);
+	size_t (*strlen)(const char *);
+};
+
+static const string_impl generic_impl = { "generic",
+	generic_memcpy, generic_memchr, generic_memcmp, generic_strchr, generic_strlen };
+
+static const string_impl sse2_impl = { "sse2",
+	_PDCLIB_memcpy_sse2, _PDCLIB_memchr_sse2, _PDCLIB_memcmp_sse2,
+	_PDCLIB_strchr_sse2, _PDCLIB_strlen_sse2 };
+
+static const string_impl avx2_impl = { "avx2",
+	_PDCLIB_memcpy_avx2, _PDCLIB_memchr_avx2, _PDCLIB_memcmp_avx2,
+	_PDCLIB_strchr_avx2, _PDCLIB_strlen_avx2 };
+
+static std::vector<const string_impl *>
+simd_impls()
+{
+	std::vector<const string_impl *> impls = { &sse2_impl };
+	if (__builtin_cpu_supports("avx2"))
+		impls.push_back(&avx2_impl);
+	return impls;
+}
+
+static const size_t sizes[] = {
+	0, 1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 1000 };
+
+static const size_t max_size = 1000;
+static const size_t max_align = 64;
+
+TEST_CASE( "libc SIMD memcpy", "[libc] [string]" )
+{
+	using clock = std::chrono::system_clock;
+	unsigned seed = clock::now().time_since_epoch().count();
+	std::default_random_engine rng(seed);
+	std::uniform_int_distribution<int> distrib(0, 255);
+
+	std::vector<uint8_t> src(max_size + max_align);
+	for (auto &b : src) b = distrib(rng);
+
+	for (const string_impl *impl : simd_impls()) {
+		for (size_t n : sizes) {
+			for (size_t align = 0; align < max_align; align += 5) {
+				std::vector<uint8_t> dst(max_size + 2 * max_align, 0xcc);
+				uint8_t *d = dst.data() + max_align / 2 + align % 16;
+				const uint8_t *s = src.data() + align;
+
+				CAPTURE( impl->name );
+				CAPTURE( n );
+				CAPTURE( align );
+				CHECK( impl->memcpy(d, s, n) == d );
+				CHECK( std::memcmp(d, s, n) == 0 );
+				CHECK( d[-1] == 0xcc );
+				CHECK( d[n] == 0xcc );
+			}
+		}
+	}
+}
+
+TEST_CASE( "libc SIMD memchr and memcmp", "[libc] [string]" )
+{
+	std::vector<uint8_t> a(max_size + max_align);
+	std::vector<uint8_t> b(max_size + max_align);
+
+	for (const string_impl *impl : simd_impls()) {
+		for (size_t n : sizes) {
+			for (size_t align = 0; align < max_align; align += 7) {
+				std::memset(a.data(), 'a', a.size());
+				std::memset(b.data(), 'a', b.size());
+				uint8_t *pa = a.data() + align;
+				uint8_t *pb = b.data() + (align * 3) % max_align;
+
+				CAPTURE( impl->name );
+				CAPTURE( n );
+				CAPTURE( align );
+
+				CHECK( impl->memchr(pa, 'x', n) == nullptr );
+				CHECK( impl->memcmp(pa, pb, n) == 0 );
+
+				// A match just past the end must not be found
+				pa[n] = 'x';
+				CHECK( impl->memchr(pa, 'x', n) == nullptr );
+
+				for (size_t i = 0; i < n; i += (n / 7) + 1) {
+					pa[i] = 'x';
+					CHECK( impl->memchr(pa, 'x', n) == pa + i );
+
+					CHECK( impl->memcmp(pa, pb, n) > 0 );
+					CHECK( impl->memcmp(pb, pa, n) < 0 );
+					pa[i] = 'a';
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE( "libc SIMD strlen and strchr", "[libc] [string]" )
+{
+	std::vector<char> buf(max_size + 2 * max_align);
+
+	for (const string_impl *impl : simd_impls()) {
+		for (size_t n : sizes) {
+			for (size_t align = 0; align < max_align; ++align) {
+				// Fill the area before the string with the searched-for
+				// character, which must not be found
+				std::memset(buf.data(), 'x', buf.size());
+				char *s = buf.data() + max_align + align;
+				std::memset(s, 'a', n);
+				s[n] = 0;
+
+				CAPTURE( impl->name );
+				CAPTURE( n );
+				CAPTURE( align );
+				CHECK( impl->strlen(s) == n );
+				CHECK( impl->strchr(s, 'x') == nullptr );
+				CHECK( impl->strchr(s, 0) == s + n );
+
+				if (n) {
+					s[n - 1] = 'x';
+					CHECK( impl->strchr(s, 'x') == s + n - 1 );
+					s[0] = 'x';
+					CHECK( impl->strchr(s, 'x') == s );
+				}
+			}
+		}
+	}
+}
+
+
+// Benchmark of the SIMD versions against the generic ones. Hidden by
+// default; run with `tests [benchmark]`.
+
+template <typename F>
+static double
+time_ns(F fn, size_t n)
+{
+	using clock = std::chrono::steady_clock;
+
+	size_t iterations = (64 << 20) / (n + 16);
+	auto start = clock::now();
+	for (size_t i = 0; i < iterations; ++i)
+		fn();
+	auto end = clock::now();
+
+	std::chrono::duration<double, std::nano> elapsed = end - start;
+	return elapsed.count() / iterations;
+}
+
+TEST_CASE( "libc string benchmarks", "[.][benchmark]" )
+{
+	static const size_t bench_sizes[] = {8, 32, 128, 512, 4096};
+
+	std::vector<const string_impl *> impls = simd_impls();
+	impls.insert(impls.begin(), &generic_impl);
+
+	std::vector<char> a(4096 + 64, 'a');
+	std::vector<char> b(4096 + 64, 'a');
+
+	std::printf("%-8s %6s", "op", "size");
+	for (const string_impl *impl : impls)
+		std::printf(" %10s", impl->name);
+	std::printf("   (ns)\n");
+
+	for (size_t n : bench_sizes) {
+		char *pa = a.data() + 1;
+		char *pb = b.data() + 3;
+		pa[n] = 0;
+
+		const char *ops[] = {"memcpy", "memchr", "memcmp", "strchr", "strlen"};
+		for (unsigned op = 0; op < 5; ++op) {
+			std::printf("%-8s %6zu", ops[op], n);
+			for (const string_impl *impl : impls) {
+				double t = 0;
+				switch (op) {
+				case 0: t = time_ns([=]{ impl->memcpy(pb, pa, n); }, n); break;
+				case 1: t = time_ns([=]{ impl->memchr(pa, 'x', n); }, n); break;
+				case 2: t = time_ns([=]{ impl->memcmp(pa, pb, n); }, n); break;
+				case 3: t = time_ns([=]{ impl->strchr(pa, 'x'); }, n); break;
+				case 4: t = time_ns([=]{ impl->strlen(pa); }, n); break;
+				}
+				std::printf(" %10.1f", t);
+			}
+			std::printf("\n");
+		}
+
+		pa[n] = 'a';
+	}
+}
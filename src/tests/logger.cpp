@@ -1,3 +1,5 @@
+#include <cstdio>
+#include <cstring>
 #include "kutil/constexpr_hash.h"
 #include "kutil/logger.h"
 #include "catch.hpp"
@@ -30,3 +32,149 @@ TEST_CASE( "logger writing", "[logger]" )
 	log::warn(hash1, "This is a thing %016lx", 682);
 	log::error(hash2, "This is a string %s", "bar");
 }
+
+static unsigned test_cpu = 0;
+static unsigned get_test_cpu() { return test_cpu; }
+
+static size_t
+read_message(log::logger &logger, char *message, size_t size, unsigned &sequence)
+{
+	uint8_t buffer[256];
+	size_t n = logger.get_entry(buffer, sizeof(buffer));
+	if (!n) return 0;
+
+	auto *ent = reinterpret_cast<log::logger::entry*>(buffer);
+	size_t len = ent->bytes - sizeof(log::logger::entry);
+	if (len >= size) len = size - 1;
+	std::memcpy(message, ent->message, len);
+	message[len] = 0;
+	sequence = ent->sequence;
+	return n;
+}
+
+TEST_CASE( "logger merges per-CPU rings in order", "[logger]" )
+{
+	static uint8_t buffer[0x400];
+	std::memset(buffer, 0, sizeof(buffer));
+
+	log::logger logger(buffer, sizeof(buffer), nullptr, 4);
+	logger.register_area(hash1, name1, log::level::debug);
+	logger.set_cpu(get_test_cpu);
+
+	for (unsigned i = 0; i < 8; ++i) {
+		test_cpu = (i * 3) % 5;
+		log::info(hash1, "message %d", i);
+	}
+	CHECK( logger.has_log() );
+
+	char message[64];
+	char expected[64];
+	for (unsigned i = 0; i < 8; ++i) {
+		unsigned sequence = 0;
+		REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+		std::snprintf(expected, sizeof(expected), "message %d", i);
+		CHECK( sequence == i );
+		CHECK( std::strcmp(message, expected) == 0 );
+	}
+
+	CHECK( !logger.has_log() );
+	CHECK( logger.get_entry(message, sizeof(message)) == 0 );
+}
+
+TEST_CASE( "logger rings wrap and drop when full", "[logger]" )
+{
+	static uint8_t buffer[0x100];
+	std::memset(buffer, 0, sizeof(buffer));
+
+	log::logger logger(buffer, sizeof(buffer));
+	logger.register_area(hash1, name1, log::level::debug);
+
+	// Records don't divide the ring evenly, so this wraps with padding
+	char message[64];
+	for (unsigned i = 0; i < 100; ++i) {
+		log::info(hash1, "wrap %d", i);
+		log::info(hash1, "around %d", i);
+
+		unsigned sequence = 0;
+		REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+		REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+		REQUIRE( sequence == (i * 2 + 1) % 256 );
+	}
+	CHECK( !logger.has_log() );
+	CHECK( logger.dropped() == 0 );
+
+	for (unsigned i = 0; i < 32; ++i)
+		log::info(hash1, "fill %d", i);
+	CHECK( logger.dropped() > 0 );
+
+	unsigned sequence = 0;
+	REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+	CHECK( std::strcmp(message, "fill 0") == 0 );
+}
+
+TEST_CASE( "logger binary mode formats on read", "[logger]" )
+{
+	static uint8_t buffer[0x400];
+	std::memset(buffer, 0, sizeof(buffer));
+
+	log::logger logger(buffer, sizeof(buffer));
+	logger.register_area(hash1, name1, log::level::debug);
+	logger.set_binary(true);
+
+	char str[] = "before";
+	log::info(hash1, "%d %s %016lx", -5, str, 0x1234);
+	std::strcpy(str, "after");
+
+	log::info(hash1, "%*d|%-4s|%%|%c", 4, 7, "ab", 'z');
+	log::info(hash1, "%s and %s", static_cast<const char*>(nullptr), "more");
+
+	const char *expected[] = {
+		"-5 before 0000000000001234",
+		"   7|ab  |%|z",
+		"(null) and more",
+	};
+
+	char message[64];
+	for (const char *e : expected) {
+		unsigned sequence = 0;
+		REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+		CHECK( std::strcmp(message, e) == 0 );
+	}
+	CHECK( !logger.has_log() );
+}
+
+extern "C" log::site __start_log_sites[], __stop_log_sites[];
+
+TEST_CASE( "logger sites can be toggled", "[logger]" )
+{
+	static uint8_t buffer[0x400];
+	std::memset(buffer, 0, sizeof(buffer));
+
+	constexpr log::area_t area = "test_area3"_h;
+
+	log::logger logger(buffer, sizeof(buffer));
+	logger.register_area(area, "test_area3", log::level::debug);
+	logger.set_sites(__start_log_sites, __stop_log_sites);
+
+	auto log_both = [] {
+		log_info(area, "first");
+		log_info(area, "second");
+	};
+	unsigned second_line = __LINE__ - 2;
+
+	CHECK( logger.set_sites_enabled("tests/logger.cpp", second_line, false) == 1 );
+	CHECK( logger.set_sites_enabled("other.cpp", 0, false) == 0 );
+	log_both();
+
+	char message[64];
+	unsigned sequence = 0;
+	REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+	CHECK( std::strcmp(message, "first") == 0 );
+	CHECK( !logger.has_log() );
+
+	CHECK( logger.set_sites_enabled("logger.cpp", 0, true) == 2 );
+	log_both();
+	REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+	REQUIRE( read_message(logger, message, sizeof(message), sequence) );
+	CHECK( std::strcmp(message, "second") == 0 );
+}
@@ -0,0 +1,217 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kutil/memory.h"
+#include "catch.hpp"
+
+static const size_t sizes[] = {
+	0, 1, 2, 3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65,
+	100, 255, 256, 511, 512, 513, 1000, 4096, 4097, 10000 };
+
+static const size_t max_size = 10000;
+static const size_t max_align = 32;
+static const size_t guard = 64;
+
+static void
+fill_random(std::vector<uint8_t> &buf, std::default_random_engine &rng)
+{
+	std::uniform_int_distribution<int> distrib(0, 255);
+	for (auto &b : buf) b = distrib(rng);
+}
+
+TEST_CASE( "memset sizes and alignments", "[memory]" )
+{
+	std::vector<uint8_t> buf(max_size + max_align + 2 * guard);
+
+	for (size_t n : sizes) {
+		for (size_t align = 0; align < max_align; ++align) {
+			std::memset(buf.data(), 0xcc, buf.size());
+			uint8_t *p = buf.data() + guard + align;
+
+			void *r = kutil::memset(p, 0x5a, n);
+			CHECK( r == p );
+
+			CAPTURE( n );
+			CAPTURE( align );
+			for (size_t i = 0; i < buf.size(); ++i) {
+				bool inside = &buf[i] >= p && &buf[i] < p + n;
+				if (buf[i] != (inside ? 0x5a : 0xcc))
+					FAIL( "Wrong value at byte " << i );
+			}
+		}
+	}
+}
+
+TEST_CASE( "memcpy sizes and alignments", "[memory]" )
+{
+	using clock = std::chrono::system_clock;
+	unsigned seed = clock::now().time_since_epoch().count();
+	std::default_random_engine rng(seed);
+
+	std::vector<uint8_t> src(max_size + max_align);
+	std::vector<uint8_t> dst(max_size + max_align + 2 * guard);
+	fill_random(src, rng);
+
+	for (size_t n : sizes) {
+		for (size_t salign = 0; salign < max_align; salign += 3) {
+			for (size_t dalign = 0; dalign < max_align; dalign += 5) {
+				std::memset(dst.data(), 0xcc, dst.size());
+				const uint8_t *s = src.data() + salign;
+				uint8_t *d = dst.data() + guard + dalign;
+
+				void *r = kutil::memcpy(d, s, n);
+				CHECK( r == d );
+
+				CAPTURE( n );
+				CAPTURE( salign );
+				CAPTURE( dalign );
+				CHECK( std::memcmp(d, s, n) == 0 );
+				for (uint8_t *b = dst.data(); b < d; ++b)
+					if (*b != 0xcc) FAIL( "Wrote before destination" );
+				for (uint8_t *b = d + n; b < dst.data() + dst.size(); ++b)
+					if (*b != 0xcc) FAIL( "Wrote past destination" );
+			}
+		}
+	}
+}
+
+TEST_CASE( "memmove overlapping areas", "[memory]" )
+{
+	using clock = std::chrono::system_clock;
+	unsigned seed = clock::now().time_since_epoch().count();
+	std::default_random_engine rng(seed);
+
+	std::vector<uint8_t> buf(max_size + 2 * guard);
+	std::vector<uint8_t> expected(buf.size());
+
+	const ptrdiff_t shifts[] = {-65, -33, -32, -17, -8, -1, 0, 1, 3, 8, 16, 31, 32, 100};
+
+	for (size_t n : sizes) {
+		if (n + 2 * 100 > max_size) continue;
+
+		for (ptrdiff_t shift : shifts) {
+			fill_random(buf, rng);
+			expected = buf;
+
+			uint8_t *s = buf.data() + guard + 100;
+			uint8_t *d = s + shift;
+			std::memmove(expected.data() + (d - buf.data()), s, n);
+
+			void *r = kutil::memmove(d, s, n);
+			CHECK( r == d );
+
+			CAPTURE( n );
+			CAPTURE( shift );
+			CHECK( buf == expected );
+		}
+	}
+}
+
+TEST_CASE( "non-temporal zeroing", "[memory]" )
+{
+	std::vector<uint8_t> buf(max_size + max_align + 2 * guard);
+
+	for (size_t n : sizes) {
+		for (size_t align = 0; align < max_align; align += 7) {
+			std::memset(buf.data(), 0xcc, buf.size());
+			uint8_t *p = buf.data() + guard + align;
+
+			kutil::zero_nontemporal(p, n);
+
+			CAPTURE( n );
+			CAPTURE( align );
+			for (size_t i = 0; i < buf.size(); ++i) {
+				bool inside = &buf[i] >= p && &buf[i] < p + n;
+				if (buf[i] != (inside ? 0 : 0xcc))
+					FAIL( "Wrong value at byte " << i );
+			}
+		}
+	}
+}
+
+
+// Microbenchmarks comparing the kutil routines with plain byte loops, like
+// the ones they replaced, and with the host libc. Hidden by default; run
+// with `tests [benchmark]`.
+
+static void *
+byte_memcpy(void *dest, const void *src, size_t n)
+{
+	const volatile uint8_t *s = reinterpret_cast<const uint8_t *>(src);
+	uint8_t *d = reinterpret_cast<uint8_t *>(dest);
+	for (size_t i = 0; i < n; ++i) d[i] = s[i];
+	return dest;
+}
+
+static void *
+byte_memset(void *s, int v, size_t n)
+{
+	volatile uint8_t *p = reinterpret_cast<uint8_t *>(s);
+	for (size_t i = 0; i < n; ++i) p[i] = v;
+	return s;
+}
+
+template <typename F>
+static double
+time_ns(F fn, size_t n)
+{
+	using clock = std::chrono::steady_clock;
+
+	// Aim for roughly 64MiB of traffic per measurement
+	size_t iterations = (64 << 20) / (n + 16);
+	auto start = clock::now();
+	for (size_t i = 0; i < iterations; ++i)
+		fn();
+	auto end = clock::now();
+
+	std::chrono::duration<double, std::nano> elapsed = end - start;
+	return elapsed.count() / iterations;
+}
+
+TEST_CASE( "memory routine benchmarks", "[.][benchmark]" )
+{
+	static const size_t bench_sizes[] = {8, 16, 32, 64, 128, 256, 512, 1024, 4096, 65536};
+	static const size_t bench_aligns[] = {0, 1, 7};
+
+	std::vector<uint8_t> src(65536 + max_align);
+	std::vector<uint8_t> dst(65536 + max_align);
+
+	std::printf("%-8s %6s %5s %12s %12s %12s\n",
+			"op", "size", "align", "byte (ns)", "kutil (ns)", "libc (ns)");
+
+	for (size_t n : bench_sizes) {
+		for (size_t align : bench_aligns) {
+			uint8_t *d = dst.data() + align;
+			uint8_t *s = src.data() + (align * 3) % max_align;
+
+			double byte = time_ns([=]{ byte_memcpy(d, s, n); }, n);
+			double kut = time_ns([=]{ kutil::memcpy(d, s, n); }, n);
+			double libc = time_ns([=]{ std::memcpy(d, s, n); }, n);
+			std::printf("%-8s %6zu %5zu %12.1f %12.1f %12.1f\n",
+					"memcpy", n, align, byte, kut, libc);
+
+			byte = time_ns([=]{ byte_memset(d, 0, n); }, n);
+			kut = time_ns([=]{ kutil::memset(d, 0, n); }, n);
+			libc = time_ns([=]{ std::memset(d, 0, n); }, n);
+			std::printf("%-8s %6zu %5zu %12.1f %12.1f %12.1f\n",
+					"memset", n, align, byte, kut, libc);
+
+			kut = time_ns([=]{ kutil::memmove(d + 1, d, n - 1); }, n);
+			libc = time_ns([=]{ std::memmove(d + 1, d, n - 1); }, n);
+			std::printf("%-8s %6zu %5zu %12s %12.1f %12.1f\n",
+					"memmove", n, align, "-", kut, libc);
+		}
+	}
+
+	for (size_t n : {4096ul, 65536ul}) {
+		double temporal = time_ns([&]{ kutil::memset(dst.data(), 0, n); }, n);
+		double nt = time_ns([&]{ kutil::zero_nontemporal(dst.data(), n); }, n);
+		std::printf("%-8s %6zu %5s %12s %12.1f %12.1f  (non-temporal)\n",
+				"zero", n, "-", "-", temporal, nt);
+	}
+}
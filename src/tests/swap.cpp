@@ -0,0 +1,181 @@
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "kernel_memory.h"
+#include "ram_disk.h"
+#include "swap.h"
+#include "swap_device.h"
+#include "catch.hpp"
+
+using memory::frame_size;
+
+/// Page-sized blocks of memory for a ram_disk
+class disk_pages
+{
+public:
+	disk_pages(size_t count) : m_memory(count * frame_size)
+	{
+		for (size_t i = 0; i < count; ++i)
+			m_pages.append(&m_memory[i * frame_size]);
+	}
+
+	const kutil::vector<void*> & pages() const { return m_pages; }
+
+private:
+	std::vector<uint8_t> m_memory;
+	kutil::vector<void*> m_pages;
+};
+
+TEST_CASE( "ram disk reads back what was written", "[swap]" )
+{
+	disk_pages pages(3);
+	ram_disk disk(pages.pages());
+	REQUIRE( disk.size() == 3 * frame_size );
+
+	// Transfers straddle page boundaries
+	uint8_t out[frame_size + 100];
+	for (size_t i = 0; i < sizeof(out); ++i)
+		out[i] = i * 7;
+
+	const size_t offset = frame_size - 50;
+	CHECK( disk.write(offset, sizeof(out), out) == sizeof(out) );
+
+	uint8_t in[sizeof(out)] = {0};
+	CHECK( disk.read(offset, sizeof(in), in) == sizeof(in) );
+	CHECK( std::memcmp(in, out, sizeof(in)) == 0 );
+
+	// Transfers are clipped to the end of the device
+	const size_t tail = disk.size() - 10;
+	CHECK( disk.write(tail, sizeof(out), out) == 10 );
+	CHECK( disk.read(tail, sizeof(in), in) == 10 );
+	CHECK( disk.read(disk.size(), sizeof(in), in) == 0 );
+}
+
+TEST_CASE( "swap slots are allocated, freed, and hold pages", "[swap]" )
+{
+	// An odd number of slots leaves the end of the slot bitmap unused
+	const size_t count = 67;
+	disk_pages pages(count);
+	ram_disk disk(pages.pages());
+	swap_device swap(&disk);
+
+	REQUIRE( swap.slots() == count );
+	REQUIRE( swap.free_slots() == count );
+
+	std::vector<bool> used(count, false);
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t slot = 0;
+		REQUIRE( swap.allocate(slot) );
+		REQUIRE( slot < count );
+		CHECK( !used[slot] );
+		used[slot] = true;
+	}
+
+	uint32_t slot = 0;
+	CHECK( swap.free_slots() == 0 );
+	CHECK( !swap.allocate(slot) );
+
+	swap.free(42);
+	CHECK( swap.free_slots() == 1 );
+	REQUIRE( swap.allocate(slot) );
+	CHECK( slot == 42 );
+
+	std::vector<uint8_t> out(frame_size);
+	std::vector<uint8_t> in(frame_size);
+	for (size_t i = 0; i < frame_size; ++i)
+		out[i] = i ^ 0x5a;
+
+	CHECK( swap.write(slot, out.data()) );
+	CHECK( swap.read(slot, in.data()) );
+	CHECK( in == out );
+}
+
+/// Pages of an area, scanned for eviction the way vm_area_open does
+struct aging_area
+{
+	aging_area(size_t count) : accessed(count, false), resident(count, true) {}
+
+	/// Scan up to `scan` resident pages from the hand and sweep them
+	size_t reclaim(size_t count, size_t scan)
+	{
+		std::vector<uintptr_t> offsets;
+		size_t i = hand / frame_size;
+		for (; i < resident.size() && offsets.size() < scan; ++i)
+			if (resident[i])
+				offsets.push_back(i * frame_size);
+
+		while (i < resident.size() && !resident[i]) ++i;
+		hand = i < resident.size() ? i * frame_size : 0;
+
+		return clock_sweep(offsets.data(), offsets.data(), offsets.size(), count, hand,
+			[this](uintptr_t off) {
+				bool was = accessed[off / frame_size];
+				accessed[off / frame_size] = false;
+				return was;
+			},
+			[this](uintptr_t off, uintptr_t) {
+				resident[off / frame_size] = false;
+				return true;
+			});
+	}
+
+	size_t resident_count() const {
+		size_t n = 0;
+		for (bool r : resident) n += r;
+		return n;
+	}
+
+	std::vector<bool> accessed;
+	std::vector<bool> resident;
+	uintptr_t hand = 0;
+};
+
+TEST_CASE( "page aging gives referenced pages a second chance", "[swap]" )
+{
+	aging_area area(8);
+	for (size_t i = 0; i < 8; i += 2)
+		area.accessed[i] = true;
+
+	// The first pass only evicts pages that weren't accessed
+	CHECK( area.reclaim(8, 8) == 4 );
+	for (size_t i = 0; i < 8; ++i)
+		CHECK( area.resident[i] == (i % 2 == 0) );
+
+	// Accessing a page again saves it from the next pass
+	area.accessed[4] = true;
+	CHECK( area.reclaim(8, 8) == 3 );
+	CHECK( area.resident_count() == 1 );
+	CHECK( area.resident[4] );
+	CHECK( !area.accessed[4] );
+
+	// Unless it goes unused until the pass after that
+	CHECK( area.reclaim(8, 8) == 1 );
+	CHECK( area.resident_count() == 0 );
+}
+
+TEST_CASE( "page aging resumes from the hand", "[swap]" )
+{
+	aging_area area(16);
+
+	// Stopping at the eviction count leaves the hand at the next page
+	CHECK( area.reclaim(3, 8) == 3 );
+	CHECK( area.hand == 3 * frame_size );
+	CHECK( !area.resident[0] );
+	CHECK( !area.resident[2] );
+	CHECK( area.resident[3] );
+
+	// Scanning a batch to its end leaves the hand past it
+	area.accessed[3] = true;
+	CHECK( area.reclaim(16, 4) == 3 );
+	CHECK( area.resident[3] );
+	CHECK( !area.resident[6] );
+	CHECK( area.hand == 7 * frame_size );
+
+	// And the hand wraps around at the end of the area
+	CHECK( area.reclaim(16, 16) == 9 );
+	CHECK( area.hand == 0 );
+	CHECK( area.resident_count() == 1 );
+	CHECK( area.reclaim(16, 16) == 1 );
+	CHECK( area.resident_count() == 0 );
+}
@@ -0,0 +1,174 @@
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "j6/errors.h"
+#include "j6/syscalls.h"
+#include "catch.hpp"
+
+// Stand-ins for the syscalls and dlmalloc the thread cache sits on top of.
+// The arena is reserved up front at the address libc uses, and grows by
+// making more of the reservation accessible.
+
+static uint8_t *arena = nullptr;
+static size_t arena_reserved = 0;
+static size_t dl_frees = 0;
+
+extern "C" j6_status_t
+j6_vma_create_map(j6_handle_t *handle, size_t size, uintptr_t base, uint32_t flags)
+{
+	if (!arena) {
+		arena_reserved = 0x1000000000;
+		void *p = mmap(reinterpret_cast<void*>(base), arena_reserved, PROT_NONE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED_NOREPLACE, -1, 0);
+		if (p == MAP_FAILED)
+			return j6_err_nyi;
+		arena = reinterpret_cast<uint8_t*>(p);
+	}
+
+	mprotect(arena, size, PROT_READ|PROT_WRITE);
+	*handle = 1;
+	return j6_status_ok;
+}
+
+extern "C" j6_status_t
+j6_vma_resize(j6_handle_t handle, size_t *size)
+{
+	mprotect(arena, *size, PROT_READ|PROT_WRITE);
+	return j6_status_ok;
+}
+
+static void * dlmalloc(size_t size) { return ::malloc(size); }
+static void * dlcalloc(size_t n, size_t size) { return ::calloc(n, size); }
+static void * dlrealloc(void *p, size_t size) { return ::realloc(p, size); }
+static void dlfree(void *p) { ++dl_frees; ::free(p); }
+
+// The libc sources can't be linked in alongside the host libc, so build
+// the thread cache here under other names.
+#define malloc tc_malloc
+#define calloc tc_calloc
+#define realloc tc_realloc
+#define free tc_free
+#include "../libraries/libc/stdlib/tcache.c"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+static bool in_arena(void *p) { return is_small(p); }
+
+TEST_CASE( "tcache serves small sizes from the arena", "[tcache]" )
+{
+	// A miss carves a new span for the class
+	void *p = tc_malloc(24);
+	REQUIRE( p );
+	CHECK( in_arena(p) );
+	CHECK( __class_size[object_class(p)] == 32 );
+
+	// Freeing and allocating again hits the cache
+	tc_free(p);
+	CHECK( tc_malloc(24) == p );
+	CHECK( tc_malloc(1) != p );
+
+	void *big = tc_malloc(MAX_SMALL + 1);
+	REQUIRE( big );
+	CHECK( !in_arena(big) );
+	tc_free(big);
+}
+
+TEST_CASE( "tcache hands overflow back to the central lists", "[tcache]" )
+{
+	unsigned cls = __class_index[(64 + 15) / 16];
+	size_t count = 4 * batch_count(cls);
+
+	std::vector<void*> ptrs;
+	for (size_t i = 0; i < count; ++i) {
+		void *p = tc_malloc(64);
+		REQUIRE( p );
+		std::memset(p, 0xaa, 64);
+		ptrs.push_back(p);
+	}
+
+	size_t central_before = __central[cls].list.count;
+	for (void *p : ptrs)
+		tc_free(p);
+
+	// The cache keeps at most two batches, the rest go back to the central list
+	struct thread_cache *cache = current_cache();
+	REQUIRE( cache );
+	CHECK( cache->bins[cls].count <= 2 * batch_count(cls) );
+	CHECK( __central[cls].list.count > central_before );
+
+	// Everything freed can be allocated again without new spans
+	size_t arena_used = __arena_used;
+	for (size_t i = 0; i < count; ++i)
+		CHECK( tc_malloc(64) );
+	CHECK( __arena_used == arena_used );
+}
+
+TEST_CASE( "tcache realloc moves between small and large", "[tcache]" )
+{
+	char *p = static_cast<char*>(tc_malloc(100));
+	REQUIRE( p );
+	for (int i = 0; i < 100; ++i)
+		p[i] = i;
+
+	// Sizes that still fit the class stay put
+	CHECK( tc_realloc(p, 112) == p );
+
+	// Growing past the small sizes moves it to dlmalloc
+	size_t frees = dl_frees;
+	char *q = static_cast<char*>(tc_realloc(p, 4000));
+	REQUIRE( q );
+	CHECK( !in_arena(q) );
+	for (int i = 0; i < 100; ++i)
+		CHECK( q[i] == i );
+
+	// And shrinking a small object moves it to a smaller class
+	char *r = static_cast<char*>(tc_malloc(300));
+	REQUIRE( r );
+	std::memset(r, 0x5a, 300);
+	char *s = static_cast<char*>(tc_realloc(r, 20));
+	REQUIRE( s );
+	CHECK( in_arena(s) );
+	CHECK( s != r );
+	CHECK( __class_size[object_class(s)] == 32 );
+	for (int i = 0; i < 20; ++i)
+		CHECK( s[i] == 0x5a );
+
+	// Freeing dlmalloc's memory goes back to dlmalloc
+	tc_free(q);
+	CHECK( dl_frees == frees + 1 );
+	tc_free(s);
+	CHECK( dl_frees == frees + 1 );
+}
+
+TEST_CASE( "tcache is flushed when a thread exits", "[tcache]" )
+{
+	unsigned cls = __class_index[(200 + 15) / 16];
+	void *a = tc_malloc(200);
+	void *b = tc_malloc(200);
+	REQUIRE( a );
+	REQUIRE( b );
+	tc_free(a);
+	tc_free(b);
+
+	struct thread_cache *cache = current_cache();
+	REQUIRE( cache );
+	size_t cached = cache->bins[cls].count;
+	REQUIRE( cached >= 2 );
+
+	size_t central = __central[cls].list.count;
+	_PDCLIB_tcache_flush();
+	CHECK( __central[cls].list.count == central + cached );
+	CHECK( __caches[current_slot()] == nullptr );
+
+	// A new cache is made on the next allocation
+	void *c = tc_malloc(200);
+	CHECK( c );
+	CHECK( __caches[current_slot()] != nullptr );
+	tc_free(c);
+}